@@ -1,8 +1,10 @@
-QT += core gui network widgets
+QT += core gui network widgets concurrent
 TARGET = Selectum
 TEMPLATE = app
 VERSION = 1.0.0.0
 DEFINES += QT_DEPRECATED_WARNINGS NVIDIA AMD
+# scoped tracing of the hot paths, saved from the tray menu or debug.trace
+#DEFINES += SELECTUM_TRACING
 CONFIG  += openssl-linked
 CONFIG -= embed_manifest_exe
 
@@ -36,7 +38,26 @@ SOURCES += \
     nvidianvml.cpp \
     nvocdialog.cpp \
     nvidiaapi.cpp \
-    amdapi_adl.cpp
+    amdapi_adl.cpp \
+    adaptivesampler.cpp \
+    metricsexporter.cpp \
+    controlserver.cpp \
+    shareledger.cpp \
+    gpuhashrate.cpp \
+    anomalydetector.cpp \
+    stratumproxy.cpp \
+    poolprober.cpp \
+    profitswitcher.cpp \
+    benchmark.cpp \
+    selectumconfig.cpp \
+    fleetprotocol.cpp \
+    fleetagent.cpp \
+    telemetrycodec.cpp \
+    logarchive.cpp \
+    logsearch.cpp \
+    minerio.cpp \
+    drivercallstats.cpp \
+    tracer.cpp
 
 HEADERS += \
     mainwindow.h \
@@ -46,7 +67,27 @@ HEADERS += \
     nvidianvml.h \
     nvocdialog.h \
     nvidiaapi.h \
-    amdapi_adl.h
+    amdapi_adl.h \
+    adaptivesampler.h \
+    metricsexporter.h \
+    controlserver.h \
+    shareledger.h \
+    gpuhashrate.h \
+    anomalydetector.h \
+    stratumproxy.h \
+    poolprober.h \
+    profitswitcher.h \
+    benchmark.h \
+    selectumconfig.h \
+    fleetprotocol.h \
+    fleetagent.h \
+    telemetrycodec.h \
+    spscqueue.h \
+    logarchive.h \
+    logsearch.h \
+    minerio.h \
+    drivercallstats.h \
+    tracer.h
 
 FORMS += \
     mainwindow.ui \
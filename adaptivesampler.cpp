@@ -0,0 +1,119 @@
+#include "adaptivesampler.h"
+#include <QtMath>
+
+adaptiveSampler::adaptiveSampler(unsigned int minIntervalMs, unsigned int maxIntervalMs) :
+    _minInterval(minIntervalMs),
+    _maxInterval(maxIntervalMs),
+    _budget(0.01),
+    _boostUntil(0),
+    _tuning(0)
+{
+    _clock.start();
+    for(int i = 0; i < MetricCount; i++)
+    {
+        _metrics[i].enabled = true;
+        _metrics[i].lastRead = -1;
+        _metrics[i].costUs = 1000;
+        _metrics[i].threshold = 1.0;
+        _metrics[i].interval = _minInterval;
+    }
+    // default change rates (per second) considered "moving"
+    _metrics[Temperature].threshold = 0.5;  // degree C
+    _metrics[Power].threshold = 5000;       // mW
+    _metrics[FanSpeed].threshold = 1.0;     // percent
+    _metrics[Clock].threshold = 20;         // MHz
+}
+
+void adaptiveSampler::setIntervalRange(unsigned int minIntervalMs, unsigned int maxIntervalMs)
+{
+    _minInterval = minIntervalMs;
+    _maxInterval = qMax(minIntervalMs, maxIntervalMs);
+}
+
+void adaptiveSampler::setMetricCost(metric m, unsigned int costUs)
+{
+    _metrics[m].costUs = costUs;
+}
+
+void adaptiveSampler::setChangeThreshold(metric m, double perSecond)
+{
+    _metrics[m].threshold = perSecond;
+}
+
+void adaptiveSampler::setEnabled(metric m, bool enabled)
+{
+    _metrics[m].enabled = enabled;
+}
+
+void adaptiveSampler::boost(unsigned int msec)
+{
+    _boostUntil.store(_clock.elapsed() + msec);
+}
+
+bool adaptiveSampler::isBoosted()
+{
+    return _tuning.load() || _clock.elapsed() < _boostUntil.load();
+}
+
+unsigned int adaptiveSampler::floorInterval(const metricState& state) const
+{
+    // driver time spent on one read of every GPU, in ms, divided by the budget
+    unsigned int devices = qMax(1, state.lastValues.size());
+    double costMs = (double)state.costUs * devices / 1000.0;
+    unsigned int budgetFloor = (unsigned int)(costMs / _budget);
+    return qBound(_minInterval, budgetFloor, _maxInterval);
+}
+
+bool adaptiveSampler::isDue(metric m)
+{
+    const metricState& state = _metrics[m];
+    if(!state.enabled)
+        return false;
+    if(state.lastRead < 0)
+        return true;
+    unsigned int interval = isBoosted() ? floorInterval(state) : state.interval;
+    return _clock.elapsed() - state.lastRead >= interval;
+}
+
+void adaptiveSampler::addSamples(metric m, const QVector<int>& values)
+{
+    metricState& state = _metrics[m];
+    qint64 now = _clock.elapsed();
+
+    if(state.lastRead >= 0 && state.lastValues.size() == values.size() && now > state.lastRead)
+    {
+        int maxDelta = 0;
+        for(int i = 0; i < values.size(); i++)
+            maxDelta = qMax(maxDelta, qAbs(values.at(i) - state.lastValues.at(i)));
+
+        double rate = maxDelta * 1000.0 / (now - state.lastRead);
+        if(rate >= state.threshold)
+            state.interval = _minInterval;
+        else if(rate < state.threshold / 4)
+            state.interval = qMin(state.interval * 2, _maxInterval);
+    }
+    else
+        state.interval = _minInterval;
+
+    state.lastValues = values;
+    state.lastRead = now;
+    state.interval = qMax(state.interval, floorInterval(state));
+}
+
+unsigned int adaptiveSampler::nextInterval()
+{
+    qint64 now = _clock.elapsed();
+    qint64 next = _maxInterval;
+    bool boosted = isBoosted();
+    for(int i = 0; i < MetricCount; i++)
+    {
+        const metricState& state = _metrics[i];
+        if(!state.enabled)
+            continue;
+        if(state.lastRead < 0)
+            return 0;
+        unsigned int interval = boosted ? floorInterval(state) : state.interval;
+        next = qMin(next, state.lastRead + interval - now);
+    }
+    return (unsigned int)qMax<qint64>(next, 0);
+}
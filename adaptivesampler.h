@@ -0,0 +1,66 @@
+#ifndef ADAPTIVESAMPLER_H
+#define ADAPTIVESAMPLER_H
+
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QVector>
+
+// Polls a metric fast while it moves (or while tuning), backs off to the
+// slow rate when it is stable, and never lets the driver cost of a metric
+// exceed the overhead budget.
+class adaptiveSampler
+{
+public:
+    enum metric
+    {
+        Temperature = 0,
+        Power,
+        FanSpeed,
+        Clock,
+        MetricCount
+    };
+
+    adaptiveSampler(unsigned int minIntervalMs = 250, unsigned int maxIntervalMs = 30000);
+
+    void setIntervalRange(unsigned int minIntervalMs, unsigned int maxIntervalMs);
+    void setMetricCost(metric m, unsigned int costUs);
+    void setChangeThreshold(metric m, double perSecond);
+    void setEnabled(metric m, bool enabled);
+    void setOverheadBudget(double fraction){_budget = fraction;}
+
+    // Keep every metric at the fast rate for the next msec milliseconds
+    void boost(unsigned int msec);
+    void setTuning(bool tuning){_tuning.store(tuning ? 1 : 0);}
+    bool isBoosted();
+
+    bool isDue(metric m);
+    // Values of m just read from every GPU, in GPU order
+    void addSamples(metric m, const QVector<int>& values);
+    // Milliseconds to sleep before the next metric becomes due
+    unsigned int nextInterval();
+
+    unsigned int interval(metric m){return _metrics[m].interval;}
+
+private:
+    struct metricState
+    {
+        bool enabled;
+        QVector<int> lastValues;
+        qint64 lastRead;
+        unsigned int costUs;
+        double threshold;
+        unsigned int interval;
+    };
+
+    unsigned int floorInterval(const metricState& state) const;
+
+    metricState _metrics[MetricCount];
+    unsigned int _minInterval;
+    unsigned int _maxInterval;
+    double _budget;
+    QElapsedTimer _clock;
+    QAtomicInteger<qint64> _boostUntil;
+    QAtomicInt _tuning;
+};
+
+#endif // ADAPTIVESAMPLER_H
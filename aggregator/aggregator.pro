@@ -0,0 +1,23 @@
+QT += core network
+QT -= gui
+TARGET = SelectumAggregator
+TEMPLATE = app
+VERSION = 1.0.0.0
+CONFIG += console
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+    main.cpp \
+    fleetaggregator.cpp \
+    ../fleetprotocol.cpp \
+    ../telemetrycodec.cpp \
+    ../controlserver.cpp
+
+HEADERS += \
+    fleetaggregator.h \
+    ../fleetprotocol.h \
+    ../telemetrycodec.h \
+    ../controlserver.h
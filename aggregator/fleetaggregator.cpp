@@ -0,0 +1,445 @@
+#include "fleetaggregator.h"
+#include "controlserver.h"
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QTimer>
+#include <QDateTime>
+#include <QDebug>
+
+#define SECOND_POINTS   3600
+#define MINUTE_POINTS   1440
+#define STALL_MSEC      (30 * 1000)         // connected without a frame: the link is dead
+#define EXPIRE_MSEC     (10 * 60 * 1000)    // a discovered rig gone that long is forgotten
+
+fleetSeries::fleetSeries() : _secondPos(0)
+                           , _minutePos(0)
+                           , _minuteSamples(0)
+{
+    _seconds.reserve(SECOND_POINTS);
+    _minute = point();
+}
+
+void fleetSeries::push(QVector<point>& ring, int& pos, int capacity, const point& p)
+{
+    if(ring.size() < capacity)
+        ring << p;
+    else
+        ring[pos] = p;
+    pos = (pos + 1) % capacity;
+}
+
+void fleetSeries::add(const point& p)
+{
+    push(_seconds, _secondPos, SECOND_POINTS, p);
+
+    if(_minuteSamples && p.time / 60000 != _minute.time / 60000)
+    {
+        _minute.hashrate /= _minuteSamples;
+        _minute.power /= _minuteSamples;
+        _minute.time = _minute.time / 60000 * 60000;
+        push(_minutes, _minutePos, MINUTE_POINTS, _minute);
+        _minuteSamples = 0;
+    }
+    if(_minuteSamples == 0)
+    {
+        _minute = p;
+        _minuteSamples = 1;
+        return;
+    }
+    _minute.hashrate += p.hashrate;
+    _minute.power += p.power;
+    _minute.maxTemp = qMax(_minute.maxTemp, p.maxTemp);
+    _minute.accepted = p.accepted;
+    _minute.rejected = p.rejected;
+    _minuteSamples++;
+}
+
+QList<fleetSeries::point> fleetSeries::ordered(const QVector<point>& ring, int pos)
+{
+    QList<point> points;
+    for(int i = 0; i < ring.size(); i++)
+        points << ring.at((pos + i) % ring.size());
+    return points;
+}
+
+QJsonObject fleetSeries::toJson(const point& p)
+{
+    QJsonObject json;
+    json["time"] = (double)p.time;
+    json["hashrate"] = p.hashrate;
+    json["power"] = p.power;
+    json["maxTemp"] = p.maxTemp;
+    json["accepted"] = (double)p.accepted;
+    json["rejected"] = (double)p.rejected;
+    return json;
+}
+
+fleetAggregator::fleetAggregator(controlServer* control, QObject* pParent) : QObject(pParent)
+                                                                         , _control(control)
+                                                                         , _udp(Q_NULLPTR)
+                                                                         , _reconnect(new QTimer(this))
+                                                                         , _nextCommand(1)
+{
+    connect(_reconnect, &QTimer::timeout, this, &fleetAggregator::onReconnect);
+    _reconnect->start(10 * 1000);
+    registerMethods();
+}
+
+fleetAggregator::~fleetAggregator()
+{
+    qDeleteAll(_rigs);
+}
+
+bool fleetAggregator::startDiscovery()
+{
+    _udp = new QUdpSocket(this);
+    connect(_udp, &QUdpSocket::readyRead, this, &fleetAggregator::onBeacon);
+    if(!_udp->bind(QHostAddress::AnyIPv4, fleetProtocol::DEFAULT_PORT, QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint))
+    {
+        qDebug() << "cannot listen for beacons" << _udp->errorString();
+        return false;
+    }
+    return true;
+}
+
+void fleetAggregator::onBeacon()
+{
+    while(_udp->hasPendingDatagrams())
+    {
+        QByteArray datagram;
+        datagram.resize(_udp->pendingDatagramSize());
+        QHostAddress sender;
+        _udp->readDatagram(datagram.data(), datagram.size(), &sender);
+        QString name;
+        quint16 port;
+        if(!fleetProtocol::parseBeacon(datagram, &name, &port))
+            continue;
+        addRig(QHostAddress(sender.toIPv4Address()).toString(), port, true);
+    }
+}
+
+void fleetAggregator::addRig(const QString& address, quint16 port, bool discovered)
+{
+    foreach(rig* r, _rigs)
+        if(r->address == address && r->port == port) return;
+
+    rig* r = new rig;
+    r->name = address;
+    r->address = address;
+    r->port = port;
+    r->socket = new QTcpSocket(this);
+    r->connected = false;
+    r->lastSeen = 0;
+    r->since = QDateTime::currentMSecsSinceEpoch();
+    r->discovered = discovered;
+    r->latest = fleetProtocol::telemetry();
+    r->latest.time = 0;
+    r->latest.minerUp = false;
+    r->latest.hashrate = 0;
+    r->latest.accepted = r->latest.rejected = r->latest.stale = 0;
+    connect(r->socket, &QTcpSocket::connected, this, &fleetAggregator::onConnected);
+    connect(r->socket, &QTcpSocket::readyRead, this, &fleetAggregator::onReadyRead);
+    connect(r->socket, &QTcpSocket::disconnected, this, &fleetAggregator::onDisconnected);
+    _rigs << r;
+    qDebug() << "rig" << address << port;
+    connectRig(r);
+}
+
+void fleetAggregator::connectRig(rig* r)
+{
+    r->buffer.clear();
+    r->socket->abort();
+    r->socket->connectToHost(r->address, r->port);
+}
+
+void fleetAggregator::onReconnect()
+{
+    expireRigs();
+    foreach(rig* r, _rigs)
+    {
+        if(!r->connected && r->socket->state() == QAbstractSocket::UnconnectedState)
+            connectRig(r);
+    }
+}
+
+void fleetAggregator::expireRigs()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for(int i = _rigs.size() - 1; i >= 0; i--)
+    {
+        rig* r = _rigs.at(i);
+        qint64 seen = qMax(r->lastSeen, r->since);
+        if(r->connected && now - seen > STALL_MSEC)
+        {
+            qDebug() << "rig" << r->name << "silent, reconnecting";
+            // onDisconnected() reports it lost
+            r->socket->abort();
+            r->connected = false;
+        }
+        if(!r->discovered || r->connected || now - seen <= EXPIRE_MSEC)
+            continue;
+        QJsonObject data;
+        data["rig"] = r->name;
+        data["kind"] = "connection";
+        data["text"] = "expired";
+        _control->publish("event", data);
+        _rigs.removeAt(i);
+        r->socket->disconnect(this);
+        r->socket->abort();
+        r->socket->deleteLater();
+        delete r;
+    }
+}
+
+fleetAggregator::rig* fleetAggregator::rigFor(QObject* socket)
+{
+    foreach(rig* r, _rigs)
+        if(r->socket == socket) return r;
+    return Q_NULLPTR;
+}
+
+QList<fleetAggregator::rig*> fleetAggregator::select(const QString& name)
+{
+    QList<rig*> rigs;
+    foreach(rig* r, _rigs)
+        if(name == "*" || r->name == name || r->address == name) rigs << r;
+    return rigs;
+}
+
+void fleetAggregator::onConnected()
+{
+    rig* r = rigFor(sender());
+    if(!r)
+        return;
+    r->connected = true;
+    r->since = QDateTime::currentMSecsSinceEpoch();
+    r->decoder = telemetryDecoder();
+    fleetProtocol::hello h;
+    h.name = "aggregator";
+    h.version = fleetProtocol::VERSION;
+    h.key = _key;
+    r->socket->write(fleetProtocol::frame(fleetProtocol::Hello, fleetProtocol::encodeHello(h)));
+}
+
+void fleetAggregator::onDisconnected()
+{
+    rig* r = rigFor(sender());
+    if(!r)
+        return;
+    r->connected = false;
+    QJsonObject data;
+    data["rig"] = r->name;
+    data["kind"] = "connection";
+    data["text"] = "lost";
+    _control->publish("event", data);
+}
+
+void fleetAggregator::onReadyRead()
+{
+    rig* r = rigFor(sender());
+    if(!r)
+        return;
+    r->buffer += r->socket->readAll();
+    fleetProtocol::messageType type;
+    QByteArray payload;
+    bool error = false;
+    while(fleetProtocol::nextFrame(r->buffer, &type, &payload, &error))
+        handleFrame(r, type, payload);
+    if(error)
+    {
+        qDebug() << "corrupt stream from" << r->name;
+        r->socket->abort();
+    }
+}
+
+void fleetAggregator::handleFrame(rig* r, fleetProtocol::messageType type, const QByteArray& payload)
+{
+    r->lastSeen = QDateTime::currentMSecsSinceEpoch();
+    switch(type)
+    {
+    case fleetProtocol::Hello:
+        if(fleetProtocol::decodeHello(payload, &r->info) && !r->info.name.isEmpty())
+            r->name = r->info.name;
+        break;
+    case fleetProtocol::Telemetry:
+    {
+        if(!r->decoder.decode(payload, &r->latest))
+            break;
+        fleetSeries::point p;
+        p.time = r->latest.time;
+        p.hashrate = r->latest.hashrate;
+        p.power = 0;
+        p.maxTemp = 0;
+        foreach(const fleetProtocol::gpuSample& g, r->latest.gpus)
+        {
+            p.power += g.power / 1000.0;
+            p.maxTemp = qMax(p.maxTemp, (int)g.temp);
+        }
+        p.accepted = r->latest.accepted;
+        p.rejected = r->latest.rejected + r->latest.stale;
+        r->series.add(p);
+        break;
+    }
+    case fleetProtocol::Event:
+    {
+        fleetProtocol::event e;
+        if(!telemetryDecoder::decodeEvent(payload, &e))
+            break;
+        QJsonObject data;
+        data["rig"] = r->name;
+        data["time"] = (double)e.time;
+        data["kind"] = e.kind;
+        data["text"] = e.text;
+        _control->publish("event", data);
+        break;
+    }
+    case fleetProtocol::CommandResult:
+    {
+        fleetProtocol::command c;
+        if(!fleetProtocol::decodeCommandResult(payload, &c))
+            break;
+        QJsonObject data;
+        data["rig"] = r->name;
+        data["id"] = (double)c.id;
+        data["result"] = c.result.value("result");
+        if(!c.error.isEmpty())
+            data["error"] = c.error;
+        _control->publish("command", data);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+quint32 fleetAggregator::sendCommand(rig* r, const QString& method, const QJsonObject& params)
+{
+    fleetProtocol::command c;
+    c.id = _nextCommand++;
+    c.method = method;
+    c.params = params;
+    r->socket->write(fleetProtocol::frame(fleetProtocol::Command, fleetProtocol::encodeCommand(c)));
+    return c.id;
+}
+
+QJsonObject fleetAggregator::rigJson(const rig* r) const
+{
+    QJsonObject json;
+    json["name"] = r->name;
+    json["address"] = r->address + ":" + QString::number(r->port);
+    json["connected"] = r->connected;
+    json["algo"] = r->info.algo;
+    json["pool"] = r->info.pool;
+    json["minerUp"] = r->latest.minerUp;
+    json["hashrate"] = r->latest.hashrate;
+    json["accepted"] = (double)r->latest.accepted;
+    json["rejected"] = (double)r->latest.rejected;
+    json["stale"] = (double)r->latest.stale;
+    json["gpus"] = r->latest.gpus.size();
+    json["lastSeen"] = (double)r->lastSeen;
+    return json;
+}
+
+// Results of commands arrive later on the "command" topic, matched by id
+void fleetAggregator::registerMethods()
+{
+    _control->registerMethod("fleet.rigs", [this](const QJsonObject&, QString*) -> QJsonValue {
+        QJsonArray rigs;
+        double hashrate = 0;
+        foreach(rig* r, _rigs)
+        {
+            rigs.append(rigJson(r));
+            if(r->connected)
+                hashrate += r->latest.hashrate;
+        }
+        QJsonObject json;
+        json["rigs"] = rigs;
+        json["hashrate"] = hashrate;
+        return json;
+    });
+    _control->registerMethod("fleet.gpus", [this](const QJsonObject& params, QString* error) -> QJsonValue {
+        QList<rig*> rigs = select(params.value("rig").toString());
+        if(rigs.isEmpty())
+        {
+            *error = "unknown rig";
+            return QJsonValue();
+        }
+        QJsonArray gpus;
+        foreach(const fleetProtocol::gpuSample& g, rigs.first()->latest.gpus)
+        {
+            QJsonObject gpu;
+            gpu["temp"] = g.temp;
+            gpu["fan"] = g.fan;
+            gpu["gpuClock"] = g.gpuClock;
+            gpu["memClock"] = g.memClock;
+            gpu["power"] = g.power / 1000.0;
+            gpu["hashrate"] = g.hashrate;
+            gpus.append(gpu);
+        }
+        return gpus;
+    });
+    // params: rig (absent for the whole fleet), resolution "second" or "minute"
+    _control->registerMethod("fleet.series", [this](const QJsonObject& params, QString*) -> QJsonValue {
+        bool seconds = params.value("resolution").toString() == "second";
+        QString name = params.value("rig").toString();
+        QMap<qint64, fleetSeries::point> sum;
+        foreach(rig* r, name.isEmpty() ? _rigs : select(name))
+        {
+            QList<fleetSeries::point> points = seconds ? r->series.seconds() : r->series.minutes();
+            foreach(const fleetSeries::point& p, points)
+            {
+                qint64 slot = seconds ? p.time / 1000 * 1000 : p.time;
+                if(!sum.contains(slot))
+                {
+                    fleetSeries::point& total = sum[slot];
+                    total = p;
+                    total.time = slot;
+                    continue;
+                }
+                fleetSeries::point& total = sum[slot];
+                total.hashrate += p.hashrate;
+                total.power += p.power;
+                total.maxTemp = qMax(total.maxTemp, p.maxTemp);
+                total.accepted += p.accepted;
+                total.rejected += p.rejected;
+            }
+        }
+        QJsonArray series;
+        foreach(const fleetSeries::point& p, sum)
+            series.append(fleetSeries::toJson(p));
+        return series;
+    });
+    // params: rig ("*" for all), method, params
+    _control->registerMethod("fleet.command", [this](const QJsonObject& params, QString* error) -> QJsonValue {
+        QList<rig*> rigs = select(params.value("rig").toString());
+        if(rigs.isEmpty())
+        {
+            *error = "unknown rig";
+            return QJsonValue();
+        }
+        QJsonArray ids;
+        foreach(rig* r, rigs)
+        {
+            if(!r->connected)
+                continue;
+            QJsonObject sent;
+            sent["rig"] = r->name;
+            sent["id"] = (double)sendCommand(r, params.value("method").toString(), params.value("params").toObject());
+            ids.append(sent);
+        }
+        return ids;
+    });
+    _control->registerMethod("fleet.oc", [this](const QJsonObject& params, QString* error) -> QJsonValue {
+        QJsonObject command;
+        command["rig"] = params.value("rig");
+        command["method"] = "oc.apply";
+        command["params"] = params.value("params");
+        return _control->call("fleet.command", command, error);
+    });
+    _control->registerMethod("fleet.restart", [this](const QJsonObject& params, QString* error) -> QJsonValue {
+        QJsonObject command;
+        command["rig"] = params.value("rig");
+        command["method"] = "miner.restart";
+        return _control->call("fleet.command", command, error);
+    });
+}
@@ -0,0 +1,111 @@
+#ifndef FLEETAGGREGATOR_H
+#define FLEETAGGREGATOR_H
+
+#include <QObject>
+#include <QMap>
+#include <QList>
+#include <QVector>
+#include <QString>
+#include <QJsonArray>
+#include <QJsonObject>
+#include "fleetprotocol.h"
+#include "telemetrycodec.h"
+
+class QTcpSocket;
+class QUdpSocket;
+class QTimer;
+class controlServer;
+
+// Rig totals over time: one point a second for the last hour and
+// one averaged point a minute for the last day, both in rings.
+class fleetSeries
+{
+public:
+    struct point
+    {
+        qint64 time;
+        double hashrate;
+        double power;       // W
+        int maxTemp;
+        quint64 accepted;
+        quint64 rejected;
+    };
+
+    fleetSeries();
+    void add(const point& p);
+    QList<point> seconds() const {return ordered(_seconds, _secondPos);}
+    QList<point> minutes() const {return ordered(_minutes, _minutePos);}
+
+    static QJsonObject toJson(const point& p);
+
+private:
+    static QList<point> ordered(const QVector<point>& ring, int pos);
+    static void push(QVector<point>& ring, int& pos, int capacity, const point& p);
+
+    QVector<point> _seconds;
+    int _secondPos;
+    QVector<point> _minutes;
+    int _minutePos;
+    point _minute;
+    int _minuteSamples;
+};
+
+// Connects to every rig found by beacon or listed in aggregator.ini,
+// keeps their latest telemetry and series and relays commands. A rig that
+// stops streaming is reconnected; one found by beacon is forgotten once
+// it has been gone for a while.
+class fleetAggregator : public QObject
+{
+    Q_OBJECT
+public:
+    fleetAggregator(controlServer* control, QObject* pParent = Q_NULLPTR);
+    ~fleetAggregator();
+
+    void setKey(const QString& key){_key = key;}
+    // discovered: found by beacon, expires when gone
+    void addRig(const QString& address, quint16 port, bool discovered = false);
+    bool startDiscovery();
+
+private slots:
+    void onBeacon();
+    void onConnected();
+    void onReadyRead();
+    void onDisconnected();
+    void onReconnect();
+
+private:
+    struct rig
+    {
+        QString name;
+        QString address;
+        quint16 port;
+        QTcpSocket* socket;
+        QByteArray buffer;
+        bool connected;
+        fleetProtocol::hello info;
+        fleetProtocol::telemetry latest;
+        qint64 lastSeen;        // last frame
+        qint64 since;           // added or last connected
+        bool discovered;
+        fleetSeries series;
+        telemetryDecoder decoder;
+    };
+
+    rig* rigFor(QObject* socket);
+    QList<rig*> select(const QString& name);
+    void connectRig(rig* r);
+    void expireRigs();
+    void handleFrame(rig* r, fleetProtocol::messageType type, const QByteArray& payload);
+    quint32 sendCommand(rig* r, const QString& method, const QJsonObject& params);
+    void registerMethods();
+    QJsonObject rigJson(const rig* r) const;
+
+    controlServer* _control;
+    QUdpSocket* _udp;
+    QTimer* _reconnect;
+    QString _key;
+    QList<rig*> _rigs;
+    quint32 _nextCommand;
+};
+
+#endif // FLEETAGGREGATOR_H
@@ -0,0 +1,42 @@
+#include <QCoreApplication>
+#include <QSettings>
+#include <QDir>
+#include "controlserver.h"
+#include "fleetaggregator.h"
+
+// aggregator.ini:
+//   key=<fleetkey of the rigs>
+//   discovery=true
+//   controlsocket=selectum-aggregator
+//   controlport=45451
+//   rigs\1\address=192.168.1.20:45450
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QSettings settings(QDir::currentPath() + QDir::separator() + "aggregator.ini", QSettings::IniFormat);
+
+    controlServer control;
+    if(!control.listen(settings.value("controlsocket", "selectum-aggregator").toString()
+                       , settings.value("controlport", 45451).toUInt()))
+        return 1;
+
+    fleetAggregator fleet(&control);
+    fleet.setKey(settings.value("key").toString());
+    if(settings.value("discovery", true).toBool())
+        fleet.startDiscovery();
+
+    int size = settings.beginReadArray("rigs");
+    for(int i = 0; i < size; i++)
+    {
+        settings.setArrayIndex(i);
+        QString address = settings.value("address").toString();
+        int colon = address.lastIndexOf(':');
+        if(colon == -1)
+            fleet.addRig(address, fleetProtocol::DEFAULT_PORT);
+        else
+            fleet.addRig(address.left(colon), address.mid(colon + 1).toUShort());
+    }
+    settings.endArray();
+
+    return a.exec();
+}
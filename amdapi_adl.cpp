@@ -1,4 +1,5 @@
 #include "amdapi_adl.h"
+#include "drivercallstats.h"
 #include <QDebug>
 
 void* __stdcall ADL_Main_Memory_Alloc ( int iSize )
@@ -65,7 +66,7 @@ amdapi_adl::amdapi_adl() : QLibrary("atiadlxx")
         return;
     }
 
-    if (ADL_OK != ADL2_Main_Control_Create(ADL_Main_Memory_Alloc, 1, &_context))
+    if (ADL_OK != DRIVER_CALL(driverCallStats::Adl, ADL2_Main_Control_Create, ADL_Main_Memory_Alloc, 1, &_context))
     {
         qDebug("Failed to initialize nested ADL2 context");
         return ;
@@ -79,7 +80,7 @@ amdapi_adl::amdapi_adl() : QLibrary("atiadlxx")
         memset ( _lpAdapterInfo,'\0', sizeof (AdapterInfo) * _gpuCount );
 
         // Get the AdapterInfo structure for all adapters in the system
-        ADL_Adapter_AdapterInfo_Get (_lpAdapterInfo, sizeof (AdapterInfo) * _gpuCount);
+        DRIVER_CALL(driverCallStats::Adl, ADL_Adapter_AdapterInfo_Get, _lpAdapterInfo, sizeof (AdapterInfo) * _gpuCount);
         _isInitialized = true;
     }
 }
@@ -90,13 +91,13 @@ amdapi_adl::~amdapi_adl()
     if(_isInitialized)
     {
         free(_lpAdapterInfo);
-        ADL2_Main_Control_Destroy(&_context);
+        DRIVER_CALL(driverCallStats::Adl, ADL2_Main_Control_Destroy, &_context);
     }
 }
 
 int amdapi_adl::getGPUCount()
 {
-    if ( ADL_OK != ADL_Adapter_NumberOfAdapters_Get ( &_gpuCount ) )
+    if ( ADL_OK != DRIVER_CALL(driverCallStats::Adl, ADL_Adapter_NumberOfAdapters_Get,  &_gpuCount ) )
     {
         qDebug("Cannot get the number of adapters!");
         return 0;
@@ -109,10 +110,10 @@ int amdapi_adl::getGpuTemperature(int gpu)
 {
     int temp;
     int iSupported,iEnabled,iVersion;
-    ADL2_Overdrive_Caps(_context, _lpAdapterInfo[gpu].iAdapterIndex, &iSupported, &iEnabled, &iVersion);
+    DRIVER_CALL(driverCallStats::Adl, ADL2_Overdrive_Caps, _context, _lpAdapterInfo[gpu].iAdapterIndex, &iSupported, &iEnabled, &iVersion);
     if (iSupported && iVersion == 7)
     {
-        if (ADL_OK != ADL2_OverdriveN_Temperature_Get(_context,_lpAdapterInfo[gpu].iAdapterIndex,1, &temp))
+        if (ADL_OK != DRIVER_CALL(driverCallStats::Adl, ADL2_OverdriveN_Temperature_Get, _context,_lpAdapterInfo[gpu].iAdapterIndex,1, &temp))
         {
             qDebug() << "ADL2_OverdriveN_Temperature_Get fails on gpu#" << gpu;
             return 0;
@@ -144,10 +145,10 @@ int amdapi_adl::getFanSpeed(int gpu)
 {
     ADLODNFanControl fanCtrl;
     int iSupported,iEnabled,iVersion;
-    ADL2_Overdrive_Caps(_context, _lpAdapterInfo[gpu].iAdapterIndex, &iSupported, &iEnabled, &iVersion);
+    DRIVER_CALL(driverCallStats::Adl, ADL2_Overdrive_Caps, _context, _lpAdapterInfo[gpu].iAdapterIndex, &iSupported, &iEnabled, &iVersion);
     if (iSupported && iVersion == 7)
     {
-        if (ADL_OK != ADL2_OverdriveN_FanControl_Get(_context, _lpAdapterInfo[gpu].iAdapterIndex, &fanCtrl))
+        if (ADL_OK != DRIVER_CALL(driverCallStats::Adl, ADL2_OverdriveN_FanControl_Get, _context, _lpAdapterInfo[gpu].iAdapterIndex, &fanCtrl))
         {
             qDebug() << "ADL2_OverdriveN_FanControl_Get fails on gpu#" << gpu;
             return 0;
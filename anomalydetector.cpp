@@ -0,0 +1,186 @@
+#include "anomalydetector.h"
+#include <QSettings>
+#include <QtMath>
+#include <QDebug>
+
+ewmaStat::ewmaStat(double alpha) : _alpha(alpha)
+                                 , _mean(0)
+                                 , _var(0)
+                                 , _count(0)
+{
+}
+
+void ewmaStat::add(double value)
+{
+    if(_count++ == 0)
+    {
+        _mean = value;
+        _var = 0;
+        return;
+    }
+    double diff = value - _mean;
+    double incr = _alpha * diff;
+    _mean += incr;
+    _var = (1 - _alpha) * (_var + diff * incr);
+}
+
+double ewmaStat::stddev() const
+{
+    return qSqrt(_var);
+}
+
+double ewmaStat::zscore(double value) const
+{
+    double sd = stddev();
+    if(sd <= 0)
+        return value < _mean ? -1e9 : 0;
+    return (value - _mean) / sd;
+}
+
+anomalyDetector::anomalyDetector() : _hashrate(0.05)
+                                   , _shareRate(0.1)
+                                   , _zThreshold(4)
+                                   , _minDrop(0.1)
+                                   , _confirm(5)
+                                   , _warmup(20)
+                                   , _low(0)
+                                   , _bucketStart(0)
+                                   , _bucketShares(0)
+                                   , _lastShare(0)
+{
+    _clock.start();
+    _rules = readRules(Q_NULLPTR);
+}
+
+bool anomalyDetector::addHashrate(double mhs)
+{
+    if(_hashrate.count() < _warmup)
+    {
+        if(mhs > 0)
+            _hashrate.add(mhs);
+        return false;
+    }
+
+    bool low = _hashrate.zscore(mhs) < -_zThreshold && mhs < _hashrate.mean() * (1 - _minDrop);
+    if(!low)
+    {
+        _low = 0;
+        _hashrate.add(mhs);
+        return false;
+    }
+    // low samples are kept out of the baseline
+    return ++_low >= _confirm;
+}
+
+void anomalyDetector::closeShareBuckets()
+{
+    const qint64 bucket = 60 * 1000;
+    qint64 now = _clock.elapsed();
+    while(now - _bucketStart >= bucket)
+    {
+        _shareRate.add(_bucketShares);
+        _bucketShares = 0;
+        _bucketStart += bucket;
+    }
+}
+
+void anomalyDetector::addShare()
+{
+    closeShareBuckets();
+    _bucketShares++;
+    _lastShare = _clock.elapsed();
+}
+
+// With shares arriving as a Poisson process, P(no share for t) = exp(-rate * t);
+// an expected count above 9.2 means less than a 1 in 10000 chance
+bool anomalyDetector::sharesStalled()
+{
+    closeShareBuckets();
+    if(_shareRate.count() < 10 || _shareRate.mean() <= 0)
+        return false;
+    double minutes = (_clock.elapsed() - _lastShare) / 60000.0;
+    return _shareRate.mean() * minutes > 9.2;
+}
+
+void anomalyDetector::rebaseline()
+{
+    _hashrate.reset();
+    _low = 0;
+    // the time the miner was down is neither a share gap nor empty minutes
+    _lastShare = _clock.elapsed();
+    _bucketStart = _lastShare;
+    _bucketShares = 0;
+}
+
+const char* anomalyDetector::severityName(severity level)
+{
+    switch(level)
+    {
+    case Ignore:  return "ignore";
+    case Info:    return "info";
+    case Warning: return "warning";
+    case Restart: return "restart";
+    }
+    return "ignore";
+}
+
+anomalyDetector::severity anomalyDetector::severityFromName(const QString& name)
+{
+    if(name == "restart") return Restart;
+    if(name == "warning") return Warning;
+    if(name == "info") return Info;
+    return Ignore;
+}
+
+// Rules come from the [errorrules] array of selectum.ini, first match wins:
+//   errorrules\1\pattern=CUDA error
+//   errorrules\1\severity=restart
+QList<anomalyDetector::errorRule> anomalyDetector::readRules(QSettings* settings)
+{
+    QList<errorRule> rules;
+    if(settings)
+    {
+        int size = settings->beginReadArray("errorrules");
+        for(int i = 0; i < size; i++)
+        {
+            settings->setArrayIndex(i);
+            errorRule rule;
+            rule.pattern = QRegularExpression(settings->value("pattern").toString(), QRegularExpression::CaseInsensitiveOption);
+            rule.level = severityFromName(settings->value("severity").toString());
+            if(rule.pattern.isValid())
+                rules << rule;
+            else
+                qDebug() << "invalid error rule" << rule.pattern.pattern() << rule.pattern.errorString();
+        }
+        settings->endArray();
+        if(!rules.isEmpty())
+            return rules;
+    }
+
+    struct { const char* pattern; severity level; } defaults[] =
+    {
+        {"CUDA error|cudaError|illegal memory access|unspecified launch failure", Restart},
+        {"OpenCL error|CL_OUT_OF_RESOURCES|CL_INVALID", Restart},
+        {"out of memory|GPU.*(hung|lost|crash)|DAG.*(fail|error)", Restart},
+        {"(connection|stratum|pool|socket|JSON-RPC).*(error|fail|refused|lost|closed)|could not resolve|timed? ?out", Warning},
+        {"error", Warning},
+    };
+    for(unsigned int i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++)
+    {
+        errorRule rule;
+        rule.pattern = QRegularExpression(defaults[i].pattern, QRegularExpression::CaseInsensitiveOption);
+        rule.level = defaults[i].level;
+        rules << rule;
+    }
+    return rules;
+}
+
+anomalyDetector::severity anomalyDetector::classify(const QString& line) const
+{
+    foreach(const errorRule& rule, _rules)
+    {
+        if(rule.pattern.match(line).hasMatch())
+            return rule.level;
+    }
+    return Ignore;
+}
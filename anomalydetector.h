@@ -0,0 +1,89 @@
+#ifndef ANOMALYDETECTOR_H
+#define ANOMALYDETECTOR_H
+
+#include <QString>
+#include <QList>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+
+class QSettings;
+
+// Exponentially weighted mean and variance
+class ewmaStat
+{
+public:
+    ewmaStat(double alpha = 0.05);
+    void add(double value);
+    void reset(){_count = 0; _mean = 0; _var = 0;}
+    double mean() const {return _mean;}
+    double stddev() const;
+    double zscore(double value) const;
+    unsigned int count() const {return _count;}
+private:
+    double _alpha;
+    double _mean;
+    double _var;
+    unsigned int _count;
+};
+
+// Watchdog triggers: statistically significant drops of the hashrate or
+// of the share rate, and miner output lines matched against a rule table
+class anomalyDetector
+{
+public:
+    enum severity
+    {
+        Ignore = 0,
+        Info,
+        Warning,
+        Restart
+    };
+
+    struct errorRule
+    {
+        QRegularExpression pattern;
+        severity level;
+    };
+
+    anomalyDetector();
+
+    void setZThreshold(double z){_zThreshold = z;}
+    void setMinDropRatio(double ratio){_minDrop = ratio;}
+    void setConfirmSamples(unsigned int count){_confirm = count;}
+
+    // True once the hashrate has been significantly low for the confirm count
+    bool addHashrate(double mhs);
+    void addShare();
+    // True when no share for long enough that it can't be bad luck
+    bool sharesStalled();
+    // A new miner (or job) is running: fresh hashrate baseline, share clock from now
+    void rebaseline();
+
+    // [errorrules] of selectum.ini, the built-in table when there is none
+    static QList<errorRule> readRules(QSettings* settings);
+    void setRules(const QList<errorRule>& rules){_rules = rules;}
+    severity classify(const QString& line) const;
+    static const char* severityName(severity level);
+    static severity severityFromName(const QString& name);
+
+    double hashrateMean() const {return _hashrate.mean();}
+    double sharesPerMinute() const {return _shareRate.mean();}
+
+private:
+    void closeShareBuckets();
+
+    ewmaStat _hashrate;
+    ewmaStat _shareRate;
+    double _zThreshold;
+    double _minDrop;
+    unsigned int _confirm;
+    unsigned int _warmup;
+    unsigned int _low;
+    QElapsedTimer _clock;
+    qint64 _bucketStart;
+    unsigned int _bucketShares;
+    qint64 _lastShare;
+    QList<errorRule> _rules;
+};
+
+#endif // ANOMALYDETECTOR_H
@@ -0,0 +1,211 @@
+#include "benchmark.h"
+#include "minerprocess.h"
+#include <QSettings>
+#include <QTimer>
+#include <QJsonArray>
+#include <algorithm>
+
+benchmarkRunner::benchmarkRunner(MinerProcess* process, QSettings* settings, QObject* pParent) : QObject(pParent)
+                                                                                             , _process(process)
+                                                                                             , _settings(settings)
+                                                                                             , _phaseTimer(new QTimer(this))
+                                                                                             , _sampleTimer(new QTimer(this))
+                                                                                             , _warmup(120)
+                                                                                             , _window(300)
+                                                                                             , _current(-1)
+                                                                                             , _phase(Idle)
+                                                                                             , _acceptedStart(0)
+                                                                                             , _rejectedStart(0)
+{
+    _phaseTimer->setSingleShot(true);
+    _sampleTimer->setInterval(1000);
+    connect(_phaseTimer, &QTimer::timeout, this, &benchmarkRunner::onPhaseDone);
+    connect(_sampleTimer, &QTimer::timeout, this, &benchmarkRunner::onSample);
+}
+
+bool benchmarkRunner::start(const QList<job>& jobs)
+{
+    if(isRunning() || jobs.isEmpty())
+        return false;
+    _jobs = jobs;
+    _current = 0;
+    _results = QJsonObject();
+    startJob();
+    return true;
+}
+
+void benchmarkRunner::abort()
+{
+    if(!isRunning())
+        return;
+    _phaseTimer->stop();
+    _sampleTimer->stop();
+    _phase = Idle;
+    _process->stop();
+    emit progress("Benchmark aborted");
+    emit finished(false);
+}
+
+void benchmarkRunner::startJob()
+{
+    const job& j = _jobs.at(_current);
+    if(_process->isRunning())
+        _process->stop();
+    _process->gpuRates().reset();
+    _process->start(j.path, j.args);
+    _phase = WarmUp;
+    _phaseTimer->start(_warmup * 1000);
+    emit progress(QString("Benchmark %1: warming up for %2 s").arg(j.algo).arg(_warmup));
+}
+
+void benchmarkRunner::setGpuTelemetry(int vendor
+                                      , const QVector<int>& temps
+                                      , const QVector<int>&
+                                      , const QVector<int>&
+                                      , const QVector<int>&
+                                      , const QVector<int>& powers)
+{
+    if(vendor < 0 || vendor > 1)
+        return;
+    _temps[vendor] = temps;
+    _powers[vendor] = powers;
+}
+
+void benchmarkRunner::onPhaseDone()
+{
+    if(_phase == WarmUp)
+    {
+        _gpuRates.clear();
+        _gpuPowers.clear();
+        _gpuTemps.clear();
+        _acceptedStart = _process->ledger().total().count[shareLedger::Accepted];
+        _rejectedStart = _process->ledger().total().count[shareLedger::Rejected] + _process->ledger().total().count[shareLedger::Stale];
+        _phase = Measure;
+        _sampleTimer->start();
+        _phaseTimer->start(_window * 1000);
+        emit progress(QString("Benchmark %1: measuring for %2 s").arg(_jobs.at(_current).algo).arg(_window));
+        return;
+    }
+
+    _sampleTimer->stop();
+    saveResults();
+    if(++_current < _jobs.size())
+    {
+        startJob();
+        return;
+    }
+    _phase = Idle;
+    _process->stop();
+    emit progress("Benchmark finished");
+    emit finished(true);
+}
+
+void benchmarkRunner::onSample()
+{
+    // a restart by the watchdog shows up as zeros, those samples are skipped
+    gpuHashrateTracker& rates = _process->gpuRates();
+    if(_gpuRates.size() < rates.gpuCount())
+        _gpuRates.resize(rates.gpuCount());
+    for(int i = 0; i < rates.gpuCount(); i++)
+    {
+        if(rates.rate(i) > 0)
+            _gpuRates[i] << rates.rate(i) * rates.unitScale();
+    }
+
+    // the miner numbers the cards of one vendor, NVIDIA when both report
+    int vendor = _temps[0].isEmpty() ? 1 : 0;
+    const QVector<int>& powers = _powers[vendor];
+    const QVector<int>& temps = _temps[vendor];
+    if(_gpuPowers.size() < powers.size())
+        _gpuPowers.resize(powers.size());
+    for(int i = 0; i < powers.size(); i++)
+    {
+        if(powers.at(i) > 0)
+            _gpuPowers[i] << powers.at(i) / 1000.0;
+    }
+    if(_gpuTemps.size() < temps.size())
+        _gpuTemps.resize(temps.size());
+    for(int i = 0; i < temps.size(); i++)
+        _gpuTemps[i] = qMax(_gpuTemps.at(i), temps.at(i));
+}
+
+double benchmarkRunner::median(QVector<double> values)
+{
+    if(values.isEmpty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+
+void benchmarkRunner::saveResults()
+{
+    const QString& algo = _jobs.at(_current).algo;
+    const shareLedger::counters& total = _process->ledger().total();
+    quint64 accepted = total.count[shareLedger::Accepted] - _acceptedStart;
+    quint64 rejected = total.count[shareLedger::Rejected] + total.count[shareLedger::Stale] - _rejectedStart;
+
+    QJsonObject result;
+    QJsonArray gpus;
+    QJsonArray gpuPowers;
+    QJsonArray gpuTemps;
+    double hashrate = 0;
+    double power = 0;
+    int temp = 0;
+    _settings->beginGroup("benchmark");
+    for(int i = 0; i < _gpuRates.size(); i++)
+    {
+        double rate = median(_gpuRates.at(i));
+        hashrate += rate;
+        gpus.append(rate);
+        _settings->setValue(algo + "_hashrate_gpu" + QString::number(i), rate);
+    }
+    for(int i = 0; i < _gpuPowers.size(); i++)
+    {
+        double watts = median(_gpuPowers.at(i));
+        power += watts;
+        gpuPowers.append(watts);
+        _settings->setValue(algo + "_power_gpu" + QString::number(i), watts);
+    }
+    for(int i = 0; i < _gpuTemps.size(); i++)
+    {
+        temp = qMax(temp, _gpuTemps.at(i));
+        gpuTemps.append(_gpuTemps.at(i));
+        _settings->setValue(algo + "_temp_gpu" + QString::number(i), _gpuTemps.at(i));
+    }
+    bool known = !_gpuRates.isEmpty();
+    double rejectRatio = accepted + rejected ? (double)rejected / (accepted + rejected) : 0;
+    _settings->setValue(algo + "_hashrate", known ? QVariant(hashrate) : QVariant("unknown"));
+    _settings->setValue(algo + "_power", power);
+    _settings->setValue(algo + "_temp", temp);
+    _settings->setValue(algo + "_rejectratio", rejectRatio);
+    _settings->endGroup();
+    _settings->sync();
+
+    result["hashrate"] = known ? QJsonValue(hashrate) : QJsonValue("unknown");
+    result["gpus"] = gpus;
+    result["power"] = power;
+    result["gpuPowers"] = gpuPowers;
+    result["temp"] = temp;
+    result["gpuTemps"] = gpuTemps;
+    result["rejectRatio"] = rejectRatio;
+    _results[algo] = result;
+    if(known)
+        emit progress(QString("Benchmark %1: %2 H/s, %3 W").arg(algo).arg(hashrate, 0, 'f', 0).arg(power, 0, 'f', 0));
+    else
+        emit progress(QString("Benchmark %1: no per-GPU speed from the miner, hashrate unknown, %2 W").arg(algo).arg(power, 0, 'f', 0));
+}
+
+QJsonObject benchmarkRunner::status() const
+{
+    QJsonObject json;
+    json["running"] = isRunning();
+    if(isRunning())
+    {
+        json["algo"] = _jobs.at(_current).algo;
+        json["phase"] = _phase == WarmUp ? "warmup" : "measure";
+        json["job"] = _current + 1;
+        json["jobs"] = _jobs.size();
+    }
+    json["results"] = _results;
+    return json;
+}
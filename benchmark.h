@@ -0,0 +1,93 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QString>
+#include <QJsonObject>
+
+class QSettings;
+class QTimer;
+class MinerProcess;
+
+// Runs each miner/algorithm in turn: a warm-up, then a measurement window
+// sampling per-GPU hashrate, power, temperature and share results once a
+// second. Stable values (medians) go to the [benchmark] group, the input
+// of the profit switcher:
+//   <algo>_hashrate (H/s), <algo>_hashrate_gpu<N>, <algo>_power (W),
+//   <algo>_power_gpu<N>, <algo>_temp, <algo>_temp_gpu<N>, <algo>_rejectratio
+// A miner that never printed per-GPU speeds has its hashrate stored as
+// "unknown", which the profit switcher skips.
+class benchmarkRunner : public QObject
+{
+    Q_OBJECT
+public:
+    struct job
+    {
+        QString algo;
+        QString path;
+        QString args;
+    };
+
+    benchmarkRunner(MinerProcess* process, QSettings* settings, QObject* pParent = Q_NULLPTR);
+
+    void setWarmup(unsigned int sec){_warmup = sec;}
+    void setWindow(unsigned int sec){_window = sec;}
+
+    bool start(const QList<job>& jobs);
+    void abort();
+    bool isRunning() const {return _phase != Idle;}
+
+    QJsonObject status() const;
+
+public slots:
+    // per-GPU power (mW) and temperature, from the monitor threads
+    void setGpuTelemetry(int vendor
+                         , const QVector<int>& temps
+                         , const QVector<int>& fans
+                         , const QVector<int>& gpuClocks
+                         , const QVector<int>& memClocks
+                         , const QVector<int>& powers);
+
+signals:
+    void progress(const QString& message);
+    void finished(bool completed);
+
+private slots:
+    void onPhaseDone();
+    void onSample();
+
+private:
+    enum phase
+    {
+        Idle = 0,
+        WarmUp,
+        Measure
+    };
+
+    void startJob();
+    void saveResults();
+    static double median(QVector<double> values);
+
+    MinerProcess* _process;
+    QSettings* _settings;
+    QTimer* _phaseTimer;
+    QTimer* _sampleTimer;
+    unsigned int _warmup;
+    unsigned int _window;
+    QList<job> _jobs;
+    int _current;
+    phase _phase;
+    QJsonObject _results;
+
+    QVector<QVector<double> > _gpuRates;
+    QVector<QVector<double> > _gpuPowers;     // W
+    QVector<int> _gpuTemps;                   // hottest seen
+    QVector<int> _temps[2];                   // latest, per metricsExporter::vendor
+    QVector<int> _powers[2];
+    quint64 _acceptedStart;
+    quint64 _rejectedStart;
+};
+
+#endif // BENCHMARK_H
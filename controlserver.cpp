@@ -0,0 +1,268 @@
+#include "controlserver.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QPointer>
+#include <QDebug>
+
+// JSON-RPC 2.0 error codes
+#define RPC_PARSE_ERROR         -32700
+#define RPC_INVALID_REQUEST     -32600
+#define RPC_METHOD_NOT_FOUND    -32601
+#define RPC_INTERNAL_ERROR      -32603
+
+// a client sending more than this without a newline is dropped
+#define MAX_REQUEST             (1024 * 1024)
+
+controlServer::controlServer(QObject* pParent) : QObject(pParent)
+                                                , _local(Q_NULLPTR)
+                                                , _tcp(Q_NULLPTR)
+{
+}
+
+controlServer::~controlServer()
+{
+}
+
+bool controlServer::listen(const QString& socketName, quint16 tcpPort)
+{
+    bool ok = true;
+    if(!socketName.isEmpty())
+    {
+        _local = new QLocalServer(this);
+        QLocalServer::removeServer(socketName);
+        connect(_local, &QLocalServer::newConnection, this, &controlServer::onLocalConnection);
+        if(!_local->listen(socketName))
+        {
+            qDebug() << "control socket" << socketName << _local->errorString();
+            ok = false;
+        }
+    }
+    if(tcpPort)
+    {
+        _tcp = new QTcpServer(this);
+        connect(_tcp, &QTcpServer::newConnection, this, &controlServer::onTcpConnection);
+        if(!_tcp->listen(QHostAddress::LocalHost, tcpPort))
+        {
+            qDebug() << "control port" << tcpPort << _tcp->errorString();
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void controlServer::registerMethod(const QString& method, handler fn)
+{
+    _methods[method] = fn;
+}
+
+void controlServer::registerAsyncMethod(const QString& method, asyncHandler fn)
+{
+    _asyncMethods[method] = fn;
+}
+
+QJsonValue controlServer::call(const QString& method, const QJsonObject& params, QString* error)
+{
+    if(!_methods.contains(method))
+    {
+        *error = _asyncMethods.contains(method) ? method + " is asynchronous" : "unknown method " + method;
+        return QJsonValue();
+    }
+    return _methods[method](params, error);
+}
+
+void controlServer::callAsync(const QString& method, const QJsonObject& params, responder reply)
+{
+    if(_asyncMethods.contains(method))
+    {
+        _asyncMethods[method](params, reply);
+        return;
+    }
+    QString error;
+    QJsonValue result = call(method, params, &error);
+    reply(result, error);
+}
+
+void controlServer::onLocalConnection()
+{
+    while(_local->hasPendingConnections())
+    {
+        QLocalSocket* socket = _local->nextPendingConnection();
+        connect(socket, &QLocalSocket::disconnected, this, &controlServer::onDisconnected);
+        addClient(socket);
+    }
+}
+
+void controlServer::onTcpConnection()
+{
+    while(_tcp->hasPendingConnections())
+    {
+        QTcpSocket* socket = _tcp->nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, this, &controlServer::onDisconnected);
+        addClient(socket);
+    }
+}
+
+void controlServer::addClient(QIODevice* device)
+{
+    _clients.insert(device, client());
+    connect(device, &QIODevice::readyRead, this, &controlServer::onReadyRead);
+}
+
+void controlServer::onDisconnected()
+{
+    QIODevice* device = qobject_cast<QIODevice*>(sender());
+    _clients.remove(device);
+    device->deleteLater();
+}
+
+void controlServer::onReadyRead()
+{
+    QIODevice* device = qobject_cast<QIODevice*>(sender());
+    if(!_clients.contains(device))
+        return;
+
+    QByteArray& buffer = _clients[device].buffer;
+    buffer += device->readAll();
+    int end;
+    while((end = buffer.indexOf('\n')) != -1)
+    {
+        QByteArray line = buffer.left(end).trimmed();
+        buffer.remove(0, end + 1);
+        if(!line.isEmpty())
+            handleRequest(device, line);
+        if(!_clients.contains(device))
+            return;
+    }
+    if(buffer.size() > MAX_REQUEST)
+    {
+        qDebug() << "control client sent" << buffer.size() << "bytes without a newline, dropped";
+        _clients.remove(device);
+        // onDisconnected() deletes it
+        device->close();
+    }
+}
+
+static QJsonObject rpcError(const QJsonValue& id, int code, const QString& message)
+{
+    QJsonObject error;
+    error["code"] = code;
+    error["message"] = message;
+    QJsonObject reply;
+    reply["jsonrpc"] = "2.0";
+    reply["id"] = id;
+    reply["error"] = error;
+    return reply;
+}
+
+static QJsonObject rpcResult(const QJsonValue& id, const QJsonValue& result)
+{
+    QJsonObject reply;
+    reply["jsonrpc"] = "2.0";
+    reply["id"] = id;
+    reply["result"] = result.isUndefined() ? QJsonValue(true) : result;
+    return reply;
+}
+
+void controlServer::handleRequest(QIODevice* device, const QByteArray& line)
+{
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+    if(parseError.error != QJsonParseError::NoError || !doc.isObject())
+    {
+        send(device, rpcError(QJsonValue(), RPC_PARSE_ERROR, parseError.errorString()));
+        return;
+    }
+
+    QJsonObject request = doc.object();
+    QJsonValue id = request.value("id");
+    QString method = request.value("method").toString();
+    QJsonObject params = request.value("params").toObject();
+    bool notification = !request.contains("id");
+
+    if(method.isEmpty())
+    {
+        send(device, rpcError(id, RPC_INVALID_REQUEST, "missing method"));
+        return;
+    }
+
+    QJsonValue result;
+    if(method == "subscribe" || method == "unsubscribe")
+    {
+        QSet<QString>& topics = _clients[device].topics;
+        foreach(const QJsonValue& topic, params.value("topics").toArray())
+        {
+            if(method == "subscribe")
+                topics.insert(topic.toString());
+            else
+                topics.remove(topic.toString());
+        }
+        QJsonArray current;
+        foreach(const QString& topic, topics)
+            current.append(topic);
+        result = current;
+    }
+    else if(_asyncMethods.contains(method))
+    {
+        // the client may be gone by the time the reply is ready
+        QPointer<controlServer> self(this);
+        QPointer<QIODevice> target(device);
+        _asyncMethods[method](params, [self, target, id, notification](const QJsonValue& result, const QString& error){
+            if(!self || !target || !self->_clients.contains(target) || notification)
+                return;
+            self->send(target, error.isEmpty() ? rpcResult(id, result) : rpcError(id, RPC_INTERNAL_ERROR, error));
+        });
+        return;
+    }
+    else if(_methods.contains(method))
+    {
+        QString error;
+        result = _methods[method](params, &error);
+        if(!error.isEmpty())
+        {
+            if(!notification)
+                send(device, rpcError(id, RPC_INTERNAL_ERROR, error));
+            return;
+        }
+    }
+    else
+    {
+        if(!notification)
+            send(device, rpcError(id, RPC_METHOD_NOT_FOUND, "unknown method " + method));
+        return;
+    }
+
+    if(notification)
+        return;
+    send(device, rpcResult(id, result));
+}
+
+void controlServer::send(QIODevice* device, const QJsonObject& message)
+{
+    device->write(QJsonDocument(message).toJson(QJsonDocument::Compact));
+    device->write("\n");
+}
+
+void controlServer::publish(const QString& topic, const QJsonObject& data)
+{
+    QByteArray message;
+    for(QMap<QIODevice*, client>::const_iterator it = _clients.constBegin(); it != _clients.constEnd(); ++it)
+    {
+        if(!it.value().topics.contains(topic))
+            continue;
+        if(message.isEmpty())
+        {
+            QJsonObject params = data;
+            params["topic"] = topic;
+            QJsonObject event;
+            event["jsonrpc"] = "2.0";
+            event["method"] = "event";
+            event["params"] = params;
+            message = QJsonDocument(event).toJson(QJsonDocument::Compact) + "\n";
+        }
+        it.key()->write(message);
+    }
+}
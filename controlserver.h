@@ -0,0 +1,65 @@
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QObject>
+#include <QMap>
+#include <QSet>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <functional>
+
+class QLocalServer;
+class QTcpServer;
+class QIODevice;
+
+// Newline delimited JSON-RPC 2.0 over a local socket (named pipe on
+// Windows) and, optionally, a TCP port bound to localhost.
+// Methods are registered by the owner; "subscribe"/"unsubscribe" are
+// built in and select which published topics a client receives.
+// An asynchronous method replies later through its responder, which must
+// be called on the server's thread; the client is served meanwhile.
+class controlServer : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<QJsonValue(const QJsonObject& params, QString* error)> handler;
+    typedef std::function<void(const QJsonValue& result, const QString& error)> responder;
+    typedef std::function<void(const QJsonObject& params, responder reply)> asyncHandler;
+
+    controlServer(QObject* pParent = Q_NULLPTR);
+    ~controlServer();
+
+    bool listen(const QString& socketName, quint16 tcpPort);
+    void registerMethod(const QString& method, handler fn);
+    void registerAsyncMethod(const QString& method, asyncHandler fn);
+    // Runs a registered method in-process, for other transports; call()
+    // only runs the synchronous ones
+    QJsonValue call(const QString& method, const QJsonObject& params, QString* error);
+    void callAsync(const QString& method, const QJsonObject& params, responder reply);
+    void publish(const QString& topic, const QJsonObject& data);
+
+private slots:
+    void onLocalConnection();
+    void onTcpConnection();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    struct client
+    {
+        QByteArray buffer;
+        QSet<QString> topics;
+    };
+
+    void addClient(QIODevice* device);
+    void handleRequest(QIODevice* device, const QByteArray& line);
+    void send(QIODevice* device, const QJsonObject& message);
+
+    QLocalServer* _local;
+    QTcpServer* _tcp;
+    QMap<QString, handler> _methods;
+    QMap<QString, asyncHandler> _asyncMethods;
+    QMap<QIODevice*, client> _clients;
+};
+
+#endif // CONTROLSERVER_H
@@ -0,0 +1,172 @@
+#include "drivercallstats.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <cstring>
+
+const qint64 driverCallStats::BUCKET_BOUNDS[driverCallStats::BUCKET_COUNT - 1] = {100, 1000, 5000, 20000, 100000, 500000};
+
+static const char* API_NAMES[driverCallStats::ApiCount] = {"nvml", "nvapi", "adl"};
+
+driverCallStats& driverCallStats::instance()
+{
+    static driverCallStats stats;
+    return stats;
+}
+
+driverCallStats::driverCallStats() : _count(0)
+                                   , _slowNext(0)
+                                   , _slowTotal(0)
+{
+    for(int i = 0; i < MAX_FUNCTIONS; i++)
+    {
+        function& f = _functions[i];
+        f.lib = Nvml;
+        f.name = "";
+        f.calls = 0;
+        f.errors = 0;
+        f.totalNs = 0;
+        f.maxNs = 0;
+        for(int b = 0; b < BUCKET_COUNT; b++)
+            f.buckets[b] = 0;
+        for(int c = 0; c < MAX_CODES; c++)
+        {
+            f.codes[c] = 0;
+            f.codeCounts[c] = 0;
+        }
+        f.otherCodes = 0;
+    }
+    memset(_slow, 0, sizeof(_slow));
+}
+
+const char* driverCallStats::apiName(api lib)
+{
+    return API_NAMES[lib];
+}
+
+int driverCallStats::functionId(api lib, const char* name)
+{
+    QMutexLocker lock(&_mutex);
+    int count = _count.load();
+    for(int i = 0; i < count; i++)
+        if(_functions[i].lib == lib && !strcmp(_functions[i].name, name))
+            return i;
+    if(count == MAX_FUNCTIONS)
+        return -1;
+    _functions[count].lib = lib;
+    _functions[count].name = name;
+    // published last: readers only look below _count
+    _count.store(count + 1);
+    return count;
+}
+
+void driverCallStats::record(int id, qint64 ns, int status)
+{
+    if(id < 0)
+        return;
+    function& f = _functions[id];
+    f.calls.fetch_add(1, std::memory_order_relaxed);
+    f.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    qint64 max = f.maxNs.load(std::memory_order_relaxed);
+    while(ns > max && !f.maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        ;
+
+    qint64 us = ns / 1000;
+    int bucket = 0;
+    while(bucket < BUCKET_COUNT - 1 && us > BUCKET_BOUNDS[bucket])
+        bucket++;
+    f.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    if(status != 0)
+    {
+        f.errors.fetch_add(1, std::memory_order_relaxed);
+        int c = 0;
+        for(; c < MAX_CODES; c++)
+        {
+            int code = f.codes[c].load();
+            // a free slot is claimed by the first thread to see it
+            if(code == 0 && f.codes[c].compare_exchange_strong(code, status))
+                code = status;
+            if(code == status)
+            {
+                f.codeCounts[c].fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        if(c == MAX_CODES)
+            f.otherCodes.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if(ns >= SLOW_CALL_MSEC * 1000000LL)
+    {
+        QMutexLocker lock(&_mutex);
+        slowCall& s = _slow[_slowNext];
+        s.time = QDateTime::currentMSecsSinceEpoch();
+        s.function = id;
+        s.ns = ns;
+        s.status = status;
+        _slowNext = (_slowNext + 1) % SLOW_RING;
+        _slowTotal++;
+    }
+}
+
+QJsonObject driverCallStats::toJson()
+{
+    QJsonArray functions;
+    int count = _count.load();
+    for(int i = 0; i < count; i++)
+    {
+        const function& f = _functions[i];
+        quint64 calls = f.calls.load();
+        QJsonObject fn;
+        fn["api"] = API_NAMES[f.lib];
+        fn["function"] = f.name;
+        fn["calls"] = (double)calls;
+        fn["errors"] = (double)f.errors.load();
+        fn["meanUs"] = calls ? (double)f.totalNs.load() / calls / 1000.0 : 0.0;
+        fn["maxUs"] = f.maxNs.load() / 1000.0;
+        QJsonArray buckets;
+        for(int b = 0; b < BUCKET_COUNT; b++)
+            buckets.append((double)f.buckets[b].load());
+        fn["buckets"] = buckets;
+        QJsonObject codes;
+        for(int c = 0; c < MAX_CODES; c++)
+            if(f.codes[c].load())
+                codes[QString::number(f.codes[c].load())] = (double)f.codeCounts[c].load();
+        if(f.otherCodes.load())
+            codes["other"] = (double)f.otherCodes.load();
+        fn["codes"] = codes;
+        functions.append(fn);
+    }
+
+    QJsonArray bounds;
+    for(int b = 0; b < BUCKET_COUNT - 1; b++)
+        bounds.append((double)BUCKET_BOUNDS[b]);
+
+    QJsonArray slow;
+    quint64 slowTotal;
+    {
+        QMutexLocker lock(&_mutex);
+        slowTotal = _slowTotal;
+        int kept = (int)qMin<quint64>(_slowTotal, SLOW_RING);
+        // most recent first
+        for(int i = 1; i <= kept; i++)
+        {
+            const slowCall& s = _slow[(_slowNext - i + SLOW_RING) % SLOW_RING];
+            QJsonObject call;
+            call["time"] = (double)s.time;
+            call["api"] = API_NAMES[_functions[s.function].lib];
+            call["function"] = _functions[s.function].name;
+            call["ms"] = s.ns / 1000000.0;
+            call["status"] = s.status;
+            slow.append(call);
+        }
+    }
+
+    QJsonObject result;
+    result["functions"] = functions;
+    result["bucketBoundsUs"] = bounds;
+    result["slowCallMs"] = SLOW_CALL_MSEC;
+    result["slowCalls"] = slow;
+    result["slowCallsTotal"] = (double)slowTotal;
+    return result;
+}
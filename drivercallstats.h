@@ -0,0 +1,99 @@
+#ifndef DRIVERCALLSTATS_H
+#define DRIVERCALLSTATS_H
+
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <atomic>
+
+// Latency and result of every NVML, NVAPI and ADL call. Recording is a few
+// relaxed atomic increments on the calling thread (the monitor threads must
+// not wait on the exporter); only a slow call takes a lock, to land in the
+// ring of the last slow calls.
+//
+// Success is 0 in the three libraries (NVML_SUCCESS, NVAPI_OK, ADL_OK),
+// anything else is counted per code.
+class driverCallStats
+{
+public:
+    enum api
+    {
+        Nvml = 0,
+        Nvapi,
+        Adl,
+        ApiCount
+    };
+
+    static const int MAX_FUNCTIONS = 96;
+    static const int MAX_CODES = 6;         // distinct error codes kept per function
+    // upper bounds in microseconds, the last bucket is everything above
+    static const int BUCKET_COUNT = 7;
+    static const qint64 BUCKET_BOUNDS[BUCKET_COUNT - 1];
+    static const int SLOW_CALL_MSEC = 50;
+    static const int SLOW_RING = 64;
+
+    struct function
+    {
+        api lib;
+        const char* name;
+        std::atomic<quint64> calls;
+        std::atomic<quint64> errors;
+        std::atomic<quint64> totalNs;
+        std::atomic<qint64> maxNs;
+        std::atomic<quint64> buckets[BUCKET_COUNT];
+        std::atomic<int> codes[MAX_CODES];
+        std::atomic<quint64> codeCounts[MAX_CODES];
+        std::atomic<quint64> otherCodes;    // once the code slots are taken
+    };
+
+    struct slowCall
+    {
+        qint64 time;        // ms since epoch
+        int function;
+        qint64 ns;
+        int status;
+    };
+
+    static driverCallStats& instance();
+
+    // Id of the function, registered on first use. A function past
+    // MAX_FUNCTIONS gets -1 and is not recorded.
+    int functionId(api lib, const char* name);
+    void record(int id, qint64 ns, int status);
+
+    int functionCount() const {return _count.load();}
+    const function& at(int id) const {return _functions[id];}
+    static const char* apiName(api lib);
+
+    // debug.driverstats: per function counters and the slow call ring
+    QJsonObject toJson();
+
+    template<typename F>
+    static auto measure(int id, F f) -> decltype(f())
+    {
+        QElapsedTimer timer;
+        timer.start();
+        auto status = f();
+        instance().record(id, timer.nsecsElapsed(), (int)status);
+        return status;
+    }
+
+private:
+    driverCallStats();
+
+    function _functions[MAX_FUNCTIONS];
+    std::atomic<int> _count;
+    QMutex _mutex;
+    slowCall _slow[SLOW_RING];
+    int _slowNext;
+    quint64 _slowTotal;
+};
+
+// Times one driver call made through a plain function or function pointer:
+//   result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetPowerUsage, device, &power);
+// the id is looked up once per call site.
+#define DRIVER_CALL(lib, fn, ...) \
+    driverCallStats::measure([]{ static const int id = driverCallStats::instance().functionId(lib, #fn); return id; }() \
+                             , [&]{ return fn(__VA_ARGS__); })
+
+#endif // DRIVERCALLSTATS_H
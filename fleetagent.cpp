@@ -0,0 +1,200 @@
+#include "fleetagent.h"
+#include "minerprocess.h"
+#include "controlserver.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QTimer>
+#include <QDateTime>
+#include <QPointer>
+#include <QDebug>
+
+fleetAgent::fleetAgent(MinerProcess* process, controlServer* control, QObject* pParent) : QObject(pParent)
+                                                                                     , _process(process)
+                                                                                     , _control(control)
+                                                                                     , _server(Q_NULLPTR)
+                                                                                     , _udp(new QUdpSocket(this))
+                                                                                     , _tick(new QTimer(this))
+                                                                                     , _beacon(new QTimer(this))
+                                                                                     , _port(0)
+                                                                                     , _minerUp(false)
+{
+    connect(_tick, &QTimer::timeout, this, &fleetAgent::onTick);
+    connect(_beacon, &QTimer::timeout, this, &fleetAgent::onBeacon);
+}
+
+bool fleetAgent::listen(quint16 port)
+{
+    _server = new QTcpServer(this);
+    connect(_server, &QTcpServer::newConnection, this, &fleetAgent::onNewConnection);
+    if(!_server->listen(QHostAddress::Any, port))
+    {
+        qDebug() << "fleet port" << port << _server->errorString();
+        return false;
+    }
+    _port = _server->serverPort();
+    _tick->start(1000);
+    _beacon->start(5000);
+    onBeacon();
+    return true;
+}
+
+void fleetAgent::onBeacon()
+{
+    _udp->writeDatagram(fleetProtocol::beacon(_name, _port), QHostAddress::Broadcast, fleetProtocol::DEFAULT_PORT);
+}
+
+void fleetAgent::setGpuTelemetry(int vendor
+                                 , const QVector<int>& temps
+                                 , const QVector<int>& fans
+                                 , const QVector<int>& gpuClocks
+                                 , const QVector<int>& memClocks
+                                 , const QVector<int>& powers)
+{
+    if(vendor < 0 || vendor > 1)
+        return;
+    QVector<fleetProtocol::gpuSample>& gpus = _gpus[vendor];
+    gpus.resize(temps.size());
+    for(int i = 0; i < temps.size(); i++)
+    {
+        gpus[i].temp = temps.at(i);
+        gpus[i].fan = fans.value(i);
+        gpus[i].gpuClock = gpuClocks.value(i);
+        gpus[i].memClock = memClocks.value(i);
+        gpus[i].power = powers.value(i);
+    }
+}
+
+void fleetAgent::onTick()
+{
+    if(_peers.isEmpty())
+        return;
+
+    fleetProtocol::telemetry t;
+    t.time = QDateTime::currentMSecsSinceEpoch();
+    t.minerUp = _minerUp;
+    const shareLedger::counters& total = _process->ledger().total();
+    t.accepted = total.count[shareLedger::Accepted];
+    t.rejected = total.count[shareLedger::Rejected];
+    t.stale = total.count[shareLedger::Stale];
+    t.gpus = _gpus[0] + _gpus[1];
+
+    // the monitors list every card, the miner only the ones it was given:
+    // an isolated card reports no hashrate
+    gpuHashrateTracker& rates = _process->gpuRates();
+    for(int i = 0; i < t.gpus.size(); i++)
+        t.gpus[i].hashrate = 0;
+    t.hashrate = 0;
+    for(int i = 0; i < rates.gpuCount(); i++)
+    {
+        int gpu = _process->physicalGpu(i);
+        if(t.gpus.size() <= gpu)
+            t.gpus.resize(gpu + 1);
+        t.gpus[gpu].hashrate = rates.rate(i) * rates.unitScale();
+        t.hashrate += t.gpus[gpu].hashrate;
+    }
+    if(t.hashrate <= 0)
+        t.hashrate = _process->detector().hashrateMean() * 1e6;
+    broadcast(fleetProtocol::Telemetry, _encoder.encode(t));
+}
+
+void fleetAgent::sendEvent(const QString& kind, const QString& text)
+{
+    fleetProtocol::event e;
+    e.time = QDateTime::currentMSecsSinceEpoch();
+    e.kind = kind;
+    e.text = text;
+    broadcast(fleetProtocol::Event, telemetryEncoder::encodeEvent(e));
+}
+
+void fleetAgent::broadcast(fleetProtocol::messageType type, const QByteArray& payload)
+{
+    QByteArray frame = fleetProtocol::frame(type, payload);
+    for(int i = 0; i < _peers.size(); i++)
+        _peers[i].socket->write(frame);
+}
+
+void fleetAgent::onNewConnection()
+{
+    while(_server->hasPendingConnections())
+    {
+        peer p;
+        p.socket = _server->nextPendingConnection();
+        p.trusted = false;
+        connect(p.socket, &QTcpSocket::readyRead, this, &fleetAgent::onReadyRead);
+        connect(p.socket, &QTcpSocket::disconnected, this, &fleetAgent::onDisconnected);
+        _peers << p;
+        // the stream is shared, restart it with a key frame for the newcomer
+        _encoder.reset();
+
+        fleetProtocol::hello h;
+        h.name = _name;
+        h.version = fleetProtocol::VERSION;
+        h.algo = _algo;
+        h.pool = _process->ledger().pool();
+        p.socket->write(fleetProtocol::frame(fleetProtocol::Hello, fleetProtocol::encodeHello(h)));
+    }
+}
+
+void fleetAgent::onReadyRead()
+{
+    for(int i = 0; i < _peers.size(); i++)
+    {
+        if(_peers.at(i).socket != sender())
+            continue;
+        peer& p = _peers[i];
+        p.buffer += p.socket->readAll();
+        fleetProtocol::messageType type;
+        QByteArray payload;
+        bool error = false;
+        while(fleetProtocol::nextFrame(p.buffer, &type, &payload, &error))
+            handleFrame(p, type, payload);
+        if(error)
+            p.socket->abort();
+        return;
+    }
+}
+
+void fleetAgent::handleFrame(peer& p, fleetProtocol::messageType type, const QByteArray& payload)
+{
+    if(type == fleetProtocol::Hello)
+    {
+        fleetProtocol::hello h;
+        p.trusted = fleetProtocol::decodeHello(payload, &h) && !_key.isEmpty() && h.key == _key;
+        return;
+    }
+    if(type != fleetProtocol::Command)
+        return;
+
+    fleetProtocol::command c;
+    if(!fleetProtocol::decodeCommand(payload, &c))
+        return;
+    if(!p.trusted)
+    {
+        c.error = "not authorized";
+        p.socket->write(fleetProtocol::frame(fleetProtocol::CommandResult, fleetProtocol::encodeCommandResult(c)));
+        return;
+    }
+    qDebug() << "fleet command" << c.method << "from" << p.socket->peerAddress().toString();
+    // the aggregator may have disconnected before an asynchronous method is done
+    QPointer<QTcpSocket> socket(p.socket);
+    _control->callAsync(c.method, c.params, [socket, c](const QJsonValue& result, const QString& error) mutable {
+        if(!socket)
+            return;
+        c.result["result"] = result;
+        c.error = error;
+        socket->write(fleetProtocol::frame(fleetProtocol::CommandResult, fleetProtocol::encodeCommandResult(c)));
+    });
+}
+
+void fleetAgent::onDisconnected()
+{
+    for(int i = 0; i < _peers.size(); i++)
+    {
+        if(_peers.at(i).socket != sender())
+            continue;
+        _peers.at(i).socket->deleteLater();
+        _peers.removeAt(i);
+        return;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef FLEETAGENT_H
+#define FLEETAGENT_H
+
+#include <QObject>
+#include <QVector>
+#include <QList>
+#include <QString>
+#include "fleetprotocol.h"
+#include "telemetrycodec.h"
+
+class QTcpServer;
+class QTcpSocket;
+class QUdpSocket;
+class QTimer;
+class MinerProcess;
+class controlServer;
+
+// Rig side of the fleet protocol: announces the rig on the LAN, streams
+// telemetry once a second to every connected aggregator and runs the
+// commands of the aggregators that presented the fleet key.
+class fleetAgent : public QObject
+{
+    Q_OBJECT
+public:
+    fleetAgent(MinerProcess* process, controlServer* control, QObject* pParent = Q_NULLPTR);
+
+    bool listen(quint16 port);
+    void setName(const QString& name){_name = name;}
+    // empty: telemetry only, commands are refused
+    void setKey(const QString& key){_key = key;}
+    void setAlgo(const QString& algo){_algo = algo;}
+    void setMinerRunning(bool running){_minerUp = running;}
+    void sendEvent(const QString& kind, const QString& text);
+
+public slots:
+    void setGpuTelemetry(int vendor
+                         , const QVector<int>& temps
+                         , const QVector<int>& fans
+                         , const QVector<int>& gpuClocks
+                         , const QVector<int>& memClocks
+                         , const QVector<int>& powers);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onTick();
+    void onBeacon();
+
+private:
+    struct peer
+    {
+        QTcpSocket* socket;
+        QByteArray buffer;
+        bool trusted;
+    };
+
+    void handleFrame(peer& p, fleetProtocol::messageType type, const QByteArray& payload);
+    void broadcast(fleetProtocol::messageType type, const QByteArray& payload);
+
+    MinerProcess* _process;
+    controlServer* _control;
+    QTcpServer* _server;
+    QUdpSocket* _udp;
+    QTimer* _tick;
+    QTimer* _beacon;
+    quint16 _port;
+    QString _name;
+    QString _key;
+    QString _algo;
+    bool _minerUp;
+    QList<peer> _peers;
+    QVector<fleetProtocol::gpuSample> _gpus[2];
+    telemetryEncoder _encoder;
+};
+
+#endif // FLEETAGENT_H
@@ -0,0 +1,112 @@
+#include "fleetprotocol.h"
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QtEndian>
+
+static void setupStream(QDataStream& stream)
+{
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream.setByteOrder(QDataStream::BigEndian);
+}
+
+QByteArray fleetProtocol::frame(messageType type, const QByteArray& payload)
+{
+    QByteArray out;
+    out.reserve(payload.size() + 5);
+    quint32 length = qToBigEndian<quint32>(payload.size() + 1);
+    out.append((const char*)&length, sizeof(length));
+    out.append((char)type);
+    out.append(payload);
+    return out;
+}
+
+bool fleetProtocol::nextFrame(QByteArray& buffer, messageType* type, QByteArray* payload, bool* error)
+{
+    *error = false;
+    if(buffer.size() < 4)
+        return false;
+    quint32 length = qFromBigEndian<quint32>((const uchar*)buffer.constData());
+    if(length == 0 || length > (quint32)MAX_FRAME)
+    {
+        *error = true;
+        return false;
+    }
+    if((quint32)buffer.size() < length + 4)
+        return false;
+    *type = (messageType)(quint8)buffer.at(4);
+    *payload = buffer.mid(5, length - 1);
+    buffer.remove(0, length + 4);
+    return true;
+}
+
+QByteArray fleetProtocol::encodeHello(const hello& h)
+{
+    QByteArray out;
+    QDataStream stream(&out, QIODevice::WriteOnly);
+    setupStream(stream);
+    stream << h.version << h.name << h.key << h.algo << h.pool;
+    return out;
+}
+
+bool fleetProtocol::decodeHello(const QByteArray& payload, hello* h)
+{
+    QDataStream stream(payload);
+    setupStream(stream);
+    stream >> h->version >> h->name >> h->key >> h->algo >> h->pool;
+    return stream.status() == QDataStream::Ok;
+}
+
+// Commands are rare, their parameters stay JSON like the control API
+QByteArray fleetProtocol::encodeCommand(const command& c)
+{
+    QByteArray out;
+    QDataStream stream(&out, QIODevice::WriteOnly);
+    setupStream(stream);
+    stream << c.id << c.method << QJsonDocument(c.params).toJson(QJsonDocument::Compact);
+    return out;
+}
+
+bool fleetProtocol::decodeCommand(const QByteArray& payload, command* c)
+{
+    QDataStream stream(payload);
+    setupStream(stream);
+    QByteArray params;
+    stream >> c->id >> c->method >> params;
+    c->params = QJsonDocument::fromJson(params).object();
+    return stream.status() == QDataStream::Ok;
+}
+
+QByteArray fleetProtocol::encodeCommandResult(const command& c)
+{
+    QByteArray out;
+    QDataStream stream(&out, QIODevice::WriteOnly);
+    setupStream(stream);
+    stream << c.id << QJsonDocument(c.result).toJson(QJsonDocument::Compact) << c.error;
+    return out;
+}
+
+bool fleetProtocol::decodeCommandResult(const QByteArray& payload, command* c)
+{
+    QDataStream stream(payload);
+    setupStream(stream);
+    QByteArray result;
+    stream >> c->id >> result >> c->error;
+    c->result = QJsonDocument::fromJson(result).object();
+    return stream.status() == QDataStream::Ok;
+}
+
+QByteArray fleetProtocol::beacon(const QString& name, quint16 port)
+{
+    return QString("SELECTUM %1 %2 %3").arg(VERSION).arg(port).arg(name).toUtf8();
+}
+
+bool fleetProtocol::parseBeacon(const QByteArray& datagram, QString* name, quint16* port)
+{
+    QString text = QString::fromUtf8(datagram);
+    if(!text.startsWith("SELECTUM "))
+        return false;
+    bool ok = false;
+    *port = text.section(' ', 2, 2).toUShort(&ok);
+    *name = text.section(' ', 3);
+    return ok && *port && !name->isEmpty();
+}
@@ -0,0 +1,94 @@
+#ifndef FLEETPROTOCOL_H
+#define FLEETPROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QJsonObject>
+
+// Rig <-> aggregator wire format, shared by Selectum and the aggregator.
+// Every message is a frame: quint32 length (big endian, type included),
+// quint8 type, payload. Rigs announce themselves with a UDP beacon,
+// the aggregator connects to them over TCP and receives one telemetry
+// frame a second; commands run the rig's control API methods.
+// Telemetry and Event payloads use the compact codec of telemetrycodec.h.
+class fleetProtocol
+{
+public:
+    enum messageType
+    {
+        Hello = 1,          // both ways: name, version, key (aggregator only)
+        Telemetry,          // rig -> aggregator
+        Event,              // rig -> aggregator
+        Command,            // aggregator -> rig: id, method, params
+        CommandResult       // rig -> aggregator: id, result, error
+    };
+
+    static const quint16 VERSION = 2;
+    static const quint16 DEFAULT_PORT = 45450;     // TCP for the stream, UDP for the beacon
+    static const int MAX_FRAME = 1024 * 1024;
+
+    struct hello
+    {
+        QString name;
+        quint16 version;
+        QString key;
+        QString algo;
+        QString pool;
+    };
+
+    struct gpuSample
+    {
+        qint32 temp;
+        qint32 fan;
+        qint32 gpuClock;
+        qint32 memClock;
+        qint32 power;       // mW
+        double hashrate;    // H/s
+    };
+
+    struct telemetry
+    {
+        qint64 time;        // ms since epoch
+        bool minerUp;
+        double hashrate;    // H/s
+        quint64 accepted;
+        quint64 rejected;
+        quint64 stale;
+        QVector<gpuSample> gpus;
+    };
+
+    struct event
+    {
+        qint64 time;
+        QString kind;
+        QString text;
+    };
+
+    struct command
+    {
+        quint32 id;
+        QString method;
+        QJsonObject params;
+        QJsonObject result;     // CommandResult: {"result": ...}
+        QString error;
+    };
+
+    static QByteArray frame(messageType type, const QByteArray& payload);
+    // Takes the first complete frame off buffer; false when there is none yet
+    // or the stream is corrupt (error set, the connection should be dropped)
+    static bool nextFrame(QByteArray& buffer, messageType* type, QByteArray* payload, bool* error);
+
+    static QByteArray encodeHello(const hello& h);
+    static bool decodeHello(const QByteArray& payload, hello* h);
+    static QByteArray encodeCommand(const command& c);
+    static bool decodeCommand(const QByteArray& payload, command* c);
+    static QByteArray encodeCommandResult(const command& c);
+    static bool decodeCommandResult(const QByteArray& payload, command* c);
+
+    // "SELECTUM <version> <port> <name>"
+    static QByteArray beacon(const QString& name, quint16 port);
+    static bool parseBeacon(const QByteArray& datagram, QString* name, quint16* port);
+};
+
+#endif // FLEETPROTOCOL_H
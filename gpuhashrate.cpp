@@ -0,0 +1,100 @@
+#include "gpuhashrate.h"
+#include <QRegularExpression>
+
+gpuHashrateTracker::gpuHashrateTracker() : _dropRatio(0.2)
+                                         , _confirm(3)
+                                         , _warmup(10)
+                                         , _unitScale(1)
+{
+}
+
+const char* gpuHashrateTracker::stateName(state s)
+{
+    switch(s)
+    {
+    case Warming:  return "warming";
+    case Healthy:  return "healthy";
+    case Degraded: return "degraded";
+    case Stalled:  return "stalled";
+    }
+    return "unknown";
+}
+
+QList<gpuHashrateTracker::sample> gpuHashrateTracker::parseLine(const QString& line)
+{
+    static const QRegularExpression perGpu("\\b(?:gpu|cu|cl)[/#]?(\\d{1,2}):? +(\\d{1,5}(?:\\.\\d{1,2})?)\\b"
+                                           , QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression unit("([kmg]?)h/s", QRegularExpression::CaseInsensitiveOption);
+    QList<sample> samples;
+    QRegularExpressionMatch unitMatch = unit.match(line);
+    if(!unitMatch.hasMatch())
+        return samples;
+
+    QRegularExpressionMatchIterator it = perGpu.globalMatch(line);
+    while(it.hasNext())
+    {
+        QRegularExpressionMatch match = it.next();
+        samples << update(match.captured(1).toInt(), match.captured(2).toDouble());
+    }
+    if(!samples.isEmpty())
+    {
+        QString prefix = unitMatch.captured(1).toLower();
+        _unitScale = prefix == "k" ? 1e3 : prefix == "m" ? 1e6 : prefix == "g" ? 1e9 : 1;
+    }
+    return samples;
+}
+
+gpuHashrateTracker::sample gpuHashrateTracker::update(int gpu, double rate)
+{
+    if(gpu >= _cards.size())
+        _cards.resize(gpu + 1);
+    card& c = _cards[gpu];
+
+    sample s;
+    s.gpu = gpu;
+    s.rate = rate;
+    s.previous = c.current;
+
+    c.rate = rate;
+    c.zero = rate <= 0 ? c.zero + 1 : 0;
+    c.low = (c.baseline > 0 && rate < c.baseline * (1 - _dropRatio)) ? c.low + 1 : 0;
+
+    if(c.samples < _warmup)
+    {
+        // plain average until the card has settled
+        if(rate > 0)
+        {
+            c.baseline = (c.baseline * c.samples + rate) / (c.samples + 1);
+            c.samples++;
+        }
+        c.current = c.zero >= _confirm ? Stalled : Warming;
+        if(c.current == Warming && c.samples >= _warmup)
+            c.current = Healthy;
+    }
+    else if(c.zero >= _confirm)
+        c.current = Stalled;
+    else if(c.low >= _confirm)
+        c.current = Degraded;
+    else if(c.low == 0 && c.zero == 0)
+    {
+        // only healthy samples move the baseline, so a slow decline can't drag it down
+        c.baseline += (rate - c.baseline) / 32;
+        c.current = Healthy;
+    }
+
+    s.baseline = c.baseline;
+    s.current = c.current;
+    return s;
+}
+
+void gpuHashrateTracker::reset()
+{
+    for(int i = 0; i < _cards.size(); i++)
+    {
+        _cards[i].low = 0;
+        _cards[i].zero = 0;
+        _cards[i].rate = 0;
+        if(_cards[i].current != Warming)
+            _cards[i].current = Healthy;
+    }
+}
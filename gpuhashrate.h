@@ -0,0 +1,73 @@
+#ifndef GPUHASHRATE_H
+#define GPUHASHRATE_H
+
+#include <QString>
+#include <QVector>
+#include <QList>
+
+// Per-GPU hashrate from the miner speed lines ("gpu0 30.12", "GPU1: 29.8"),
+// each card compared against its own rolling baseline.
+class gpuHashrateTracker
+{
+public:
+    enum state
+    {
+        Warming = 0,    // not enough samples for a baseline yet
+        Healthy,
+        Degraded,       // below the baseline by more than the drop ratio
+        Stalled         // reporting zero
+    };
+
+    struct sample
+    {
+        int gpu;
+        double rate;
+        double baseline;
+        state previous;
+        state current;
+    };
+
+    gpuHashrateTracker();
+
+    void setDropRatio(double ratio){_dropRatio = ratio;}
+    void setConfirmSamples(unsigned int count){_confirm = count;}
+    void setWarmupSamples(unsigned int count){_warmup = count;}
+
+    // Returns one sample per GPU found in the line
+    QList<sample> parseLine(const QString& line);
+
+    int gpuCount() const {return _cards.size();}
+    double rate(int gpu) const {return _cards.value(gpu).rate;}
+    double baseline(int gpu) const {return _cards.value(gpu).baseline;}
+    state cardState(int gpu) const {return _cards.value(gpu).current;}
+    // multiplier from the miner's unit (kh/s, Mh/s...) to H/s
+    double unitScale() const {return _unitScale;}
+    static const char* stateName(state s);
+
+    // Forget the short-term history (after a restart); baselines are kept
+    void reset();
+    // Forget the cards altogether, the miner numbers them differently now
+    void clear(){_cards.clear();}
+
+private:
+    struct card
+    {
+        card() : rate(0), baseline(0), samples(0), low(0), zero(0), current(Warming) {}
+        double rate;
+        double baseline;
+        unsigned int samples;
+        unsigned int low;
+        unsigned int zero;
+        state current;
+    };
+
+    sample update(int gpu, double rate);
+
+    QVector<card> _cards;
+    double _dropRatio;
+    unsigned int _confirm;
+    unsigned int _warmup;
+    double _unitScale;
+};
+
+#endif // GPUHASHRATE_H
@@ -1,54 +1,93 @@
 #include "highlighter.h"
+#include "tracer.h"
 #include <QDebug>
 #include <QColor>
 
 Highlighter::Highlighter(QTextDocument *parent)
     : QSyntaxHighlighter(parent)
+    , _next(Plain)
+    , _nextStart(0)
+    , _nextLength(0)
 {
-    HighlightingRule rule;
-
-    QString escaped;
     QTextCharFormat strFormat;
-
     strFormat.setFontWeight(QFont::Bold);
+
     strFormat.setForeground(Qt::cyan);
-    rule.pattern = QRegularExpression(" [0-9]{1,5}.[0-9]{1,2} Mh/s");
-    rule.format = strFormat;
-    _highlightingRules.append(rule);
+    _formats[Hashrate] = strFormat;
 
-    strFormat.setFontWeight(QFont::Bold);
     strFormat.setForeground(Qt::red);
-    rule.pattern = QRegularExpression(" 0.00 Mh/s");
-    rule.format = strFormat;
-    _highlightingRules.append(rule);
+    _formats[ZeroHashrate] = strFormat;
+    _formats[Rejected] = strFormat;
+    _formats[Error] = strFormat;
 
-    escaped = QRegularExpression::escape("**Accepted");
     strFormat.setForeground(Qt::green);
-    rule.pattern = QRegularExpression(escaped);
-    rule.format = strFormat;
-    _highlightingRules.append(rule);
-
-    escaped = QRegularExpression::escape("**Rejected");
-    strFormat.setForeground(Qt::red);
-    rule.pattern = QRegularExpression(escaped);
-    rule.format = strFormat;
-    _highlightingRules.append(rule);
+    _formats[Accepted] = strFormat;
 
-    escaped = QRegularExpression::escape("(stale)");
     strFormat.setForeground(QColor(255, 165, 0)); //orange
-    rule.pattern = QRegularExpression(escaped);
-    rule.format = strFormat;
-    _highlightingRules.append(rule);
+    _formats[Stale] = strFormat;
+}
+
+// Only the part that matters is colored, found with plain string searches
+void Highlighter::setNextLine(lineClass cls, const QString& line)
+{
+    _next = cls;
+    _nextStart = 0;
+    _nextLength = line.length();
+    int pos = -1;
+    switch(cls)
+    {
+    case Hashrate:
+    case ZeroHashrate:
+        pos = line.indexOf(" Mh/s");
+        if(pos != -1)
+        {
+            _nextStart = pos;
+            while(_nextStart > 0 && (line.at(_nextStart - 1).isDigit() || line.at(_nextStart - 1) == '.'))
+                _nextStart--;
+            _nextLength = pos + 5 - _nextStart;
+            if(line.midRef(_nextStart, pos - _nextStart) == QLatin1String("0.00"))
+                _next = ZeroHashrate;
+        }
+        return;
+    case Accepted:
+        pos = line.indexOf("**Accepted");
+        _nextLength = 10;
+        break;
+    case Rejected:
+        pos = line.indexOf("**Rejected");
+        _nextLength = 10;
+        break;
+    case Stale:
+        pos = line.indexOf("(stale)");
+        _nextLength = 7;
+        break;
+    default:
+        return;
+    }
+    if(pos == -1)
+        _nextLength = line.length();
+    else
+        _nextStart = pos;
 }
 
 void Highlighter::highlightBlock(const QString &text)
 {
-    foreach (const HighlightingRule &rule, _highlightingRules) {
-        QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
-        while (matchIterator.hasNext()) {
-            QRegularExpressionMatch match = matchIterator.next();
-            setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+    SELECTUM_TRACE_SCOPE("ui.highlight");
+    // a new block takes the pending class once it has its text,
+    // rehighlighting keeps the class it got
+    lineData* data = static_cast<lineData*>(currentBlockUserData());
+    if(!data)
+    {
+        if(text.isEmpty())
+        {
+            setCurrentBlockState(0);
+            return;
         }
+        data = new lineData(_next, _nextStart, _nextLength);
+        setCurrentBlockUserData(data);
+        _next = Plain;
     }
+    if(data->cls != Plain)
+        setFormat(data->start, qMin(data->length, text.length() - data->start), _formats[data->cls]);
     setCurrentBlockState(0);
 }
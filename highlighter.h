@@ -4,25 +4,50 @@
 #include <QObject>
 #include <QTextCharFormat>
 #include <QSyntaxHighlighter>
-#include <QRegularExpression>
+#include <QTextBlockUserData>
 
+// Colors the miner log from the class the parser gave each line, kept in
+// the block: highlighting a block is a table lookup, no pattern matching.
 class Highlighter : public QSyntaxHighlighter
 {
     Q_OBJECT
 
 public:
+    enum lineClass
+    {
+        Plain = 0,
+        Hashrate,
+        ZeroHashrate,
+        Accepted,
+        Rejected,
+        Stale,
+        Error,
+        ClassCount
+    };
+
     Highlighter(QTextDocument *parent = 0);
 
+    // Class of the next block, set right before the line is appended.
+    // Blocks appended without it are plain.
+    void setNextLine(lineClass cls, const QString& line);
+
 protected:
     void highlightBlock(const QString &text) override;
 
 private:
-    struct HighlightingRule
+    class lineData : public QTextBlockUserData
     {
-        QRegularExpression pattern;
-        QTextCharFormat format;
+    public:
+        lineData(lineClass c, int s, int l) : cls(c), start(s), length(l) {}
+        lineClass cls;
+        int start;
+        int length;
     };
-    QVector<HighlightingRule> _highlightingRules;
+
+    QTextCharFormat _formats[ClassCount];
+    lineClass _next;
+    int _nextStart;
+    int _nextLength;
 };
 
 #endif
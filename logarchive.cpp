@@ -0,0 +1,225 @@
+#include "logarchive.h"
+#include "logsearch.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QDebug>
+#include <algorithm>
+
+logArchive::logArchive(const QString& dir, QObject* pParent) : QThread(pParent)
+                                                              , _dir(dir)
+                                                              , _queue(QUEUE_SIZE)
+                                                              , _dropped(0)
+                                                              , _reportedDrops(0)
+                                                              , _needToStop(false)
+                                                              , _segmentSize(8 * 1024 * 1024)
+                                                              , _segmentAge(24 * 3600 * 1000LL)
+                                                              , _retention(14 * 24 * 3600 * 1000LL)
+                                                              , _segmentStart(0)
+                                                              , _blockFirst(0)
+                                                              , _blockLast(0)
+                                                              , _blockLines(0)
+{
+    _block.reserve(BLOCK_SIZE + 4096);
+}
+
+void logArchive::append(const QString& text)
+{
+    line l;
+    l.time = QDateTime::currentMSecsSinceEpoch();
+    l.text = text;
+    if(!_queue.push(l))
+        _dropped++;
+}
+
+void logArchive::run()
+{
+    if(!QDir().mkpath(_dir))
+    {
+        qDebug() << "log archive cannot create" << _dir;
+        return;
+    }
+    purge();
+    qint64 lastPurge = QDateTime::currentMSecsSinceEpoch();
+
+    line l;
+    while(true)
+    {
+        bool stopping = _needToStop;
+        while(_queue.pop(&l))
+        {
+            if(_blockLines == 0)
+                _blockFirst = l.time;
+            _blockLast = l.time;
+            _block += QByteArray::number(l.time);
+            _block += '\t';
+            _block += l.text.toUtf8();
+            _block += '\n';
+            _blockLines++;
+            if(_block.size() >= BLOCK_SIZE)
+                writeBlock();
+        }
+
+        quint64 dropped = _dropped.load();
+        if(dropped != _reportedDrops)
+        {
+            qint64 now = QDateTime::currentMSecsSinceEpoch();
+            if(_blockLines == 0)
+                _blockFirst = now;
+            _blockLast = now;
+            _block += QByteArray::number(now) + "\t[archive] " + QByteArray::number(dropped - _reportedDrops) + " lines dropped\n";
+            _blockLines++;
+            _reportedDrops = dropped;
+        }
+
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        if(_blockLines && (stopping || now - _blockFirst >= FLUSH_MSEC))
+            writeBlock();
+        if(stopping)
+            break;
+
+        if(now - lastPurge >= 3600 * 1000)
+        {
+            purge();
+            lastPurge = now;
+        }
+        msleep(100);
+    }
+    closeSegment();
+}
+
+void logArchive::writeBlock()
+{
+    if(_segment.isOpen() && (_segment.size() >= _segmentSize || _blockFirst - _segmentStart >= _segmentAge))
+        closeSegment();
+    if(!_segment.isOpen() && !openSegment(_blockFirst))
+    {
+        // disk full or gone: keep the process going, lose the block
+        _block.clear();
+        _blockLines = 0;
+        return;
+    }
+
+    QByteArray compressed = qCompress(_block, 6);
+    blockEntry entry;
+    entry.offset = _segment.size();
+    entry.first = _blockFirst;
+    entry.last = _blockLast;
+    entry.lines = _blockLines;
+    entry.rawSize = _block.size();
+
+    QDataStream out(&_segment);
+    out.setByteOrder(QDataStream::BigEndian);
+    out << BLOCK_MAGIC << (quint32)compressed.size();
+    out.writeRawData(compressed.constData(), compressed.size());
+    _segment.flush();
+
+    // the index is written after the block: an entry always points to a whole block
+    QDataStream index(&_index);
+    index.setByteOrder(QDataStream::BigEndian);
+    index << entry.offset << entry.first << entry.last << entry.lines << entry.rawSize;
+    _index.flush();
+    _tokens.write(logSearch::blockFilter(_block));
+    _tokens.flush();
+
+    _block.clear();
+    _blockLines = 0;
+}
+
+bool logArchive::openSegment(qint64 time)
+{
+    QString base = _dir + QDir::separator() + "miner-" + QDateTime::fromMSecsSinceEpoch(time).toUTC().toString("yyyyMMdd-hhmmss");
+    _segment.setFileName(base + ".slog");
+    _index.setFileName(base + ".idx");
+    _tokens.setFileName(base + ".tok");
+    if(!_segment.open(QIODevice::Append) || !_index.open(QIODevice::Append) || !_tokens.open(QIODevice::Append))
+    {
+        qDebug() << "log archive cannot open" << base << _segment.errorString();
+        closeSegment();
+        return false;
+    }
+    _segmentStart = time;
+    return true;
+}
+
+void logArchive::closeSegment()
+{
+    _segment.close();
+    _index.close();
+    _tokens.close();
+}
+
+void logArchive::purge()
+{
+    if(!_retention)
+        return;
+    qint64 limit = QDateTime::currentMSecsSinceEpoch() - _retention;
+    foreach(const segment& s, segments(_dir))
+    {
+        if(s.last >= limit || s.path == _segment.fileName())
+            continue;
+        QFile::remove(s.path);
+        QFile::remove(s.path.left(s.path.length() - 5) + ".idx");
+        QFile::remove(s.path.left(s.path.length() - 5) + ".tok");
+    }
+}
+
+bool logArchive::readIndex(const QString& idxPath, QList<blockEntry>* blocks)
+{
+    QFile file(idxPath);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::BigEndian);
+    // a crash can leave a partial last entry: it is ignored
+    while(file.bytesAvailable() >= 32)
+    {
+        blockEntry e;
+        stream >> e.offset >> e.first >> e.last >> e.lines >> e.rawSize;
+        blocks->append(e);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+QList<logArchive::segment> logArchive::segments(const QString& dir)
+{
+    QList<segment> list;
+    QDir d(dir);
+    foreach(const QFileInfo& info, d.entryInfoList(QStringList() << "miner-*.slog", QDir::Files, QDir::Name))
+    {
+        segment s;
+        s.path = info.filePath();
+        s.size = info.size();
+        readIndex(s.path.left(s.path.length() - 5) + ".idx", &s.blocks);
+        if(s.blocks.isEmpty())
+        {
+            s.first = s.last = info.lastModified().toMSecsSinceEpoch();
+        }
+        else
+        {
+            s.first = s.blocks.first().first;
+            s.last = s.blocks.last().last;
+        }
+        list << s;
+    }
+    std::sort(list.begin(), list.end(), [](const segment& a, const segment& b){ return a.first < b.first; });
+    return list;
+}
+
+QByteArray logArchive::readBlock(QFile& file, const blockEntry& block)
+{
+    if(!file.seek(block.offset))
+        return QByteArray();
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::BigEndian);
+    quint32 magic = 0;
+    quint32 size = 0;
+    stream >> magic >> size;
+    if(magic != BLOCK_MAGIC || size > 16 * 1024 * 1024)
+        return QByteArray();
+    QByteArray compressed = file.read(size);
+    if((quint32)compressed.size() != size)
+        return QByteArray();
+    return qUncompress(compressed);
+}
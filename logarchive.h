@@ -0,0 +1,100 @@
+#ifndef LOGARCHIVE_H
+#define LOGARCHIVE_H
+
+#include <QThread>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFile>
+#include <atomic>
+#include "spscqueue.h"
+
+// Keeps every miner line on disk. The miner process only pushes lines into
+// a lock-free queue (dropping them if the writer falls behind); the writer
+// thread packs them into compressed blocks and appends those to segment
+// files, rotated by size and age and deleted after the retention period.
+//
+// <dir>/miner-<yyyyMMdd-hhmmss>.slog  blocks: 'SLB1', quint32 size, qCompress(data)
+//                                     data: "<ms since epoch>\t<line>\n" ...
+// <dir>/miner-<yyyyMMdd-hhmmss>.idx   one blockEntry per block, the timestamp index
+// <dir>/miner-<yyyyMMdd-hhmmss>.tok   one token filter per block, see logSearch
+class logArchive : public QThread
+{
+    Q_OBJECT
+public:
+    static const quint32 BLOCK_MAGIC = 0x534C4231;
+    static const int BLOCK_SIZE = 64 * 1024;        // raw bytes per block
+    static const int FLUSH_MSEC = 2000;             // max age of an unwritten line
+    static const int QUEUE_SIZE = 8192;
+
+    struct blockEntry
+    {
+        qint64 offset;      // in the segment
+        qint64 first;       // ms since epoch
+        qint64 last;
+        quint32 lines;
+        quint32 rawSize;
+    };
+
+    struct segment
+    {
+        QString path;       // the .slog
+        qint64 first;
+        qint64 last;
+        qint64 size;
+        QList<blockEntry> blocks;
+    };
+
+    logArchive(const QString& dir, QObject* pParent = Q_NULLPTR);
+    void run();
+    void stop(){_needToStop = true;}
+    const QString& dir() const {return _dir;}
+
+    void setSegmentSize(qint64 bytes){_segmentSize = bytes;}
+    void setSegmentAge(qint64 msec){_segmentAge = msec;}
+    // 0 keeps everything
+    void setRetention(qint64 msec){_retention = msec;}
+
+    // Producer side, one thread at a time (the miner I/O thread holding it)
+    void append(const QString& line);
+    quint64 dropped() const {return _dropped.load();}
+
+    // Segments of dir sorted by time, with their block index
+    static QList<segment> segments(const QString& dir);
+    static bool readIndex(const QString& idxPath, QList<blockEntry>* blocks);
+    // Decompressed content of one block, empty on a corrupt block
+    static QByteArray readBlock(QFile& file, const blockEntry& block);
+
+private:
+    struct line
+    {
+        qint64 time;
+        QString text;
+    };
+
+    void writeBlock();
+    bool openSegment(qint64 time);
+    void closeSegment();
+    void purge();
+
+    QString _dir;
+    spscQueue<line> _queue;
+    std::atomic<quint64> _dropped;
+    quint64 _reportedDrops;
+    bool _needToStop;
+    qint64 _segmentSize;
+    qint64 _segmentAge;
+    qint64 _retention;
+
+    // writer thread only
+    QFile _segment;
+    QFile _index;
+    QFile _tokens;
+    qint64 _segmentStart;
+    QByteArray _block;
+    qint64 _blockFirst;
+    qint64 _blockLast;
+    quint32 _blockLines;
+};
+
+#endif // LOGARCHIVE_H
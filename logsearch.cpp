@@ -0,0 +1,237 @@
+#include "logsearch.h"
+#include "logarchive.h"
+#include <QFile>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QJsonArray>
+
+// FNV-1a: the filters are on disk, the hash must not change with Qt
+static quint64 tokenHash(const QString& token)
+{
+    QByteArray utf8 = token.toUtf8();
+    quint64 hash = 14695981039346656037ULL;
+    for(int i = 0; i < utf8.size(); i++)
+    {
+        hash ^= (quint8)utf8.at(i);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int filterBit(quint64 hash, int i)
+{
+    quint32 h1 = hash;
+    quint32 h2 = hash >> 32;
+    return (h1 + i * h2) % (logSearch::FILTER_BYTES * 8);
+}
+
+QSet<QString> logSearch::tokens(const QString& text)
+{
+    static const QRegularExpression gpuId("\\b(?:gpu|cuda|cu|cl) ?[-#/]? ?(\\d{1,2})\\b");
+    QString lower = text.toLower();
+    if(lower.contains("gpu") || lower.contains("cu") || lower.contains("cl"))
+        lower.replace(gpuId, "gpu\\1");
+
+    QSet<QString> set;
+    int start = -1;
+    bool letter = false;
+    for(int i = 0; i <= lower.size(); i++)
+    {
+        QChar c = i < lower.size() ? lower.at(i) : QChar(' ');
+        if(c.isLetterOrNumber() || c == '_')
+        {
+            if(start == -1)
+            {
+                start = i;
+                letter = false;
+            }
+            letter |= c.isLetter();
+            continue;
+        }
+        if(start != -1 && letter && i - start >= 2 && i - start <= 32)
+            set.insert(lower.mid(start, i - start));
+        start = -1;
+    }
+    return set;
+}
+
+QByteArray logSearch::blockFilter(const QByteArray& block)
+{
+    QSet<QString> set;
+    int pos = 0;
+    while(pos < block.size())
+    {
+        int end = block.indexOf('\n', pos);
+        if(end == -1)
+            end = block.size();
+        int tab = block.indexOf('\t', pos);
+        if(tab != -1 && tab < end)
+            set.unite(tokens(QString::fromUtf8(block.constData() + tab + 1, end - tab - 1)));
+        pos = end + 1;
+    }
+
+    QByteArray filter(FILTER_BYTES, 0);
+    foreach(const QString& token, set)
+    {
+        quint64 hash = tokenHash(token);
+        for(int i = 0; i < FILTER_HASHES; i++)
+        {
+            int bit = filterBit(hash, i);
+            filter[bit / 8] = filter.at(bit / 8) | (1 << (bit % 8));
+        }
+    }
+    return filter;
+}
+
+bool logSearch::mayContain(const QByteArray& filter, const QString& token)
+{
+    if(filter.size() != FILTER_BYTES)
+        return true;
+    quint64 hash = tokenHash(token);
+    for(int i = 0; i < FILTER_HASHES; i++)
+    {
+        int bit = filterBit(hash, i);
+        if(!(filter.at(bit / 8) & (1 << (bit % 8))))
+            return false;
+    }
+    return true;
+}
+
+QList<logSearch::match> logSearch::search(const QString& dir, const query& q, stats* s)
+{
+    QElapsedTimer timer;
+    timer.start();
+    stats st;
+    st.segments = st.blocks = st.decompressed = 0;
+    QList<match> matches;
+    qint64 to = q.to ? q.to : Q_INT64_C(0x7fffffffffffffff);
+
+    foreach(const logArchive::segment& seg, logArchive::segments(dir))
+    {
+        if(seg.last < q.from || seg.first > to)
+            continue;
+        st.segments++;
+
+        // a crash between the .idx and the .tok leaves blocks without a filter: they are scanned
+        QByteArray filters;
+        QFile tok(seg.path.left(seg.path.length() - 5) + ".tok");
+        if(tok.open(QIODevice::ReadOnly))
+            filters = tok.readAll();
+        QFile file(seg.path);
+        if(!file.open(QIODevice::ReadOnly))
+            continue;
+
+        for(int b = 0; b < seg.blocks.size(); b++)
+        {
+            const logArchive::blockEntry& block = seg.blocks.at(b);
+            if(block.last < q.from || block.first > to)
+                continue;
+            st.blocks++;
+            QByteArray filter = filters.mid(b * FILTER_BYTES, FILTER_BYTES);
+            bool candidate = true;
+            foreach(const QString& term, q.terms)
+                candidate = candidate && mayContain(filter, term);
+            if(!candidate)
+                continue;
+
+            QByteArray data = logArchive::readBlock(file, block);
+            st.decompressed++;
+            int pos = 0;
+            while(pos < data.size())
+            {
+                int end = data.indexOf('\n', pos);
+                if(end == -1)
+                    end = data.size();
+                int tab = data.indexOf('\t', pos);
+                if(tab != -1 && tab < end)
+                {
+                    qint64 time = data.mid(pos, tab - pos).toLongLong();
+                    if(time >= q.from && time <= to)
+                    {
+                        QString line = QString::fromUtf8(data.constData() + tab + 1, end - tab - 1);
+                        QSet<QString> lineTokens = tokens(line);
+                        bool all = true;
+                        foreach(const QString& term, q.terms)
+                            all = all && lineTokens.contains(term);
+                        if(all)
+                        {
+                            match m;
+                            m.time = time;
+                            m.line = line;
+                            matches << m;
+                            if(q.limit > 0 && matches.size() >= q.limit)
+                                break;
+                        }
+                    }
+                }
+                pos = end + 1;
+            }
+            if(q.limit > 0 && matches.size() >= q.limit)
+                break;
+        }
+        if(q.limit > 0 && matches.size() >= q.limit)
+            break;
+    }
+
+    st.elapsed = timer.elapsed();
+    if(s)
+        *s = st;
+    return matches;
+}
+
+qint64 logSearch::parseTime(const QString& text)
+{
+    bool ok = false;
+    qint64 ms = text.toLongLong(&ok);
+    if(ok)
+        return ms;
+    QTime time = QTime::fromString(text, text.length() > 5 ? "hh:mm:ss" : "hh:mm");
+    if(time.isValid())
+        return QDateTime(QDate::currentDate(), time).toMSecsSinceEpoch();
+    QDateTime date = QDateTime::fromString(text, Qt::ISODate);
+    return date.isValid() ? date.toMSecsSinceEpoch() : -1;
+}
+
+static bool timeParam(const QJsonObject& params, const QString& name, qint64* time, QString* error)
+{
+    QJsonValue value = params.value(name);
+    if(value.isUndefined() || value.isNull())
+        *time = 0;
+    else if(value.isDouble())
+        *time = (qint64)value.toDouble();
+    else
+        *time = logSearch::parseTime(value.toString());
+    if(*time < 0)
+    {
+        *error = "invalid " + name;
+        return false;
+    }
+    return true;
+}
+
+QJsonObject logSearch::searchJson(const QString& dir, const QJsonObject& params, QString* error)
+{
+    query q;
+    q.terms = tokens(params.value("query").toString()).toList();
+    q.limit = qBound(1, params.value("limit").toInt(200), 10000);
+    if(!timeParam(params, "from", &q.from, error) || !timeParam(params, "to", &q.to, error))
+        return QJsonObject();
+
+    stats s;
+    QJsonArray lines;
+    foreach(const match& m, search(dir, q, &s))
+    {
+        QJsonObject line;
+        line["time"] = (double)m.time;
+        line["line"] = m.line;
+        lines.append(line);
+    }
+    QJsonObject result;
+    result["matches"] = lines;
+    result["segments"] = s.segments;
+    result["blocks"] = s.blocks;
+    result["decompressed"] = s.decompressed;
+    result["elapsed"] = (double)s.elapsed;
+    return result;
+}
@@ -0,0 +1,58 @@
+#ifndef LOGSEARCH_H
+#define LOGSEARCH_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QSet>
+#include <QJsonObject>
+
+// Search over the segments of logArchive. Next to each segment the writer
+// keeps a .tok file: one bloom filter of the block's tokens per block, in
+// the order of the .idx. A query only decompresses the blocks whose time
+// range overlaps and whose filter may hold every term.
+//
+// Tokens are lower case words with a letter in them (numbers alone are too
+// many to be useful), GPU ids are normalized so "GPU #3", "gpu3" and
+// "cuda-3" are all gpu3.
+class logSearch
+{
+public:
+    static const int FILTER_BYTES = 512;
+    static const int FILTER_HASHES = 3;
+
+    struct query
+    {
+        QStringList terms;      // all of them, see tokens()
+        qint64 from;            // ms since epoch, 0 = no bound
+        qint64 to;
+        int limit;
+    };
+
+    struct match
+    {
+        qint64 time;
+        QString line;
+    };
+
+    struct stats
+    {
+        int segments;
+        int blocks;         // in the time range
+        int decompressed;
+        qint64 elapsed;     // ms
+    };
+
+    static QSet<QString> tokens(const QString& text);
+    static QByteArray blockFilter(const QByteArray& block);
+    static bool mayContain(const QByteArray& filter, const QString& token);
+
+    static QList<match> search(const QString& dir, const query& q, stats* s = Q_NULLPTR);
+    // "1700000000000", "2024-01-31T02:00" or "02:00" (today)
+    static qint64 parseTime(const QString& text);
+    // log.search parameters: {"query", "from", "to", "limit"}
+    static QJsonObject searchJson(const QString& dir, const QJsonObject& params, QString* error);
+};
+
+#endif // LOGSEARCH_H
@@ -5,6 +5,7 @@
 #include "nvidianvml.h"
 #include "nvocdialog.h"
 #include "nanopoolapi.h"
+#include "tracer.h"
 #include <QMessageBox>
 #include <QMenu>
 #include <QMenuBar>
@@ -12,17 +13,15 @@
 #include <QLibrary>
 #include <QDir>
 #include <QFileDialog>
+#include <QFile>
 #include <QScrollBar>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <QSharedPointer>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <functional>
 
-#define MINERPATH           "minerpath"
-#define MINERARGS           "minerargs"
-#define AUTORESTART         "autorestart"
-#define MAX0MHS             "max0mhs"
-#define RESTARTDELAY        "restartdelay"
-#define ZEROMHSDELAY        "zeromhsdelay"
-#define AUTOSTART           "autostart"
-#define DISPLAYSHAREONLY    "shareonly"
-#define DELAYNOHASH         "delaynohash"
 #ifdef NVIDIA
 #define NVIDIAOPTION        "nvidia_options"
 #define NVOCOPTION          "nvidia_oc_options"
@@ -33,55 +32,118 @@ MainWindow::MainWindow(QWidget *parent) :
                                           ui(new Ui::MainWindow),
                                           _isMinerRunning(false),
                                           _isStartStoping(false),
-                                          _errorCount(0)
+                                          _restartPending(false),
+                                          _errorCount(0),
+                                          _nvMonitorThrd(Q_NULLPTR),
+                                          _amdMonitorThrd(Q_NULLPTR),
+                                          _nvEvents(Q_NULLPTR),
+                                          _metrics(Q_NULLPTR),
+                                          _control(Q_NULLPTR),
+                                          _proxy(Q_NULLPTR),
+                                          _prober(Q_NULLPTR),
+                                          _profit(Q_NULLPTR),
+                                          _resumeAfterBenchmark(false),
+                                          _fleet(Q_NULLPTR),
+                                          _archive(Q_NULLPTR),
+                                          _nvapi(Q_NULLPTR),
+                                          _startupPending(3)
 
 {
+    _startupClock.start();
 
     _settings = new QSettings(QString(QDir::currentPath() + QDir::separator() + "selectum.ini"), QSettings::IniFormat);
-    _process = new MinerProcess(_settings);
+    _process = new MinerProcess();
     ui->setupUi(this);
     _process->setLogControl(ui->textEdit);
-    connect(_process, &MinerProcess::emitStarted, this, &MainWindow::onMinerStarted);
-    connect(_process, &MinerProcess::emitStoped, this, &MainWindow::onMinerStoped);
-    connect(_process, &MinerProcess::emitError, this, &MainWindow::onError);
-    _nvapi = new nvidiaAPI();
-    bool nvDll = true;
-    QLibrary lib("nvml.dll");
-    if (!lib.load())
+    reloadConfig();
+    startupMark("config loaded");
+    configPtr config = configStore::current();
+    if(!config->logArchiveDir.isEmpty())
     {
-        lib.setFileName("C://Program Files//NVIDIA GPU Computing Toolkit//CUDA//v9.0//lib//x64//nvml.dll");
-        if(!lib.load())
-        {
-            ui->textEdit->append("Cannot find nvml.dll. NVAPI monitoring won't work.");
-            nvDll = false;
-        }
+        _archive = new logArchive(config->logArchiveDir, this);
+        _archive->setSegmentSize(config->logSegmentSize * 1024LL * 1024);
+        _archive->setSegmentAge(config->logSegmentAge * 3600 * 1000LL);
+        _archive->setRetention(config->logKeepDays * 24 * 3600 * 1000LL);
+        _process->setLogArchive(_archive);
+        _archive->start(QThread::LowPriority);
     }
-    if(nvDll)
+    if(config->metricsPort)
     {
-        _nvMonitorThrd = new nvMonitorThrd(this);
-        connect(_nvMonitorThrd, &nvMonitorThrd::gpuInfoSignal, this, &MainWindow::onNvMonitorInfo);
-        _nvMonitorThrd->start();
-        if(_nvapi->libLoaded())
-        {
-        }
+        _metrics = new metricsExporter(config->metricsPort);
+        _metrics->start();
+        _process->setMetricsExporter(_metrics);
     }
-    else
+    if(config->proxyPort)
     {
-        ui->groupBoxNvidia->hide();
+        _proxy = new stratumProxy(this);
+        if(!_proxy->listen(config->proxyPort))
+        {
+            delete _proxy;
+            _proxy = Q_NULLPTR;
+        }
     }
-    QLibrary adl("atiadlxx");
-    if(!adl.load())
+    connect(_process, &MinerProcess::emitStarted, this, &MainWindow::onMinerStarted);
+    connect(_process, &MinerProcess::emitStoped, this, &MainWindow::onMinerStoped);
+    connect(_process, &MinerProcess::emitError, this, &MainWindow::onError);
+    connect(_process, &MinerProcess::emitRejectSpike, this, &MainWindow::onRejectSpike);
+    connect(_process, &MinerProcess::emitGpuDegraded, this, &MainWindow::onGpuDegraded);
+    // the vendor libraries load in the background, their parts of the UI
+    // show up when they are ready
+    ui->groupBoxNvidia->hide();
+    ui->groupBoxAMD->hide();
+    _nvapiWatcher = new QFutureWatcher<nvidiaAPI*>(this);
+    connect(_nvapiWatcher, &QFutureWatcher<nvidiaAPI*>::finished, this, &MainWindow::onNvapiLoaded);
+    _nvapiWatcher->setFuture(QtConcurrent::run([](){
+        nvidiaAPI* api = new nvidiaAPI();
+        api->moveToThread(QCoreApplication::instance()->thread());
+        return api;
+    }));
+    _nvmlWatcher = new QFutureWatcher<bool>(this);
+    connect(_nvmlWatcher, &QFutureWatcher<bool>::finished, this, &MainWindow::onNvmlProbed);
+    _nvmlWatcher->setFuture(QtConcurrent::run([](){
+        QLibrary lib("nvml.dll");
+        if(lib.load())
+            return true;
+        lib.setFileName("C://Program Files//NVIDIA GPU Computing Toolkit//CUDA//v9.0//lib//x64//nvml.dll");
+        return lib.load();
+    }));
+    _adlWatcher = new QFutureWatcher<bool>(this);
+    connect(_adlWatcher, &QFutureWatcher<bool>::finished, this, &MainWindow::onAdlProbed);
+    _adlWatcher->setFuture(QtConcurrent::run([](){
+        QLibrary adl("atiadlxx");
+        if(!adl.load())
+            return false;
+        adl.unload();
+        return true;
+    }));
+    startupMark("vendor libraries loading");
+    loadParameters();
+    _prober = new poolProber(this);
+    _prober->setDialect(poolProber::dialectFor(ui->comboBox->currentText()));
+    _prober->setPools(config->pools);
+    if(_prober->poolCount())
     {
-        ui->groupBoxAMD->hide();
+        _prober->setInterval(config->poolProbeInterval);
+        _prober->setCurrent(ui->poolPort->text());
+        connect(_prober, &poolProber::poolChanged, this, &MainWindow::onPoolChanged);
+        _prober->start();
     }
-    else
+    if(config->profitSwitch)
     {
-        adl.unload();
-        _amdMonitorThrd = new amdMonitorThrd(this);
-        connect(_amdMonitorThrd, &amdMonitorThrd::gpuInfoSignal, this, &MainWindow::onAMDMonitorInfo);
-        _amdMonitorThrd->start();
+        _profit = new profitSwitcher(_settings, this);
+        _profit->setFeed(config->profitFeed);
+        _profit->setElectricityCost(config->electricityCost);
+        _profit->setHysteresis(config->profitHysteresis);
+        _profit->setMinDwell(config->profitMinDwell);
+        _profit->setCurrent(ui->currenciesBox->currentText());
+        connect(_profit, &profitSwitcher::switchTo, this, &MainWindow::onProfitSwitch);
+        _profit->start(config->profitInterval);
     }
-    loadParameters();
+    _benchmark = new benchmarkRunner(_process, _settings, this);
+    _benchmark->setWarmup(config->benchmarkWarmup);
+    _benchmark->setWindow(config->benchmarkWindow);
+    connect(_benchmark, &benchmarkRunner::progress, ui->textEdit, &QTextEdit::append);
+    connect(_benchmark, &benchmarkRunner::finished, this, &MainWindow::onBenchmarkFinished);
     setupToolTips();
     createActions();
     createTrayIcon();
@@ -89,45 +151,309 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(_trayIcon, &QSystemTrayIcon::activated, this, &MainWindow::iconActivated);
     _trayIcon->show();
     setupEditor();
-    if(ui->checkBoxAutoStart->isChecked())
+    setupControlApi();
+    if(config->fleetPort)
     {
-        _starter = new autoStart(this);
-        connect(_starter, SIGNAL(readyToStartMiner()), this, SLOT(onReadyToStartMiner()));
-        _starter->start();
+        _fleet = new fleetAgent(_process, _control, this);
+        _fleet->setName(config->rigName);
+        _fleet->setKey(config->fleetKey);
+        _fleet->setAlgo(ui->comboBox->currentText());
+        _fleet->listen(config->fleetPort);
+        connect(_process, &MinerProcess::emitStarted, this, [this](){
+            _fleet->setMinerRunning(true);
+            _fleet->setAlgo(ui->comboBox->currentText());
+            _fleet->sendEvent("miner", "started");
+        });
+        connect(_process, &MinerProcess::emitStoped, this, [this](){
+            _fleet->setMinerRunning(false);
+            _fleet->sendEvent("miner", "stopped");
+        });
+        connect(_process, &MinerProcess::emitError, this, [this](){ _fleet->sendEvent("miner", "error"); });
+        connect(_process, &MinerProcess::emitRejectSpike, this, [this](int gpu, double ratio){
+            _fleet->sendEvent("rejects", QString("gpu%1 %2%").arg(gpu).arg(ratio * 100, 0, 'f', 1));
+        });
     }
+    // editors write in several steps, reload once they are done
+    _configReload = new QTimer(this);
+    _configReload->setSingleShot(true);
+    _configReload->setInterval(500);
+    connect(_configReload, &QTimer::timeout, this, &MainWindow::hotReload);
+    _configWatcher = new QFileSystemWatcher(QStringList() << _settings->fileName(), this);
+    connect(_configWatcher, &QFileSystemWatcher::fileChanged, this, [this](const QString& path){
+        // saving by replacing the file drops it from the watcher
+        if(!_configWatcher->files().contains(path) && QFile::exists(path))
+            _configWatcher->addPath(path);
+        _configReload->start();
+    });
     ui->pushButtonShowHideLog->setChecked(true);
+    startupMark("window ready");
+}
+
+void MainWindow::startupMark(const QString& step)
+{
+    _startupTimeline << QString("%1 +%2 ms").arg(step).arg(_startupClock.elapsed());
+}
+
+// The timeline is logged once NVAPI, NVML and ADL are all done
+void MainWindow::onStartupStep()
+{
+    if(--_startupPending > 0)
+        return;
+    startupMark("libraries ready");
+    ui->textEdit->append("startup: " + _startupTimeline.join(", "));
+}
+
+// The miner only needs NVAPI (OC on start), the monitors show up on their own
+void MainWindow::onNvapiLoaded()
+{
+    _nvapi = _nvapiWatcher->result();
+    startupMark(_nvapi->libLoaded() ? "nvapi loaded" : "nvapi not found");
+    if(ui->checkBoxAutoStart->isChecked())
+    {
+        onReadyToStartMiner();
+        startupMark("miner starting");
+    }
+    onStartupStep();
+}
+
+void MainWindow::onNvmlProbed()
+{
+    if(!_nvmlWatcher->result())
+    {
+        ui->textEdit->append("Cannot find nvml.dll. NVAPI monitoring won't work.");
+        startupMark("nvml not found");
+        onStartupStep();
+        return;
+    }
+    ui->groupBoxNvidia->show();
+    _nvMonitorThrd = new nvMonitorThrd(this);
+    _nvMonitorThrd->setMetricsExporter(_metrics);
+    connect(_nvMonitorThrd, &nvMonitorThrd::gpuInfoSignal, this, &MainWindow::onNvMonitorInfo);
+    connect(_nvMonitorThrd, &nvMonitorThrd::gpuTelemetry, _benchmark, &benchmarkRunner::setGpuTelemetry);
+    if(_fleet)
+        connect(_nvMonitorThrd, &nvMonitorThrd::gpuTelemetry, _fleet, &fleetAgent::setGpuTelemetry);
+    _nvMonitorThrd->start();
+    _nvEvents = new nvmlEventWaiter(this);
+    connect(_nvEvents, &nvmlEventWaiter::xidError, _process, &MinerProcess::onGpuXid);
+    connect(_nvEvents, &nvmlEventWaiter::clockChanged, this, [this](unsigned int){ _nvMonitorThrd->boost(10 * 1000); });
+    connect(_nvEvents, &nvmlEventWaiter::powerStateChanged, this, [this](unsigned int){ _nvMonitorThrd->boost(10 * 1000); });
+    _nvEvents->start();
+    startupMark("nvml monitor started");
+    onStartupStep();
+}
+
+void MainWindow::onAdlProbed()
+{
+    if(_adlWatcher->result())
+    {
+        ui->groupBoxAMD->show();
+        _amdMonitorThrd = new amdMonitorThrd(this);
+        _amdMonitorThrd->setMetricsExporter(_metrics);
+        connect(_amdMonitorThrd, &amdMonitorThrd::gpuInfoSignal, this, &MainWindow::onAMDMonitorInfo);
+        connect(_amdMonitorThrd, &amdMonitorThrd::gpuTelemetry, _benchmark, &benchmarkRunner::setGpuTelemetry);
+        if(_fleet)
+            connect(_amdMonitorThrd, &amdMonitorThrd::gpuTelemetry, _fleet, &fleetAgent::setGpuTelemetry);
+        _amdMonitorThrd->start();
+    }
+    startupMark(_adlWatcher->result() ? "adl monitor started" : "adl not found");
+    onStartupStep();
 }
 
 MainWindow::~MainWindow()
 {
     saveParameters();
+    if(_nvEvents)
+    {
+        _nvEvents->stop();
+        _nvEvents->wait();
+    }
+    if(_prober->isRunning())
+    {
+        _prober->stop();
+        _prober->wait();
+    }
     _process->stop();
     if(_nvapi != Q_NULLPTR)
         delete _nvapi;
+    // waits for the miner to exit
     delete _process;
+    if(_archive)
+    {
+        // the last lines of the miner are the ones we want after a crash
+        _archive->stop();
+        _archive->wait();
+    }
+    if(_metrics)
+        delete _metrics;
     delete _settings;
     delete ui;
 }
 
-void MainWindow::applyOC()
+void MainWindow::reloadConfig()
 {
-    _settings->beginGroup("nvoc");
-    if(_settings->value("nvoc_applyonstart").toBool())
+    QStringList warnings;
+    configPtr config = selectumConfig::load(_settings, &warnings);
+    foreach(const QString& warning, warnings)
+        ui->textEdit->append("selectum.ini: " + warning);
+    configStore::publish(config);
+    _process->setConfig(config);
+}
+
+// selectum.ini changed on disk: apply only what differs from the running
+// snapshot. Watchdog, OC, pool, profit, benchmark and fleet identity values
+// are live; ports and the log archive wait for the next start. The miner is
+// only restarted when the command line it would get is different.
+void MainWindow::hotReload()
+{
+    _settings->sync();
+    configPtr old = configStore::current();
+    reloadConfig();
+    configPtr config = configStore::current();
+
+    if(config->watchdog.autoRestart != old->watchdog.autoRestart)
     {
-        if(_nvapi->libLoaded())
+        ui->groupBoxWatchdog->setChecked(config->watchdog.autoRestart);
+        on_groupBoxWatchdog_clicked(config->watchdog.autoRestart);
+    }
+    if(config->watchdog.max0mhs != old->watchdog.max0mhs)
+        ui->spinBoxMax0MHs->setValue(config->watchdog.max0mhs);
+    if(config->watchdog.restartDelay != old->watchdog.restartDelay)
+        ui->spinBoxDelay->setValue(config->watchdog.restartDelay);
+    if(config->watchdog.delayBefore0mhs != old->watchdog.delayBefore0mhs)
+        ui->spinBoxDelay0MHs->setValue(config->watchdog.delayBefore0mhs);
+    if(config->watchdog.delayNoHash != old->watchdog.delayNoHash)
+        ui->spinBoxDelayNoHash->setValue(config->watchdog.delayNoHash);
+    if(config->autoStart != old->autoStart)
+        ui->checkBoxAutoStart->setChecked(config->autoStart);
+
+    if(_isMinerRunning && config->ocApplyOnStart && _nvapi && _nvapi->libLoaded())
+    {
+        const selectumConfig::ocProfile& oc = config->ocProfileFor(ui->comboBox->currentText());
+        const selectumConfig::ocProfile& before = old->ocProfileFor(ui->comboBox->currentText());
+        bool changed = !old->ocApplyOnStart;
+        const int unset = selectumConfig::ocProfile::UNSET;
+        for(unsigned int i = 0; i < _nvapi->getGPUCount(); i++)
         {
-            for(unsigned int i = 0; i < _nvapi->getGPUCount(); i++)
-            {
-                _nvapi->setPowerLimitPercent(i, _settings->value(QString("powerlimitoffset" + QString::number(i))).toInt());
-                _nvapi->setGPUOffset(i, _settings->value(QString("gpuoffset" + QString::number(i))).toInt());
-                _nvapi->setMemClockOffset(i, _settings->value(QString("memoffset" + QString::number(i))).toInt());
-                _nvapi->setFanSpeed(i, _settings->value(QString("fanspeed" + QString::number(i))).toInt());
-            }
-            if(_settings->value(QString("fanspeed" + QString::number(0))).toInt() == 101)
-                _nvapi->startFanThread();
+            int value = oc.powerLimit.value(i, unset);
+            if(value != unset && (changed || value != before.powerLimit.value(i, unset)))
+                _nvapi->setPowerLimitPercent(i, value);
+            value = oc.gpuOffset.value(i, unset);
+            if(value != unset && (changed || value != before.gpuOffset.value(i, unset)))
+                _nvapi->setGPUOffset(i, value);
+            value = oc.memOffset.value(i, unset);
+            if(value != unset && (changed || value != before.memOffset.value(i, unset)))
+                _nvapi->setMemClockOffset(i, value);
+            value = oc.fanSpeed.value(i, unset);
+            if(value != unset && (changed || value != before.fanSpeed.value(i, unset)))
+                _nvapi->setFanSpeed(i, value);
         }
+        if(oc.fanSpeed.value(0) == 101 && (changed || before.fanSpeed.value(0) != 101))
+            _nvapi->startFanThread();
+        if(_nvMonitorThrd)
+            _nvMonitorThrd->boost(60 * 1000);
     }
-    _settings->endGroup();
+
+    if(config->poolProbeInterval != old->poolProbeInterval)
+        _prober->setInterval(config->poolProbeInterval);
+    if(!(config->pools == old->pools))
+    {
+        _prober->setPools(config->pools);
+        if(_prober->poolCount() && !_prober->isRunning())
+        {
+            connect(_prober, &poolProber::poolChanged, this, &MainWindow::onPoolChanged, Qt::UniqueConnection);
+            _prober->start();
+        }
+    }
+
+    if(_profit)
+    {
+        _profit->setFeed(config->profitFeed);
+        _profit->setElectricityCost(config->electricityCost);
+        _profit->setHysteresis(config->profitHysteresis);
+        _profit->setMinDwell(config->profitMinDwell);
+        if(!config->profitSwitch)
+            _profit->stop();
+        else if(!old->profitSwitch || config->profitInterval != old->profitInterval)
+            _profit->start(config->profitInterval);
+    }
+    else if(config->profitSwitch && !old->profitSwitch)
+        ui->textEdit->append("selectum.ini: profit switching starts on the next start of Selectum");
+
+    // benchmark.start may have set others, only a change overrides them
+    if(config->benchmarkWarmup != old->benchmarkWarmup)
+        _benchmark->setWarmup(config->benchmarkWarmup);
+    if(config->benchmarkWindow != old->benchmarkWindow)
+        _benchmark->setWindow(config->benchmarkWindow);
+
+    if(_fleet)
+    {
+        _fleet->setName(config->rigName);
+        _fleet->setKey(config->fleetKey);
+    }
+
+    if(config->metricsPort != old->metricsPort || config->controlPort != old->controlPort
+            || config->controlSocket != old->controlSocket || config->proxyPort != old->proxyPort
+            || config->fleetPort != old->fleetPort)
+        ui->textEdit->append("selectum.ini: listening ports change on the next start of Selectum");
+    if(config->logArchiveDir != old->logArchiveDir || config->logSegmentSize != old->logSegmentSize
+            || config->logSegmentAge != old->logSegmentAge || config->logKeepDays != old->logKeepDays)
+        ui->textEdit->append("selectum.ini: log archive settings change on the next start of Selectum");
+
+    // the pool fields regenerate the arguments, so they go first
+    if(config->poolSSL != old->poolSSL)
+        ui->useSSL->setCurrentIndex(config->poolSSL);
+    if(config->poolPort != old->poolPort)
+        ui->poolPort->setText(config->poolPort);
+    if(config->wallet != old->wallet)
+        ui->wallet->setText(config->wallet);
+    if(config->worker != old->worker)
+        ui->worker->setText(config->worker);
+    if(config->email != old->email)
+        ui->email->setText(config->email);
+    if(config->minerPath != old->minerPath)
+        ui->lineEditMinerPath->setText(config->minerPath);
+    if(config->minerArgs != old->minerArgs)
+        ui->lineEditArgs->setText(config->minerArgs);
+
+    if(!_isMinerRunning || _benchmark->isRunning())
+        return;
+    // behind the proxy a pool change only moves the upstream
+    pointProxy();
+    QString args = minerArgs();
+    if(args != _process->minerArgs() || ui->lineEditMinerPath->text() != _process->minerPath())
+    {
+        ui->textEdit->append("selectum.ini: miner command line changed, restarting the miner");
+        _process->stop();
+        _process->start(ui->lineEditMinerPath->text(), args);
+    }
+}
+
+// Uses the algorithm's overclocking profile [nvoc_<algo>], [nvoc] otherwise
+void MainWindow::applyOC()
+{
+    SELECTUM_TRACE_SCOPE("applyOC");
+    configPtr config = configStore::current();
+    if(!config->ocApplyOnStart || !_nvapi || !_nvapi->libLoaded())
+        return;
+
+    const selectumConfig::ocProfile& oc = config->ocProfileFor(ui->comboBox->currentText());
+    // GPUs missing from the profile keep what they run with
+    const int unset = selectumConfig::ocProfile::UNSET;
+    for(unsigned int i = 0; i < _nvapi->getGPUCount(); i++)
+    {
+        if(oc.powerLimit.value(i, unset) != unset)
+            _nvapi->setPowerLimitPercent(i, oc.powerLimit.at(i));
+        if(oc.gpuOffset.value(i, unset) != unset)
+            _nvapi->setGPUOffset(i, oc.gpuOffset.at(i));
+        if(oc.memOffset.value(i, unset) != unset)
+            _nvapi->setMemClockOffset(i, oc.memOffset.at(i));
+        if(oc.fanSpeed.value(i, unset) != unset)
+            _nvapi->setFanSpeed(i, oc.fanSpeed.at(i));
+    }
+    if(oc.fanSpeed.value(0) == 101)
+        _nvapi->startFanThread();
+    if(_nvMonitorThrd)
+        _nvMonitorThrd->boost(60 * 1000);
 }
 
 
@@ -185,6 +511,25 @@ void MainWindow::createActions()
 {
     _restoreAction = new QAction(tr("&Restore"), this);
     connect(_restoreAction, &QAction::triggered, this, &QWidget::showNormal);
+    _benchmarkAction = new QAction(tr("&Benchmark"), this);
+    _benchmarkAction->setCheckable(true);
+    connect(_benchmarkAction, &QAction::triggered, this, [this](bool checked){
+        if(checked)
+            _benchmarkAction->setChecked(startBenchmark());
+        else
+            _benchmark->abort();
+    });
+#ifdef SELECTUM_TRACING
+    _traceAction = new QAction(tr("Save &trace"), this);
+    connect(_traceAction, &QAction::triggered, this, [this](){
+        QString path = tracer::defaultPath();
+        int events = tracer::dump(path);
+        if(events < 0)
+            _trayIcon->showMessage("Selectum", "Cannot write " + path, QSystemTrayIcon::Warning, 5 * 1000);
+        else
+            _trayIcon->showMessage("Selectum", QString("%1 trace events saved to %2").arg(events).arg(path), QSystemTrayIcon::Information, 5 * 1000);
+    });
+#endif
     _quitAction = new QAction(tr("&Close"), this);
     connect(_quitAction, &QAction::triggered, qApp, &QCoreApplication::quit);
 }
@@ -193,6 +538,10 @@ void MainWindow::createTrayIcon()
 {
     _trayIconMenu = new QMenu(this);
     _trayIconMenu->addAction(_restoreAction);
+    _trayIconMenu->addAction(_benchmarkAction);
+#ifdef SELECTUM_TRACING
+    _trayIconMenu->addAction(_traceAction);
+#endif
     _trayIconMenu->addSeparator();
     _trayIconMenu->addAction(_quitAction);
     _trayIconMenu->setStyleSheet("QMenu {\
@@ -216,7 +565,10 @@ void MainWindow::setupEditor()
     font.setFixedPitch(true);
     font.setPointSize(8);
     ui->textEdit->setFont(font);
+    // the archive keeps the whole history, the widget only the recent lines
+    ui->textEdit->document()->setMaximumBlockCount(5000);
     _highlighter = new Highlighter(ui->textEdit->document());
+    _process->setHighlighter(_highlighter);
 }
 
 void MainWindow::setupToolTips()
@@ -241,6 +593,290 @@ void MainWindow::setupToolTips()
         ui->groupBoxWatchdog->setToolTip("");
 }
 
+void MainWindow::setupControlApi()
+{
+    _control = new controlServer(this);
+    configPtr config = configStore::current();
+    _control->listen(config->controlSocket, config->controlPort);
+
+    _control->registerMethod("miner.start", [this](const QJsonObject&, QString*) -> QJsonValue {
+        if(!_isMinerRunning) on_pushButton_clicked();
+        return true;
+    });
+    _control->registerMethod("miner.stop", [this](const QJsonObject&, QString*) -> QJsonValue {
+        if(_isMinerRunning) on_pushButton_clicked();
+        return true;
+    });
+    // through the button's path: a start or stop in progress is not doubled,
+    // the stopped miner is started again from onMinerStoped()
+    _control->registerMethod("miner.restart", [this](const QJsonObject&, QString* error) -> QJsonValue {
+        if(_isStartStoping)
+        {
+            *error = "the miner is already starting or stopping";
+            return QJsonValue();
+        }
+        _restartPending = _isMinerRunning;
+        on_pushButton_clicked();
+        if(!_isStartStoping)
+        {
+            _restartPending = false;
+            *error = "no miner path or arguments";
+            return QJsonValue();
+        }
+        return true;
+    });
+    _control->registerMethod("status", [this](const QJsonObject&, QString*) -> QJsonValue {
+        QJsonObject status;
+        status["running"] = _isMinerRunning;
+        status["miner"] = ui->lineEditMinerPath->text();
+        status["args"] = ui->lineEditArgs->text();
+        status["errors"] = (int)_errorCount;
+        return status;
+    });
+    _control->registerMethod("shares", [this](const QJsonObject&, QString*) -> QJsonValue {
+        return _process->ledger().toJson();
+    });
+    _control->registerMethod("gpus", [this](const QJsonObject&, QString*) -> QJsonValue {
+        QJsonArray gpus;
+        gpuHashrateTracker& rates = _process->gpuRates();
+        for(int i = 0; i < rates.gpuCount(); i++)
+        {
+            QJsonObject gpu;
+            gpu["gpu"] = i;
+            gpu["hashrate"] = rates.rate(i);
+            gpu["baseline"] = rates.baseline(i);
+            gpu["state"] = gpuHashrateTracker::stateName(rates.cardState(i));
+            gpus.append(gpu);
+        }
+        return gpus;
+    });
+    _control->registerMethod("watchdog.get", [this](const QJsonObject&, QString*) -> QJsonValue {
+        QJsonObject watchdog;
+        watchdog["enabled"] = ui->groupBoxWatchdog->isChecked();
+        watchdog["max0mhs"] = ui->spinBoxMax0MHs->value();
+        watchdog["restartDelay"] = ui->spinBoxDelay->value();
+        watchdog["delayBefore0mhs"] = ui->spinBoxDelay0MHs->value();
+        watchdog["delayNoHash"] = ui->spinBoxDelayNoHash->value();
+        return watchdog;
+    });
+    // widgets are updated so their valueChanged slots push the values to the miner process
+    _control->registerMethod("watchdog.set", [this](const QJsonObject& params, QString*) -> QJsonValue {
+        if(params.contains("enabled"))
+        {
+            ui->groupBoxWatchdog->setChecked(params.value("enabled").toBool());
+            on_groupBoxWatchdog_clicked(ui->groupBoxWatchdog->isChecked());
+        }
+        if(params.contains("max0mhs"))
+            ui->spinBoxMax0MHs->setValue(params.value("max0mhs").toInt());
+        if(params.contains("restartDelay"))
+            ui->spinBoxDelay->setValue(params.value("restartDelay").toInt());
+        if(params.contains("delayBefore0mhs"))
+            ui->spinBoxDelay0MHs->setValue(params.value("delayBefore0mhs").toInt());
+        if(params.contains("delayNoHash"))
+            ui->spinBoxDelayNoHash->setValue(params.value("delayNoHash").toInt());
+        saveParameters();
+        return true;
+    });
+    // params: gpu (-1 or absent for all), powerlimit, gpuoffset, memoffset, fanspeed (101 = auto), save
+    _control->registerMethod("oc.apply", [this](const QJsonObject& params, QString* error) -> QJsonValue {
+        if(!_nvapi || !_nvapi->libLoaded())
+        {
+            *error = "NVAPI not available";
+            return QJsonValue();
+        }
+        int gpu = params.value("gpu").toInt(-1);
+        unsigned int count = _nvapi->getGPUCount();
+        if(gpu >= (int)count)
+        {
+            *error = QString("no GPU %1, %2 found").arg(gpu).arg(count);
+            return QJsonValue();
+        }
+        // same ranges as selectum.ini, nothing is applied when one is off
+        struct range {const char* key; int min; int max;};
+        const range ranges[] = {{"powerlimit", 0, 200}, {"gpuoffset", -1000, 1000}, {"memoffset", -2000, 3000}, {"fanspeed", 0, 101}};
+        for(const range& r : ranges)
+        {
+            int value = params.value(r.key).toInt();
+            if(params.contains(r.key) && (!params.value(r.key).isDouble() || value < r.min || value > r.max))
+            {
+                *error = QString("%1 out of range [%2, %3]").arg(r.key).arg(r.min).arg(r.max);
+                return QJsonValue();
+            }
+        }
+        unsigned int first = gpu < 0 ? 0 : gpu;
+        unsigned int last = gpu < 0 ? count : gpu + 1;
+        bool autoFan = params.value("fanspeed").toInt() == 101;
+        bool save = params.value("save").toBool();
+        _settings->beginGroup("nvoc");
+        for(unsigned int i = first; i < last; i++)
+        {
+            QString index = QString::number(i);
+            if(params.contains("powerlimit"))
+            {
+                _nvapi->setPowerLimitPercent(i, params.value("powerlimit").toInt());
+                if(save) _settings->setValue("powerlimitoffset" + index, params.value("powerlimit").toInt());
+            }
+            if(params.contains("gpuoffset"))
+            {
+                _nvapi->setGPUOffset(i, params.value("gpuoffset").toInt());
+                if(save) _settings->setValue("gpuoffset" + index, params.value("gpuoffset").toInt());
+            }
+            if(params.contains("memoffset"))
+            {
+                _nvapi->setMemClockOffset(i, params.value("memoffset").toInt());
+                if(save) _settings->setValue("memoffset" + index, params.value("memoffset").toInt());
+            }
+            if(params.contains("fanspeed"))
+            {
+                if(!autoFan) _nvapi->setFanSpeed(i, params.value("fanspeed").toInt());
+                if(save) _settings->setValue("fanspeed" + index, params.value("fanspeed").toInt());
+            }
+        }
+        _settings->endGroup();
+        if(save)
+            reloadConfig();
+        if(autoFan)
+            _nvapi->startFanThread();
+        if(_nvMonitorThrd)
+            _nvMonitorThrd->boost(60 * 1000);
+        return true;
+    });
+    _control->registerMethod("nvapi.entrypoints", [this](const QJsonObject&, QString* error) -> QJsonValue {
+        if(!_nvapi || !_nvapi->libLoaded())
+        {
+            *error = "NVAPI not available";
+            return QJsonValue();
+        }
+        return _nvapi->entryPointsJson();
+    });
+    _control->registerMethod("debug.driverstats", [](const QJsonObject&, QString*) -> QJsonValue {
+        return driverCallStats::instance().toJson();
+    });
+    // params: path (selectum-trace-<time>.json in the working directory by default)
+    _control->registerMethod("debug.trace", [](const QJsonObject& params, QString* error) -> QJsonValue {
+        if(!tracer::compiledIn())
+        {
+            *error = "tracing not compiled in (DEFINES += SELECTUM_TRACING)";
+            return QJsonValue();
+        }
+        QString path = params.value("path").toString(tracer::defaultPath());
+        int events = tracer::dump(path);
+        if(events < 0)
+        {
+            *error = "cannot write " + path;
+            return QJsonValue();
+        }
+        QJsonObject result;
+        result["path"] = path;
+        result["events"] = events;
+        return result;
+    });
+    _control->registerMethod("pools", [this](const QJsonObject&, QString*) -> QJsonValue {
+        return _prober->toJson();
+    });
+    _control->registerMethod("profit", [this](const QJsonObject&, QString* error) -> QJsonValue {
+        if(!_profit)
+        {
+            *error = "profit switching disabled";
+            return QJsonValue();
+        }
+        return _profit->toJson();
+    });
+    // params: warmup, window (seconds)
+    _control->registerMethod("benchmark.start", [this](const QJsonObject& params, QString* error) -> QJsonValue {
+        if(params.contains("warmup"))
+            _benchmark->setWarmup(params.value("warmup").toInt());
+        if(params.contains("window"))
+            _benchmark->setWindow(params.value("window").toInt());
+        if(!startBenchmark())
+        {
+            *error = "nothing to benchmark";
+            return QJsonValue();
+        }
+        _benchmarkAction->setChecked(true);
+        return _benchmark->status();
+    });
+    _control->registerMethod("benchmark.status", [this](const QJsonObject&, QString*) -> QJsonValue {
+        return _benchmark->status();
+    });
+    _control->registerMethod("benchmark.abort", [this](const QJsonObject&, QString*) -> QJsonValue {
+        _benchmark->abort();
+        return true;
+    });
+    _control->registerMethod("standby", [this](const QJsonObject&, QString*) -> QJsonValue {
+        return _process->standbyJson();
+    });
+    // params: query ("rejected gpu3"), from, to (ms, ISO date or hh:mm), limit
+    // decompressing blocks takes a while: the search runs on the thread pool
+    _control->registerAsyncMethod("log.search", [this](const QJsonObject& params, controlServer::responder reply) {
+        if(!_archive)
+        {
+            reply(QJsonValue(), "log archive disabled");
+            return;
+        }
+        QString dir = _archive->dir();
+        QSharedPointer<QString> error(new QString);
+        QFutureWatcher<QJsonObject>* watcher = new QFutureWatcher<QJsonObject>(this);
+        connect(watcher, &QFutureWatcher<QJsonObject>::finished, this, [watcher, error, reply](){
+            QJsonObject result = watcher->result();
+            watcher->deleteLater();
+            reply(error->isEmpty() ? QJsonValue(result) : QJsonValue(), *error);
+        });
+        watcher->setFuture(QtConcurrent::run([dir, params, error](){
+            return logSearch::searchJson(dir, params, error.data());
+        }));
+    });
+    _control->registerMethod("proxy.stats", [this](const QJsonObject&, QString* error) -> QJsonValue {
+        if(!_proxy)
+        {
+            *error = "stratum proxy disabled";
+            return QJsonValue();
+        }
+        return _proxy->stats();
+    });
+
+    connect(_process, &MinerProcess::emitHashRate, this, [this](QString& hashrate){
+        QJsonObject data;
+        data["hashrate"] = hashrate;
+        _control->publish("hashrate", data);
+    });
+    connect(_process, &MinerProcess::emitShare, this, [this](const QString& result){
+        QJsonObject data;
+        data["result"] = result;
+        _control->publish("share", data);
+    });
+    connect(_process, &MinerProcess::emitStarted, this, [this](){
+        QJsonObject data;
+        data["state"] = "started";
+        _control->publish("miner", data);
+    });
+    connect(_process, &MinerProcess::emitStoped, this, [this](){
+        QJsonObject data;
+        data["state"] = "stopped";
+        _control->publish("miner", data);
+    });
+    connect(_process, &MinerProcess::emitError, this, [this](){
+        QJsonObject data;
+        data["state"] = "error";
+        _control->publish("miner", data);
+    });
+    if(_proxy)
+    {
+        connect(_proxy, &stratumProxy::upstreamChanged, this, [this](const QString& pool){
+            ui->textEdit->append("Stratum proxy on " + pool);
+            QJsonObject data;
+            data["upstream"] = pool;
+            _control->publish("proxy", data);
+        });
+        connect(_proxy, &stratumProxy::shareLatency, this, [this](double ms, bool accepted){
+            QJsonObject data;
+            data["latencyMs"] = ms;
+            data["accepted"] = accepted;
+            _control->publish("proxy", data);
+        });
+    }
+}
+
 void MainWindow::on_pushButton_clicked()
 {
     saveParameters();
@@ -255,7 +891,8 @@ void MainWindow::on_pushButton_clicked()
             _process->setRestartDelay(ui->spinBoxDelay->value());
             _process->setRestartOption(ui->groupBoxWatchdog->isChecked());
             _process->setDelayBeforeNoHash(ui->spinBoxDelayNoHash->value());
-            _process->start(ui->lineEditMinerPath->text(), ui->lineEditArgs->text());
+            pointProxy();
+            _process->start(ui->lineEditMinerPath->text(), minerArgs());
         }
         else
             _process->stop();
@@ -277,15 +914,213 @@ void MainWindow::onMinerStoped()
     _isStartStoping = false;
     this->setWindowTitle(QString("Selectum"));
     _trayIcon->setToolTip(QString("Selectum"));
+    if(_restartPending)
+    {
+        _restartPending = false;
+        on_pushButton_clicked();
+    }
+}
+
+// The proxy moves the running miner to the new pool by itself,
+// without it the miner has to be restarted with the new arguments
+void MainWindow::onPoolChanged(const QString& host, quint16 port, bool ssl)
+{
+    QString pool = host + ":" + QString::number(port);
+    if(pool == ui->poolPort->text() && ssl == ui->useSSL->currentText().startsWith("use"))
+        return;
+    ui->textEdit->append("Switching to pool " + pool);
+    ui->useSSL->setCurrentIndex(ui->useSSL->findText(ssl ? "use" : "dont", Qt::MatchStartsWith));
+    ui->poolPort->setText(pool);
+    // the miner is restarted on the new pool once the benchmark is done
+    if(!_isMinerRunning || _benchmark->isRunning())
+        return;
+    if(_proxy)
+        pointProxy();
+    else
+    {
+        _process->stop();
+        _process->start(ui->lineEditMinerPath->text(), minerArgs());
+    }
+}
+
+// The currencies box of an algorithm, the blank entry first
+static QStringList currenciesFor(const QString& algo)
+{
+    if(algo == "cryptonight")
+        return {"","aeon7","bbscoin","bittube","graft","haven","lethean","masari","monero","qrl","ryo","turtlecoin","plenteum","torque","xcash"};
+    if(algo == "ethash")
+        return {"","ethereum","ethereum classic"};
+    return QStringList();
+}
+
+void MainWindow::onProfitSwitch(const QString& coinName, const QString& algo)
+{
+    int algoIndex = ui->comboBox->findText(algo);
+    if(algoIndex == -1)
+    {
+        ui->textEdit->append("Profit switch to " + coinName + " skipped: unknown algorithm " + algo);
+        _profit->setCurrent(ui->currenciesBox->currentText());
+        return;
+    }
+    if(coinName.isEmpty() || !currenciesFor(algo).contains(coinName))
+    {
+        ui->textEdit->append("Profit switch to " + coinName + " skipped: not a " + algo + " currency");
+        _profit->setCurrent(ui->currenciesBox->currentText());
+        return;
+    }
+    ui->textEdit->append("Switching to " + coinName + " (" + algo + ")");
+    ui->comboBox->setCurrentIndex(algoIndex);
+    ui->currenciesBox->setCurrentIndex(ui->currenciesBox->findText(coinName));
+    if(_isMinerRunning && !_benchmark->isRunning())
+    {
+        _process->stop();
+        // applyOC() picks the algorithm's profile once the miner is up
+        pointProxy();
+        _process->start(ui->lineEditMinerPath->text(), minerArgs());
+    }
+}
+
+// The command line selectum generates for an algorithm, empty when it has none
+static QString minerArgsFor(const QString& algo, const QString& currency, bool ssl
+                            , const QString& pool, const QString& wallet, const QString& worker, const QString& email)
+{
+    QString line;
+    if(algo=="cryptonight"){
+        line += ssl ? "-O stratum+ssl://" : "-o stratum://";
+        line += pool;
+        line += " -u ";
+        line += wallet;
+        if (!worker.isEmpty()){
+            line += ".";
+            line += worker;
+        }
+        if (!email.isEmpty()){
+            line += "/";
+            line += email;
+        }
+        line += " --currency ";
+        line += currency;
+        line += " -i 0 -p '' -r ''";
+    }
+    else if (algo=="ethash"){
+        line += ssl ? "-P stratum+ssl://" : "-P stratum://";
+        line += wallet;
+        if (!email.isEmpty()){
+            line += "@";
+            line += pool;
+            if (!worker.isEmpty()){
+                line += "/";
+                line += worker;
+            }
+            line += "/";
+            line += email;
+        }else{
+            if (!worker.isEmpty()){
+                line += ".";
+                line += worker;
+            }
+            line += "@";
+            line += pool;
+        }
+    }
+    return line;
+}
+
+// One job per algorithm, built from selectum.ini without touching the UI:
+// the current algorithm runs the saved command line, the others the one
+// the UI would generate for their [pool_<algo>]; an algorithm without one
+// is left out. The jobs go straight to the pool, the proxy stays on the
+// live miner's.
+QList<benchmarkRunner::job> MainWindow::benchmarkJobs()
+{
+    configPtr config = configStore::current();
+    QString current = ui->comboBox->currentText();
+    QList<benchmarkRunner::job> jobs;
+    for(int i = 0; i < ui->comboBox->count(); i++)
+    {
+        benchmarkRunner::job j;
+        j.algo = ui->comboBox->itemText(i);
+        if(j.algo.isEmpty())
+            continue;
+        if(j.algo == current)
+        {
+            j.path = config->minerPath;
+            j.args = config->minerArgs;
+        }
+        else
+        {
+            if(!config->algoPools.contains(j.algo))
+            {
+                ui->textEdit->append("Benchmark: no [pool_" + j.algo + "] in selectum.ini, " + j.algo + " left out");
+                continue;
+            }
+            const selectumConfig::algoPool& p = config->algoPools[j.algo];
+            if(j.algo == "cryptonight" && p.currency.isEmpty())
+            {
+                ui->textEdit->append("Benchmark: [pool_cryptonight] needs a currency, cryptonight left out");
+                continue;
+            }
+            j.path = j.algo + ".rn";
+            j.args = minerArgsFor(j.algo, p.currency, p.ssl, p.poolPort, p.wallet, p.worker, p.email);
+        }
+        if(!j.args.isEmpty())
+            jobs << j;
+    }
+    return jobs;
+}
+
+bool MainWindow::startBenchmark()
+{
+    if(_benchmark->isRunning())
+        return true;
+    _resumeAfterBenchmark = _isMinerRunning;
+    return _benchmark->start(benchmarkJobs());
+}
+
+void MainWindow::onBenchmarkFinished(bool completed)
+{
+    _benchmarkAction->setChecked(false);
+    _trayIcon->showMessage("Selectum", completed ? "Benchmark finished" : "Benchmark aborted");
+    if(_resumeAfterBenchmark && !ui->lineEditArgs->text().isEmpty())
+    {
+        pointProxy();
+        _process->start(ui->lineEditMinerPath->text(), minerArgs());
+    }
+    _resumeAfterBenchmark = false;
 }
 
 void MainWindow::onError()
 {
     _errorCount++;
+    if(_metrics)
+        _metrics->addError();
     _trayIcon->showMessage("Selectum"
                            , "An error has been detected in miner.\n" + ui->groupBoxWatchdog->isChecked() ? "Selectum restarted automaticaly" : "Check the watchdog option checkbox if you want Selectum to restart it on error");
 }
 
+void MainWindow::onRejectSpike(int gpu, double ratio)
+{
+    derateGpu(gpu, QString("rejects %1%").arg(ratio * 100, 0, 'f', 1));
+}
+
+void MainWindow::onGpuDegraded(int gpu, double rate, double baseline)
+{
+    derateGpu(gpu, QString("%1 Mh/s instead of %2 Mh/s").arg(rate, 0, 'f', 2).arg(baseline, 0, 'f', 2));
+}
+
+// Step the memory overclock of a misbehaving card down by 50 MHz
+void MainWindow::derateGpu(int gpu, const QString& reason)
+{
+    if(gpu < 0 || !_nvapi || !_nvapi->libLoaded() || gpu >= (int)_nvapi->getGPUCount())
+        return;
+    int memoffset = _nvapi->getMemOffset(gpu);
+    if(memoffset <= 0)
+        return;
+    memoffset = qMax(0, memoffset - 50);
+    _nvapi->setMemClockOffset(gpu, memoffset);
+    ui->textEdit->append(QString("GPU%1 %2, memory offset lowered to %3 MHz").arg(gpu).arg(reason).arg(memoffset));
+}
+
 const QColor MainWindow::getTempColor(unsigned int temp)
 {
     if(temp < 50)
@@ -344,15 +1179,6 @@ void MainWindow::on_spinBoxDelayNoHash_valueChanged(int arg1)
     _process->setDelayBeforeNoHash(arg1);
 }
 
-autoStart::autoStart(QObject *pParent)
-{
-}
-
-void autoStart::run()
-{
-    QThread::sleep(2);
-    emit readyToStartMiner();
-}
 
 
 
@@ -370,6 +1196,7 @@ void MainWindow::onNvMonitorInfo(unsigned int gpucount
                                  , unsigned int minpowerdraw
                                  , unsigned int totalpowerdraw)
 {
+    SELECTUM_TRACE_SCOPE("ui.nvTelemetry");
 
     ui->lcdNumberGPUCount->display((int)gpucount);
 
@@ -390,10 +1217,29 @@ void MainWindow::onNvMonitorInfo(unsigned int gpucount
 
     ui->lcdNumberTotalPowerDraw->display((double)totalpowerdraw / 1000);
 
+    if(_control)
+    {
+        QJsonObject data;
+        data["vendor"] = "nvidia";
+        data["gpuCount"] = (int)gpucount;
+        data["maxTemp"] = (int)maxgputemp;
+        data["minTemp"] = (int)mingputemp;
+        data["maxFan"] = (int)maxfanspeed;
+        data["minFan"] = (int)minfanspeed;
+        data["maxMemClock"] = (int)maxmemclock;
+        data["minMemClock"] = (int)minmemclock;
+        data["maxGpuClock"] = (int)maxgpuclock;
+        data["minGpuClock"] = (int)mingpuclock;
+        data["maxPower"] = (double)maxpowerdraw / 1000;
+        data["minPower"] = (double)minpowerdraw / 1000;
+        data["totalPower"] = (double)totalpowerdraw / 1000;
+        _control->publish("telemetry", data);
+    }
 }
 
 void MainWindow::onAMDMonitorInfo(unsigned int gpucount, unsigned int maxgputemp, unsigned int mingputemp, unsigned int maxfanspeed, unsigned int minfanspeed, unsigned int maxmemclock, unsigned int minmemclock, unsigned int maxgpuclock, unsigned int mingpuclock, unsigned int maxpowerdraw, unsigned int minpowerdraw, unsigned int totalpowerdraw)
 {
+    SELECTUM_TRACE_SCOPE("ui.amdTelemetry");
     ui->lcdNumber_AMD_GPUCount->display((int)gpucount);
 
     ui->lcdNumber_AMD_MaxTemp->display((int)maxgputemp);
@@ -412,12 +1258,83 @@ void MainWindow::onAMDMonitorInfo(unsigned int gpucount, unsigned int maxgputemp
     ui->lcdNumberMinWatt->display((double)minpowerdraw / 1000);
 
     ui->lcdNumberTotalPowerDraw->display((double)totalpowerdraw / 1000);
+
+    if(_control)
+    {
+        QJsonObject data;
+        data["vendor"] = "amd";
+        data["gpuCount"] = (int)gpucount;
+        data["maxTemp"] = (int)maxgputemp;
+        data["minTemp"] = (int)mingputemp;
+        data["maxFan"] = (int)maxfanspeed;
+        data["minFan"] = (int)minfanspeed;
+        data["maxMemClock"] = (int)maxmemclock;
+        data["minMemClock"] = (int)minmemclock;
+        data["maxGpuClock"] = (int)maxgpuclock;
+        data["minGpuClock"] = (int)mingpuclock;
+        data["maxPower"] = (double)maxpowerdraw / 1000;
+        data["minPower"] = (double)minpowerdraw / 1000;
+        data["totalPower"] = (double)totalpowerdraw / 1000;
+        _control->publish("telemetry", data);
+    }
+}
+
+nvMonitorThrd::nvMonitorThrd(QObject * /*pParent*/) : _metrics(Q_NULLPTR)
+{
+
+
 }
 
-nvMonitorThrd::nvMonitorThrd(QObject * /*pParent*/)
+static int maxOf(const QVector<int>& values)
 {
+    int max = 0;
+    foreach(int value, values)
+        max = qMax(max, value);
+    return max;
+}
 
+static int minOf(const QVector<int>& values)
+{
+    if(values.isEmpty()) return 0;
+    int min = values.first();
+    foreach(int value, values)
+        min = qMin(min, value);
+    return min;
+}
 
+static int sumOf(const QVector<int>& values)
+{
+    int sum = 0;
+    foreach(int value, values)
+        sum += value;
+    return sum;
+}
+
+// Read metric m from every GPU if the sampler says it is due, and feed the
+// measured per-GPU driver cost back into the sampler
+static bool sampleMetric(adaptiveSampler& sampler
+                         , adaptiveSampler::metric m
+                         , unsigned int gpucount
+                         , QVector<int>& values
+                         , std::function<int(unsigned int)> read)
+{
+    if(!sampler.isDue(m) && values.size() == (int)gpucount)
+        return false;
+
+    QElapsedTimer cost;
+    cost.start();
+    values.resize(gpucount);
+    for(unsigned int i = 0; i < gpucount; i++)
+        values[i] = read(i);
+    if(gpucount)
+        sampler.setMetricCost(m, cost.nsecsElapsed() / 1000 / gpucount);
+    sampler.addSamples(m, values);
+    return true;
+}
+
+static void sleepFor(adaptiveSampler& sampler)
+{
+    QThread::msleep(qMax(sampler.nextInterval(), 50u));
 }
 
 void nvMonitorThrd::run()
@@ -425,41 +1342,52 @@ void nvMonitorThrd::run()
     nvidiaNVML nvml;
     if(!nvml.initNVML()) return;
 
+    QVector<int> temps, fans, powers, clocks;
+
     while(1)
     {
-        unsigned int gpucount = nvml.getGPUCount();
-        unsigned int maxTemp = nvml.getHigherTemp();
-        unsigned int minTemp = nvml.getLowerTemp();
-        unsigned int maxfanspeed = nvml.getHigherFanSpeed();
-        unsigned int minfanspeed = nvml.getLowerFanSpeed();
-        unsigned int maxmemclock = nvml.getMemMaxClock();
-        unsigned int minmemclock = nvml.getMemLowerClock();
-        unsigned int maxgpuclock = nvml.getGPUMaxClock();
-        unsigned int mingpuclock = nvml.getGPUMinClock();
-        unsigned int maxpowerdraw = nvml.getMaxPowerDraw();
-        unsigned int minpowerdraw = nvml.getMinPowerDraw();
-        unsigned int totalpowerdraw = nvml.getPowerDrawSum();
-
-        emit gpuInfoSignal(gpucount
-                           , maxTemp
-                           , minTemp
-                           , maxfanspeed
-                           , minfanspeed
-                           , maxmemclock
-                           , minmemclock
-                           , maxgpuclock
-                           , mingpuclock
-                           , maxpowerdraw
-                           , minpowerdraw
-                           , totalpowerdraw);
-
-        QThread::sleep(5);
+        {
+            SELECTUM_TRACE_SCOPE("nvMonitor.tick");
+            unsigned int gpucount = nvml.getGPUCount();
+
+            sampleMetric(_sampler, adaptiveSampler::Temperature, gpucount, temps
+                         , [&nvml](unsigned int i){ return nvml.getGPUTemp(i); });
+            sampleMetric(_sampler, adaptiveSampler::FanSpeed, gpucount, fans
+                         , [&nvml](unsigned int i){ return nvml.getFanSpeed(i); });
+            sampleMetric(_sampler, adaptiveSampler::Power, gpucount, powers
+                         , [&nvml](unsigned int i){ return nvml.getPowerDraw(i); });
+            // graphics clocks in the first half, memory clocks in the second
+            sampleMetric(_sampler, adaptiveSampler::Clock, gpucount * 2, clocks
+                         , [&nvml, gpucount](unsigned int i){ return i < gpucount ? nvml.getGPUClock(i)
+                                                                                  : nvml.getMemClock(i - gpucount); });
+
+            QVector<int> gpuclocks = clocks.mid(0, gpucount);
+            QVector<int> memclocks = clocks.mid(gpucount);
+
+            if(_metrics)
+                _metrics->setGpuTelemetry(metricsExporter::Nvidia, temps, fans, gpuclocks, memclocks, powers);
+            emit gpuTelemetry(metricsExporter::Nvidia, temps, fans, gpuclocks, memclocks, powers);
+
+            emit gpuInfoSignal(gpucount
+                               , maxOf(temps)
+                               , minOf(temps)
+                               , maxOf(fans)
+                               , minOf(fans)
+                               , maxOf(memclocks)
+                               , minOf(memclocks)
+                               , maxOf(gpuclocks)
+                               , minOf(gpuclocks)
+                               , maxOf(powers)
+                               , minOf(powers)
+                               , sumOf(powers));
+        }
+        sleepFor(_sampler);
     }
     nvml.shutDownNVML();
 }
 
 
-amdMonitorThrd::amdMonitorThrd(QObject *)
+amdMonitorThrd::amdMonitorThrd(QObject *) : _metrics(Q_NULLPTR)
 {
 
 }
@@ -469,28 +1397,40 @@ void amdMonitorThrd::run()
     _amd = new amdapi_adl();
     if(_amd && _amd->isInitialized())
     {
+        _sampler.setEnabled(adaptiveSampler::Power, false);
+        _sampler.setEnabled(adaptiveSampler::Clock, false);
+
+        QVector<int> temps, fans;
+        amdapi_adl* amd = _amd;
         while(1)
         {
-            unsigned int gpucount = _amd->getGPUCount();
-            unsigned int maxTemp =  _amd->getHigherTemp();
-            unsigned int minTemp =  _amd->getLowerTemp();
-            unsigned int maxfanspeed = _amd->getHigherFanSpeed();
-            unsigned int minfanspeed = _amd->getLowerFanSpeed();
-
-            emit gpuInfoSignal(gpucount
-                               , maxTemp
-                               , minTemp
-                               , maxfanspeed
-                               , minfanspeed
-                               , 0
-                               , 0
-                               , 0
-                               , 0
-                               , 0
-                               , 0
-                               , 0);
-
-            QThread::sleep(5);
+            {
+                SELECTUM_TRACE_SCOPE("amdMonitor.tick");
+                unsigned int gpucount = _amd->getGPUCount();
+
+                sampleMetric(_sampler, adaptiveSampler::Temperature, gpucount, temps
+                             , [amd](unsigned int i){ return amd->getGpuTemperature(i); });
+                sampleMetric(_sampler, adaptiveSampler::FanSpeed, gpucount, fans
+                             , [amd](unsigned int i){ return amd->getFanSpeed(i); });
+
+                if(_metrics)
+                    _metrics->setGpuTelemetry(metricsExporter::Amd, temps, fans, QVector<int>(), QVector<int>(), QVector<int>());
+                emit gpuTelemetry(metricsExporter::Amd, temps, fans, QVector<int>(), QVector<int>(), QVector<int>());
+
+                emit gpuInfoSignal(gpucount
+                                   , maxOf(temps)
+                                   , minOf(temps)
+                                   , maxOf(fans)
+                                   , minOf(fans)
+                                   , 0
+                                   , 0
+                                   , 0
+                                   , 0
+                                   , 0
+                                   , 0
+                                   , 0);
+            }
+            sleepFor(_sampler);
         }
     }
 
@@ -501,11 +1441,19 @@ void amdMonitorThrd::run()
 
 void MainWindow::on_pushButtonOC_clicked()
 {
-    if(_nvapi->libLoaded())
+    if(_nvapi && _nvapi->libLoaded())
     {
+        if(_nvMonitorThrd)
+            _nvMonitorThrd->setTuning(true);
         nvOCDialog* dlg = new nvOCDialog(_nvapi, _settings, this);
         dlg->exec();
         delete dlg;
+        reloadConfig();
+        if(_nvMonitorThrd)
+        {
+            _nvMonitorThrd->setTuning(false);
+            _nvMonitorThrd->boost(60 * 1000);
+        }
     }
 }
 
@@ -525,21 +1473,21 @@ void MainWindow::on_pushButtonShowHideLog_clicked(bool checked)
 
 void MainWindow::loadParameters()
 {
-    ui->lineEditMinerPath->setText(_settings->value(MINERPATH).toString());
-    ui->lineEditArgs->setText(_settings->value(MINERARGS).toString());
-    ui->groupBoxWatchdog->setChecked(_settings->value(AUTORESTART).toBool());
-    ui->spinBoxMax0MHs->setValue(_settings->value(MAX0MHS).toInt());
-    ui->spinBoxDelay->setValue(_settings->value(RESTARTDELAY).toInt());
-    ui->spinBoxDelay0MHs->setValue(_settings->value(ZEROMHSDELAY).toInt());
-    ui->checkBoxAutoStart->setChecked(_settings->value(AUTOSTART).toBool());
-    ui->spinBoxDelayNoHash->setValue(_settings->value(DELAYNOHASH).toInt());
-    _process->setShareOnly(_settings->value(DISPLAYSHAREONLY).toBool());
-    _process->setRestartOption(_settings->value(AUTORESTART).toBool());
-    ui->useSSL->setCurrentIndex(_settings->value("SSL").toInt());
-    ui->poolPort->setText(_settings->value("POOLPORT").toString());
-    ui->wallet->setText(_settings->value("WALLET").toString());
-    ui->worker->setText(_settings->value("WORKER").toString());
-    ui->email->setText(_settings->value("EMAIL").toString());
+    configPtr config = configStore::current();
+    ui->lineEditMinerPath->setText(config->minerPath);
+    ui->lineEditArgs->setText(config->minerArgs);
+    ui->groupBoxWatchdog->setChecked(config->watchdog.autoRestart);
+    ui->spinBoxMax0MHs->setValue(config->watchdog.max0mhs);
+    ui->spinBoxDelay->setValue(config->watchdog.restartDelay);
+    ui->spinBoxDelay0MHs->setValue(config->watchdog.delayBefore0mhs);
+    ui->checkBoxAutoStart->setChecked(config->autoStart);
+    ui->spinBoxDelayNoHash->setValue(config->watchdog.delayNoHash);
+    _process->setRestartOption(config->watchdog.autoRestart);
+    ui->useSSL->setCurrentIndex(config->poolSSL);
+    ui->poolPort->setText(config->poolPort);
+    ui->wallet->setText(config->wallet);
+    ui->worker->setText(config->worker);
+    ui->email->setText(config->email);
 }
 
 
@@ -558,71 +1506,55 @@ void MainWindow::saveParameters()
     _settings->setValue("WALLET", ui->wallet->text());
     _settings->setValue("WORKER", ui->worker->text());
     _settings->setValue("EMAIL", ui->email->text());
+    reloadConfig();
+}
+
+// With the proxy enabled the miner is pointed at it, see pointProxy()
+QString MainWindow::minerArgs()
+{
+    QString args = ui->lineEditArgs->text();
+    QString pool = ui->poolPort->text();
+    if(!_proxy || pool.lastIndexOf(':') == -1 || !args.contains(pool))
+        return args;
+    return stratumProxy::localArgs(args, pool, _proxy->port());
+}
+
+// Connects the proxy to the pool of the UI, only for the live miner
+void MainWindow::pointProxy()
+{
+    QString pool = ui->poolPort->text();
+    int colon = pool.lastIndexOf(':');
+    if(!_proxy || colon == -1)
+        return;
+    _proxy->setUpstream(pool.left(colon), pool.mid(colon + 1).toUShort(), ui->useSSL->currentText().startsWith("use"));
 }
 
 void MainWindow::fillMinerArgs()
 {
-    if(ui->comboBox->currentText()=="cryptonight"){
-        ui->lineEditArgs->clear();
-        QString line;
-        line += ui->useSSL->currentText().replace("use","-O stratum+ssl://").replace("dont","-o stratum://");
-        line += ui->poolPort->text();
-        line += " -u ";
-        line += ui->wallet->text();
-        if (!ui->worker->text().isEmpty()){
-            line += ".";
-            line += ui->worker->text() ;
-        }
-        if (!ui->email->text().isEmpty()){
-            line += "/";
-            line += ui->email->text() ;
-        }
-        line += " --currency ";
-        line += ui->currenciesBox->currentText();
-        line += " -i 0 -p '' -r ''";
-        ui->lineEditArgs->setText(line);
-    }
-    else if (ui->comboBox->currentText()=="ethash"){
-        ui->lineEditArgs->clear();
-        QString line;
-        line += ui->useSSL->currentText().replace("use","-P stratum+ssl://").replace("dont","-P stratum://");
-        line += ui->wallet->text();
-        if (!ui->email->text().isEmpty()){
-            line += "@";
-            line += ui->poolPort->text();
-            if (!ui->worker->text().isEmpty()){
-                line += "/";
-                line += ui->worker->text() ;
-            }
-            line += "/";
-            line += ui->email->text() ;
-        }else{
-            if (!ui->worker->text().isEmpty()){
-                line += ".";
-                line += ui->worker->text() ;
-            }
-            line += "@";
-            line += ui->poolPort->text();
-        }
+    QString line = minerArgsFor(ui->comboBox->currentText(), ui->currenciesBox->currentText(), ui->useSSL->currentText().startsWith("use")
+                                , ui->poolPort->text(), ui->wallet->text(), ui->worker->text(), ui->email->text());
+    if(!line.isEmpty())
         ui->lineEditArgs->setText(line);
-    }
 }
 
 void MainWindow::on_comboBox_currentIndexChanged(const QString &arg1)
 {
     ui->lineEditMinerPath->setText(arg1+".rn");
-    if (arg1=="cryptonight"){
-        ui->currenciesBox->clear();
-        ui->currenciesBox->addItems({"","aeon7","bbscoin","bittube","graft","haven","lethean","masari","monero","qrl","ryo","turtlecoin","plenteum","torque","xcash"});
-    }else if (arg1=="ethash") {
+    if(_prober)
+        _prober->setDialect(poolProber::dialectFor(arg1));
+    QStringList currencies = currenciesFor(arg1);
+    if(!currencies.isEmpty()){
         ui->currenciesBox->clear();
-        ui->currenciesBox->addItems({"","ethereum","ethereum сlassic"});
+        ui->currenciesBox->addItems(currencies);
     }
     fillMinerArgs();
 }
 
 void MainWindow::on_currenciesBox_currentIndexChanged(const QString &arg1)
 {
+    // a coin picked by hand starts the switcher's dwell time too
+    if(_profit)
+        _profit->setCurrent(arg1);
     fillMinerArgs();
 }
 
@@ -633,6 +1565,8 @@ void MainWindow::on_useSSL_currentIndexChanged(const QString &arg1)
 
 void MainWindow::on_poolPort_textChanged(const QString &arg1)
 {
+    if(_prober)
+        _prober->setCurrent(arg1);
     fillMinerArgs();
 }
 
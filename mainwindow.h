@@ -6,34 +6,50 @@
 #include <QSystemTrayIcon>
 #include <QThread>
 #include <QTimer>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
 #include "minerprocess.h"
 #include "highlighter.h"
 #include "nanopoolapi.h"
 #include "nvapi.h"
 #include "nvidiaapi.h"
+#include "nvidianvml.h"
 #include "amdapi_adl.h"
+#include "adaptivesampler.h"
+#include "metricsexporter.h"
+#include "controlserver.h"
+#include "stratumproxy.h"
+#include "poolprober.h"
+#include "profitswitcher.h"
+#include "benchmark.h"
+#include "selectumconfig.h"
+#include "fleetagent.h"
+#include "logsearch.h"
 
 namespace Ui {
 class MainWindow;
 }
 
-class autoStart : public QThread
-{
-    Q_OBJECT
-public:
-    autoStart(QObject* pParent = Q_NULLPTR);
-    void run();
-signals:
-    void readyToStartMiner();
-};
-
 class nvMonitorThrd : public QThread
 {
     Q_OBJECT
 public:
     nvMonitorThrd(QObject* = Q_NULLPTR);
     void run();
+    void setTuning(bool tuning){_sampler.setTuning(tuning);}
+    void boost(unsigned int msec){_sampler.boost(msec);}
+    void setMetricsExporter(metricsExporter* metrics){_metrics = metrics;}
+private:
+    adaptiveSampler _sampler;
+    metricsExporter* _metrics;
 signals:
+    void gpuTelemetry(int vendor
+                      , const QVector<int>& temps
+                      , const QVector<int>& fans
+                      , const QVector<int>& gpuClocks
+                      , const QVector<int>& memClocks
+                      , const QVector<int>& powers);
     void gpuInfoSignal(unsigned int gpucount
                        , unsigned int maxgputemp
                        , unsigned int mingputemp
@@ -55,7 +71,16 @@ class amdMonitorThrd : public QThread
 public:
     amdMonitorThrd(QObject* = Q_NULLPTR);
     void run();
+    void setTuning(bool tuning){_sampler.setTuning(tuning);}
+    void boost(unsigned int msec){_sampler.boost(msec);}
+    void setMetricsExporter(metricsExporter* metrics){_metrics = metrics;}
 signals:
+    void gpuTelemetry(int vendor
+                      , const QVector<int>& temps
+                      , const QVector<int>& fans
+                      , const QVector<int>& gpuClocks
+                      , const QVector<int>& memClocks
+                      , const QVector<int>& powers);
     void gpuInfoSignal(unsigned int gpucount
                        , unsigned int maxgputemp
                        , unsigned int mingputemp
@@ -70,6 +95,8 @@ signals:
                        , unsigned int totalpowerdraw);
 private:
     amdapi_adl* _amd;
+    adaptiveSampler _sampler;
+    metricsExporter* _metrics;
 };
 
 class MainWindow : public QMainWindow
@@ -93,11 +120,23 @@ private:
     void createTrayIcon();
     void setupEditor();
     void setupToolTips();
+    void setupControlApi();
     void loadParameters();
     void saveParameters();
+    QString minerArgs();
+    void pointProxy();
+    QList<benchmarkRunner::job> benchmarkJobs();
+    bool startBenchmark();
     nvidiaAPI* _nvapi;
     void applyOC();
+    void reloadConfig();
+    void hotReload();
+    void startupMark(const QString& step);
+    void onStartupStep();
 private slots:
+    void onNvapiLoaded();
+    void onNvmlProbed();
+    void onAdlProbed();
     void on_pushButton_clicked();
     void on_spinBoxMax0MHs_valueChanged(int arg1);
     void on_spinBoxDelay_valueChanged(int arg1);
@@ -147,6 +186,12 @@ private:
     void onMinerStarted();
     void onMinerStoped();
     void onError();
+    void onPoolChanged(const QString& host, quint16 port, bool ssl);
+    void onProfitSwitch(const QString& coinName, const QString& algo);
+    void onBenchmarkFinished(bool completed);
+    void onRejectSpike(int gpu, double ratio);
+    void onGpuDegraded(int gpu, double rate, double baseline);
+    void derateGpu(int gpu, const QString& reason);
     const QColor getTempColor(unsigned int temp);
     Ui::MainWindow *ui;
     MinerProcess* _process;
@@ -154,14 +199,36 @@ private:
     QIcon*       _icon;
     bool _isMinerRunning;
     bool _isStartStoping;
+    bool _restartPending;       // miner.restart: start again once stopped
     unsigned int _errorCount;
     QSystemTrayIcon* _trayIcon;
     QMenu* _trayIconMenu;
     QAction* _restoreAction;
     QAction* _quitAction;
+    QAction* _benchmarkAction;
+#ifdef SELECTUM_TRACING
+    QAction* _traceAction;
+#endif
     Highlighter* _highlighter;
-    autoStart* _starter;
     nvMonitorThrd* _nvMonitorThrd;
     amdMonitorThrd* _amdMonitorThrd;
+    nvmlEventWaiter* _nvEvents;
+    metricsExporter* _metrics;
+    controlServer* _control;
+    stratumProxy* _proxy;
+    poolProber* _prober;
+    profitSwitcher* _profit;
+    benchmarkRunner* _benchmark;
+    bool _resumeAfterBenchmark;
+    QFileSystemWatcher* _configWatcher;
+    QTimer* _configReload;
+    fleetAgent* _fleet;
+    logArchive* _archive;
+    QFutureWatcher<nvidiaAPI*>* _nvapiWatcher;
+    QFutureWatcher<bool>* _nvmlWatcher;
+    QFutureWatcher<bool>* _adlWatcher;
+    QElapsedTimer _startupClock;
+    QStringList _startupTimeline;
+    int _startupPending;
 };
 #endif
@@ -0,0 +1,306 @@
+#include "metricsexporter.h"
+#include "drivercallstats.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QDebug>
+#include <cstdarg>
+#include <cstring>
+
+static const char* VENDOR_NAMES[metricsExporter::VendorCount] = {"nvidia", "amd"};
+
+metricsExporter::metricsExporter(quint16 port, QObject* pParent) : QObject(pParent)
+                                                                  , _port(port)
+                                                                  , _server(Q_NULLPTR)
+{
+    memset(&_snapshot, 0, sizeof(_snapshot));
+    _page.reserve(32 * 1024);
+}
+
+metricsExporter::~metricsExporter()
+{
+    shutdown();
+}
+
+void metricsExporter::start()
+{
+    moveToThread(&_thread);
+    _thread.start();
+    QMetaObject::invokeMethod(this, "onListen", Qt::QueuedConnection);
+}
+
+void metricsExporter::shutdown()
+{
+    if(_thread.isRunning())
+    {
+        _thread.quit();
+        _thread.wait();
+    }
+}
+
+void metricsExporter::onListen()
+{
+    _server = new QTcpServer(this);
+    connect(_server, &QTcpServer::newConnection, this, &metricsExporter::onNewConnection);
+    if(!_server->listen(QHostAddress::Any, _port))
+        qDebug() << "metrics exporter cannot listen on port" << _port << _server->errorString();
+}
+
+void metricsExporter::onNewConnection()
+{
+    while(_server->hasPendingConnections())
+    {
+        QTcpSocket* socket = _server->nextPendingConnection();
+        _requests.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::readyRead, this, &metricsExporter::onReadyRead);
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket](){ _requests.remove(socket); });
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void metricsExporter::onReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if(!socket)
+        return;
+    // one answer per connection, whatever comes after it is ignored
+    if(!_requests.contains(socket))
+    {
+        socket->readAll();
+        return;
+    }
+
+    QByteArray& buffer = _requests[socket];
+    buffer += socket->readAll();
+    int end = buffer.indexOf("\r\n\r\n");
+    if(end == -1)
+        end = buffer.indexOf("\n\n");
+    if(end == -1)
+    {
+        if(buffer.size() > MAX_REQUEST)
+        {
+            _requests.remove(socket);
+            socket->write("HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+            socket->disconnectFromHost();
+        }
+        return;
+    }
+    QByteArray request = buffer.left(buffer.indexOf('\n'));
+    _requests.remove(socket);
+
+    if(request.startsWith("GET /metrics"))
+    {
+        snapshot snap;
+        {
+            QMutexLocker lock(&_mutex);
+            snap = _snapshot;
+        }
+        render(snap);
+
+        socket->write("HTTP/1.1 200 OK\r\n"
+                      "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                      "Connection: close\r\n"
+                      "Content-Length: ");
+        socket->write(QByteArray::number(_page.size()));
+        socket->write("\r\n\r\n");
+        socket->write(_page);
+    }
+    else
+    {
+        socket->write("HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    }
+    socket->disconnectFromHost();
+}
+
+void metricsExporter::appendLine(const char* format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int len = qvsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if(len > 0)
+        _page.append(line, qMin(len, (int)sizeof(line) - 1));
+}
+
+void metricsExporter::render(const snapshot& snap)
+{
+    // resize keeps the reserved capacity, so steady-state scrapes don't allocate
+    _page.resize(0);
+
+    struct gpuFamily
+    {
+        const char* name;
+        const char* help;
+        int gpuSample::*field;
+    };
+    static const gpuFamily families[] =
+    {
+        {"selectum_gpu_temperature_celsius", "GPU core temperature", &gpuSample::temp},
+        {"selectum_gpu_fan_speed_percent", "GPU fan speed", &gpuSample::fan},
+        {"selectum_gpu_clock_mhz", "GPU graphics clock", &gpuSample::gpuClock},
+        {"selectum_gpu_memory_clock_mhz", "GPU memory clock", &gpuSample::memClock},
+    };
+
+    for(const gpuFamily& family : families)
+    {
+        appendLine("# TYPE %s gauge\n# HELP %s %s.\n", family.name, family.name, family.help);
+        for(int v = 0; v < VendorCount; v++)
+            for(int i = 0; i < snap.gpuCount[v]; i++)
+                appendLine("%s{vendor=\"%s\",gpu=\"%d\"} %d\n", family.name, VENDOR_NAMES[v], i, snap.gpus[v][i].*family.field);
+    }
+
+    appendLine("# TYPE selectum_gpu_power_watts gauge\n# HELP selectum_gpu_power_watts GPU board power draw.\n");
+    for(int v = 0; v < VendorCount; v++)
+        for(int i = 0; i < snap.gpuCount[v]; i++)
+            appendLine("selectum_gpu_power_watts{vendor=\"%s\",gpu=\"%d\"} %.3f\n", VENDOR_NAMES[v], i, snap.gpus[v][i].power / 1000.0);
+
+    appendLine("# TYPE selectum_miner_up gauge\nselectum_miner_up %d\n", snap.minerRunning ? 1 : 0);
+    appendLine("# TYPE selectum_hashrate_mhs gauge\n# HELP selectum_hashrate_mhs Hashrate reported by the miner.\n");
+    appendLine("selectum_hashrate_mhs %.2f\n", snap.hashrate);
+    appendLine("# TYPE selectum_gpu_hashrate_mhs gauge\n# HELP selectum_gpu_hashrate_mhs Per GPU hashrate reported by the miner.\n");
+    for(int i = 0; i < snap.hashGpuCount; i++)
+        appendLine("selectum_gpu_hashrate_mhs{gpu=\"%d\"} %.2f\n", i, snap.gpuHashrate[i]);
+    appendLine("# TYPE selectum_gpu_hashrate_baseline_mhs gauge\n");
+    for(int i = 0; i < snap.hashGpuCount; i++)
+        appendLine("selectum_gpu_hashrate_baseline_mhs{gpu=\"%d\"} %.2f\n", i, snap.gpuBaseline[i]);
+
+    appendLine("# TYPE selectum_shares counter\n# HELP selectum_shares Shares reported by the miner.\n");
+    for(int r = 0; r < shareLedger::ResultCount; r++)
+        appendLine("selectum_shares_total{result=\"%s\"} %llu\n", shareLedger::resultName((shareLedger::result)r), snap.shares[r]);
+
+    appendLine("# TYPE selectum_gpu_shares counter\n# HELP selectum_gpu_shares Shares attributed to a GPU by the miner.\n");
+    for(int i = 0; i < snap.shareGpuCount; i++)
+        for(int r = 0; r < shareLedger::ResultCount; r++)
+            appendLine("selectum_gpu_shares_total{gpu=\"%d\",result=\"%s\"} %llu\n", i, shareLedger::resultName((shareLedger::result)r), snap.gpuShares[i][r]);
+
+    appendLine("# TYPE selectum_effective_hashrate_mhs gauge\n# HELP selectum_effective_hashrate_mhs Hashrate implied by accepted share difficulty.\n");
+    appendLine("selectum_effective_hashrate_mhs %.2f\n", snap.effectiveHashrate);
+    appendLine("# TYPE selectum_reject_ratio gauge\nselectum_reject_ratio %.4f\n", snap.rejectRatio);
+
+    renderDriverCalls();
+
+    appendLine("# TYPE selectum_miner_restarts counter\nselectum_miner_restarts_total %llu\n", snap.restarts);
+    appendLine("# TYPE selectum_miner_errors counter\nselectum_miner_errors_total %llu\n", snap.errors);
+    appendLine("# EOF\n");
+}
+
+// Read straight from the atomics: a scrape never blocks a monitor thread
+void metricsExporter::renderDriverCalls()
+{
+    driverCallStats& stats = driverCallStats::instance();
+    int count = stats.functionCount();
+
+    appendLine("# TYPE selectum_driver_call_seconds histogram\n# HELP selectum_driver_call_seconds Time spent in NVML, NVAPI and ADL calls.\n");
+    for(int i = 0; i < count; i++)
+    {
+        const driverCallStats::function& f = stats.at(i);
+        const char* lib = driverCallStats::apiName(f.lib);
+        // the count is the sum of the buckets read here, so the histogram stays consistent
+        quint64 cumulative = 0;
+        for(int b = 0; b < driverCallStats::BUCKET_COUNT - 1; b++)
+        {
+            cumulative += f.buckets[b].load();
+            appendLine("selectum_driver_call_seconds_bucket{api=\"%s\",function=\"%s\",le=\"%g\"} %llu\n"
+                       , lib, f.name, driverCallStats::BUCKET_BOUNDS[b] / 1e6, cumulative);
+        }
+        cumulative += f.buckets[driverCallStats::BUCKET_COUNT - 1].load();
+        appendLine("selectum_driver_call_seconds_bucket{api=\"%s\",function=\"%s\",le=\"+Inf\"} %llu\n", lib, f.name, cumulative);
+        appendLine("selectum_driver_call_seconds_sum{api=\"%s\",function=\"%s\"} %.6f\n", lib, f.name, f.totalNs.load() / 1e9);
+        appendLine("selectum_driver_call_seconds_count{api=\"%s\",function=\"%s\"} %llu\n", lib, f.name, cumulative);
+    }
+
+    appendLine("# TYPE selectum_driver_call_errors counter\n# HELP selectum_driver_call_errors Driver calls that did not succeed, by returned code.\n");
+    for(int i = 0; i < count; i++)
+    {
+        const driverCallStats::function& f = stats.at(i);
+        const char* lib = driverCallStats::apiName(f.lib);
+        for(int c = 0; c < driverCallStats::MAX_CODES; c++)
+        {
+            int code = f.codes[c].load();
+            if(code)
+                appendLine("selectum_driver_call_errors_total{api=\"%s\",function=\"%s\",code=\"%d\"} %llu\n"
+                           , lib, f.name, code, f.codeCounts[c].load());
+        }
+        if(f.otherCodes.load())
+            appendLine("selectum_driver_call_errors_total{api=\"%s\",function=\"%s\",code=\"other\"} %llu\n"
+                       , lib, f.name, f.otherCodes.load());
+    }
+}
+
+void metricsExporter::setGpuTelemetry(vendor v
+                                      , const QVector<int>& temps
+                                      , const QVector<int>& fans
+                                      , const QVector<int>& gpuClocks
+                                      , const QVector<int>& memClocks
+                                      , const QVector<int>& powers)
+{
+    QMutexLocker lock(&_mutex);
+    int count = qMin(temps.size(), (int)MAX_GPUS);
+    _snapshot.gpuCount[v] = count;
+    for(int i = 0; i < count; i++)
+    {
+        gpuSample& gpu = _snapshot.gpus[v][i];
+        gpu.temp = temps.at(i);
+        gpu.fan = i < fans.size() ? fans.at(i) : 0;
+        gpu.gpuClock = i < gpuClocks.size() ? gpuClocks.at(i) : 0;
+        gpu.memClock = i < memClocks.size() ? memClocks.at(i) : 0;
+        gpu.power = i < powers.size() ? powers.at(i) : 0;
+    }
+}
+
+void metricsExporter::setMinerRunning(bool running)
+{
+    QMutexLocker lock(&_mutex);
+    _snapshot.minerRunning = running;
+}
+
+void metricsExporter::setHashrate(double mhs)
+{
+    QMutexLocker lock(&_mutex);
+    _snapshot.hashrate = mhs;
+}
+
+void metricsExporter::setGpuHashrate(int gpu, double mhs, double baseline)
+{
+    if(gpu < 0 || gpu >= MAX_GPUS)
+        return;
+    QMutexLocker lock(&_mutex);
+    _snapshot.gpuHashrate[gpu] = mhs;
+    _snapshot.gpuBaseline[gpu] = baseline;
+    _snapshot.hashGpuCount = qMax(_snapshot.hashGpuCount, gpu + 1);
+}
+
+void metricsExporter::setShares(shareLedger& ledger)
+{
+    double effective = ledger.effectiveHashrate() / 1e6;
+    double ratio = ledger.rejectRatio();
+    QList<int> gpus = ledger.gpus();
+
+    QMutexLocker lock(&_mutex);
+    for(int r = 0; r < shareLedger::ResultCount; r++)
+        _snapshot.shares[r] = ledger.total().count[r];
+    _snapshot.effectiveHashrate = effective;
+    _snapshot.rejectRatio = ratio;
+    // GPU ids are the miner's own numbering
+    foreach(int gpu, gpus)
+    {
+        if(gpu < 0 || gpu >= MAX_GPUS)
+            continue;
+        shareLedger::counters counters = ledger.gpuTotal(gpu);
+        for(int r = 0; r < shareLedger::ResultCount; r++)
+            _snapshot.gpuShares[gpu][r] = counters.count[r];
+        _snapshot.shareGpuCount = qMax(_snapshot.shareGpuCount, gpu + 1);
+    }
+}
+
+void metricsExporter::addRestart()
+{
+    QMutexLocker lock(&_mutex);
+    _snapshot.restarts++;
+}
+
+void metricsExporter::addError()
+{
+    QMutexLocker lock(&_mutex);
+    _snapshot.errors++;
+}
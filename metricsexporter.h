@@ -0,0 +1,97 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+#include <QMap>
+#include <QByteArray>
+#include "shareledger.h"
+
+class QTcpServer;
+class QTcpSocket;
+
+// Serves /metrics in OpenMetrics text format from its own thread.
+// Producers (monitor threads, miner process) only copy numbers under a
+// mutex; the page is rendered on scrape into a buffer that is reused.
+class metricsExporter : public QObject
+{
+    Q_OBJECT
+public:
+    enum vendor
+    {
+        Nvidia = 0,
+        Amd,
+        VendorCount
+    };
+    static const int MAX_GPUS = 32;
+    static const int MAX_REQUEST = 8192;    // request line and headers
+
+    metricsExporter(quint16 port, QObject* pParent = Q_NULLPTR);
+    ~metricsExporter();
+
+    void start();
+    void shutdown();
+
+    void setGpuTelemetry(vendor v
+                         , const QVector<int>& temps
+                         , const QVector<int>& fans
+                         , const QVector<int>& gpuClocks
+                         , const QVector<int>& memClocks
+                         , const QVector<int>& powers);
+    void setMinerRunning(bool running);
+    void setHashrate(double mhs);
+    void setGpuHashrate(int gpu, double mhs, double baseline);
+    void setShares(shareLedger& ledger);
+    void addRestart();
+    void addError();
+
+private slots:
+    void onListen();
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    struct gpuSample
+    {
+        int temp;
+        int fan;
+        int gpuClock;
+        int memClock;
+        int power;
+    };
+
+    struct snapshot
+    {
+        int gpuCount[VendorCount];
+        gpuSample gpus[VendorCount][MAX_GPUS];
+        bool minerRunning;
+        double hashrate;
+        double gpuHashrate[MAX_GPUS];
+        double gpuBaseline[MAX_GPUS];
+        int hashGpuCount;
+        quint64 shares[shareLedger::ResultCount];
+        quint64 gpuShares[MAX_GPUS][shareLedger::ResultCount];
+        int shareGpuCount;
+        double effectiveHashrate;
+        double rejectRatio;
+        quint64 restarts;
+        quint64 errors;
+    };
+
+    void render(const snapshot& snap);
+    void renderDriverCalls();
+    void appendLine(const char* format, ...);
+
+    quint16 _port;
+    QThread _thread;
+    QTcpServer* _server;
+    QMutex _mutex;
+    snapshot _snapshot;
+    QByteArray _page;
+    // request read so far, until its headers end; answered sockets are gone
+    QMap<QTcpSocket*, QByteArray> _requests;
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,287 @@
+#include "minerio.h"
+#include "logarchive.h"
+#include <QDateTime>
+#include <QTimer>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+std::atomic<quint32> minerIO::_nextRun(0);
+
+minerIO::minerIO(QObject* pParent) : QObject(pParent)
+                                   , _process(Q_NULLPTR)
+                                   , _phaseTimer(Q_NULLPTR)
+                                   , _phase(Idle)
+                                   , _killAt(-1)
+                                   , _graceMs(5000)
+                                   , _pendingRun(0)
+                                   , _pendingLow(false)
+                                   , _archive(Q_NULLPTR)
+                                   , _archiving(false)
+                                   , _run(0)
+{
+    qRegisterMetaType<QProcess::ExitStatus>("QProcess::ExitStatus");
+}
+
+minerIO::~minerIO()
+{
+    shutdown();
+    qDeleteAll(_consumers);
+}
+
+int minerIO::addConsumer()
+{
+    _consumers << new consumer();
+    return _consumers.size() - 1;
+}
+
+bool minerIO::take(int index, minerLine* line)
+{
+    consumer* c = _consumers.at(index);
+    // cleared before draining: a line pushed from now on signals again
+    c->pending.store(false);
+    return c->queue.pop(line);
+}
+
+void minerIO::setArchive(logArchive* archive)
+{
+    // push() raises _archiving before it loads _archive: seeing it down
+    // after the store means any later push() loads the new archive
+    _archive.store(archive);
+    while(_archiving.load())
+        QThread::yieldCurrentThread();
+}
+
+void minerIO::startThread()
+{
+    moveToThread(&_thread);
+    _thread.start(QThread::HighPriority);
+    QMetaObject::invokeMethod(this, "onInit", Qt::QueuedConnection);
+}
+
+void minerIO::shutdown()
+{
+    if(_thread.isRunning())
+    {
+        // the process belongs to the I/O thread, it goes away there
+        QMetaObject::invokeMethod(this, "onClose", Qt::BlockingQueuedConnection);
+        _thread.quit();
+        _thread.wait();
+    }
+}
+
+quint32 minerIO::start(const QString& path, const QStringList& args, bool lowPriority)
+{
+    quint32 run = ++_nextRun;
+    QMetaObject::invokeMethod(this, "onStart", Qt::QueuedConnection
+                              , Q_ARG(QString, path), Q_ARG(QStringList, args), Q_ARG(quint32, run), Q_ARG(bool, lowPriority));
+    return run;
+}
+
+void minerIO::setNormalPriority()
+{
+    QMetaObject::invokeMethod(this, "onNormalPriority", Qt::QueuedConnection);
+}
+
+void minerIO::stop()
+{
+    QMetaObject::invokeMethod(this, "onStop", Qt::QueuedConnection);
+}
+
+void minerIO::onInit()
+{
+    _process = new QProcess(this);
+    connect(_process, &QProcess::readyReadStandardOutput, this, &minerIO::onStdout);
+    connect(_process, &QProcess::readyReadStandardError, this, &minerIO::onStderr);
+    connect(_process, &QProcess::started, this, &minerIO::onStarted);
+    connect(_process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
+            this, &minerIO::onFinished);
+    _phaseTimer = new QTimer(this);
+    _phaseTimer->setSingleShot(true);
+    connect(_phaseTimer, &QTimer::timeout, this, &minerIO::onPhaseTimeout);
+}
+
+void minerIO::onStart(const QString& path, const QStringList& args, quint32 run, bool lowPriority)
+{
+    // the previous miner still holds the cards: start once it is reaped
+    if(_process->state() != QProcess::NotRunning)
+    {
+        _pendingPath = path;
+        _pendingArgs = args;
+        _pendingRun = run;
+        _pendingLow = lowPriority;
+        beginStop();
+        return;
+    }
+    _run = run;
+    _phase = Running;
+    _outBuffer.clear();
+    _errBuffer.clear();
+#ifdef Q_OS_WIN
+    _process->setCreateProcessArgumentsModifier([lowPriority](QProcess::CreateProcessArguments* arguments){
+        if(lowPriority)
+            arguments->flags |= IDLE_PRIORITY_CLASS;
+    });
+#endif
+    _process->start(path, args);
+}
+
+// A niced process cannot be given its priority back without privileges,
+// outside Windows the priority is left alone
+void minerIO::onNormalPriority()
+{
+#ifdef Q_OS_WIN
+    if(_process->state() != QProcess::NotRunning)
+        SetPriorityClass(_process->pid()->hProcess, NORMAL_PRIORITY_CLASS);
+#endif
+}
+
+// An explicit stop also cancels a start waiting for the previous miner:
+// only onStart() queues a run
+void minerIO::onStop()
+{
+    _pendingRun = 0;
+    _pendingPath.clear();
+    _pendingArgs.clear();
+    beginStop();
+}
+
+// Running -> Terminating (terminate, grace period) -> Killing (kill) -> reaped in onFinished
+void minerIO::beginStop()
+{
+    if(_process->state() == QProcess::NotRunning)
+        return;
+    if(_phase == Terminating || _phase == Killing)
+        return;
+    _phase = Terminating;
+    _killAt = -1;
+    _stopClock.start();
+    _process->terminate();
+    _phaseTimer->start(_graceMs.load());
+}
+
+void minerIO::onPhaseTimeout()
+{
+    if(_phase == Terminating)
+    {
+        _phase = Killing;
+        _killAt = _stopClock.elapsed();
+        _process->kill();
+        _phaseTimer->start(REAP_WARNING_MSEC);
+    }
+    else if(_phase == Killing)
+    {
+        // killed but not gone: the driver is still tearing down the contexts
+        emit stopStalled(_run, _stopClock.elapsed());
+        _phaseTimer->start(REAP_WARNING_MSEC);
+    }
+}
+
+void minerIO::stopAndWait()
+{
+    _phaseTimer->stop();
+    _pendingRun = 0;
+    if(_process->state() == QProcess::NotRunning)
+        return;
+    if(_phase != Killing)
+    {
+        _process->terminate();
+        if(_process->waitForFinished(_graceMs.load()))
+            return;
+    }
+    _process->kill();
+    _process->waitForFinished();
+}
+
+void minerIO::onClose()
+{
+    stopAndWait();
+    delete _process;
+    _process = Q_NULLPTR;
+}
+
+void minerIO::onStdout()
+{
+    _outBuffer += _process->readAllStandardOutput();
+    split(_outBuffer, false);
+}
+
+void minerIO::onStderr()
+{
+    _errBuffer += _process->readAllStandardError();
+    split(_errBuffer, true);
+}
+
+void minerIO::split(QByteArray& buffer, bool stdErr)
+{
+    minerLine line;
+    line.time = QDateTime::currentMSecsSinceEpoch();
+    line.run = _run;
+    line.stdErr = stdErr;
+    int start = 0;
+    int end;
+    while((end = buffer.indexOf('\n', start)) != -1)
+    {
+        int length = end - start;
+        if(length > 0 && buffer.at(end - 1) == '\r')
+            length--;
+        if(length > 0)
+        {
+            line.text = QString::fromUtf8(buffer.constData() + start, length);
+            push(line);
+        }
+        start = end + 1;
+    }
+    buffer.remove(0, start);
+}
+
+void minerIO::push(const minerLine& line)
+{
+    _archiving.store(true);
+    logArchive* archive = _archive.load();
+    if(archive && line.text.length() > 1)
+        archive->append(line.text);
+    _archiving.store(false);
+    for(int i = 0; i < _consumers.size(); i++)
+    {
+        consumer* c = _consumers.at(i);
+        if(!c->queue.push(line))
+        {
+            c->dropped++;
+            continue;
+        }
+        if(!c->pending.exchange(true))
+            emit linesReady(i);
+    }
+}
+
+void minerIO::onStarted()
+{
+    emit started(_run);
+}
+
+void minerIO::onFinished(int exitCode, QProcess::ExitStatus status)
+{
+    // whatever the miner printed last without a newline
+    _outBuffer += '\n';
+    split(_outBuffer, false);
+    _errBuffer += '\n';
+    split(_errBuffer, true);
+
+    if(_phase == Terminating || _phase == Killing)
+    {
+        _phaseTimer->stop();
+        qint64 total = _stopClock.elapsed();
+        qint64 terminate = _killAt == -1 ? total : _killAt;
+        emit stopped(_run, terminate, total - terminate, _killAt != -1);
+    }
+    _phase = Idle;
+    emit finished(_run, exitCode, status);
+
+    if(_pendingRun)
+    {
+        quint32 run = _pendingRun;
+        _pendingRun = 0;
+        onStart(_pendingPath, _pendingArgs, run, _pendingLow);
+    }
+}
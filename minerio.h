@@ -0,0 +1,125 @@
+#ifndef MINERIO_H
+#define MINERIO_H
+
+#include <QObject>
+#include <QThread>
+#include <QProcess>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QVector>
+#include <atomic>
+#include "spscqueue.h"
+
+class logArchive;
+class QTimer;
+
+struct minerLine
+{
+    qint64 time;
+    quint32 run;        // start() that produced it: lines of a killed miner can be told apart
+    bool stdErr;
+    QString text;
+};
+
+// Owns the miner QProcess on its own thread, so the pipes are always drained
+// whatever the GUI is doing (a modal dialog, a resize). Complete lines go
+// to one lock-free queue per consumer; a consumer that falls behind loses
+// lines (counted) instead of stalling the miner on a full pipe.
+class minerIO : public QObject
+{
+    Q_OBJECT
+public:
+    static const int QUEUE_SIZE = 16384;
+    static const int REAP_WARNING_MSEC = 10000;
+    typedef spscQueue<minerLine> lineQueue;
+
+    minerIO(QObject* pParent = Q_NULLPTR);
+    ~minerIO();
+
+    // Consumers are added before startThread(); linesReady(consumer) is
+    // emitted once for the lines pushed since the consumer last called take()
+    int addConsumer();
+    bool take(int consumer, minerLine* line);
+    quint64 dropped(int consumer) const {return _consumers.at(consumer)->dropped.load();}
+    // The archive has its own queue, fed from the I/O thread. Returns once
+    // the previous archive is no longer appended to, so an archive moved
+    // from one instance to another never has two producers.
+    void setArchive(logArchive* archive);
+
+    void startThread();
+    void shutdown();
+
+    // Any thread, none of them blocks. start() returns the run id of the
+    // new process, which starts once the previous one is reaped. Run ids
+    // are unique across instances. A low priority process only gets the
+    // CPU time nobody else wants (Windows only).
+    quint32 start(const QString& path, const QStringList& args, bool lowPriority = false);
+    void setNormalPriority();
+    // terminate, kill after the grace period; stopped() tells how it went
+    void stop();
+    void setGracePeriod(int msec){_graceMs = msec;}
+
+signals:
+    void linesReady(int consumer);
+    void started(quint32 run);
+    void finished(quint32 run, int exitCode, QProcess::ExitStatus status);
+    // phase durations of a stop, killed when terminate was not enough
+    void stopped(quint32 run, qint64 terminateMs, qint64 killMs, bool killed);
+    void stopStalled(quint32 run, qint64 elapsedMs);
+
+private slots:
+    void onInit();
+    void onStart(const QString& path, const QStringList& args, quint32 run, bool lowPriority);
+    void onNormalPriority();
+    void onStop();
+    void onPhaseTimeout();
+    void onClose();
+    void onStdout();
+    void onStderr();
+    void onStarted();
+    void onFinished(int exitCode, QProcess::ExitStatus status);
+
+private:
+    struct consumer
+    {
+        consumer() : queue(QUEUE_SIZE), pending(false), dropped(0) {}
+        lineQueue queue;
+        std::atomic<bool> pending;
+        std::atomic<quint64> dropped;
+    };
+
+    enum stopPhase
+    {
+        Idle = 0,
+        Running,
+        Terminating,
+        Killing
+    };
+
+    void beginStop();
+    // only when the I/O thread goes away
+    void stopAndWait();
+    void split(QByteArray& buffer, bool stdErr);
+    void push(const minerLine& line);
+
+    QThread _thread;
+    QProcess* _process;
+    QTimer* _phaseTimer;
+    stopPhase _phase;
+    QElapsedTimer _stopClock;
+    qint64 _killAt;
+    std::atomic<int> _graceMs;
+    QString _pendingPath;
+    QStringList _pendingArgs;
+    quint32 _pendingRun;
+    bool _pendingLow;
+    QVector<consumer*> _consumers;
+    std::atomic<logArchive*> _archive;
+    std::atomic<bool> _archiving;       // push() is appending to _archive
+    static std::atomic<quint32> _nextRun;
+    quint32 _run;
+    QByteArray _outBuffer;
+    QByteArray _errBuffer;
+};
+
+#endif // MINERIO_H
@@ -1,4 +1,5 @@
 #include "minerprocess.h"
+#include "tracer.h"
 #include <QTextStream>
 #include <QDebug>
 #include <QRegExp>
@@ -6,6 +7,7 @@
 #include <QDateTime>
 #include <QThread>
 #include <QFile>
+#include <utility>
 
 anyMHsWaitter::anyMHsWaitter(unsigned int delay, QObject *pParent) : QThread(pParent)
                                                                      , _pParent((MinerProcess*)pParent)
@@ -41,7 +43,7 @@ void zeroMHsWaitter::run()
     QThread::sleep(_delay);
 }
 
-MinerProcess::MinerProcess(QSettings* settings):
+MinerProcess::MinerProcess():
                                                   _isRunning(false),
                                                   _0mhs(5),
                                                   _restartDelay(2),
@@ -54,23 +56,40 @@ MinerProcess::MinerProcess(QSettings* settings):
                                                   , _ledActivated(false)
                                                   , _ledHash(50)
                                                   , _ledShare(100)
-                                                  , _acceptedShare(0)
-                                                  , _staleShare(0)
+                                                  , _maxRejectRatio(0)
+                                                  , _gpuTotal(0)
+                                                  , _metrics(Q_NULLPTR)
+                                                  , _highlighter(Q_NULLPTR)
+                                                  , _run(0)
+                                                  , _reportedDrops(0)
+                                                  , _archive(Q_NULLPTR)
+                                                  , _standbyEnabled(false)
+                                                  , _standbyDelay(120)
+                                                  , _standbyRun(0)
+                                                  , _restoreRun(0)
+                                                  , _standbyBaseline(0)
+                                                  , _standbyCost(-1)
+                                                  , _rateSum(0)
+                                                  , _rateSamples(0)
+                                                  , _takingOver(false)
+                                                  , _lastTakeover(-1)
+                                                  , _takeovers(0)
                                                   , _shareNumber("")
-                                                  , _settings(settings)
 #ifdef DONATE
                                                   , _donate(Q_NULLPTR)
 #endif
 {
-    connect(&_miner, &QProcess::readyReadStandardOutput,
-            this, &MinerProcess::onReadyToReadStdout);
-    connect(&_miner, &QProcess::readyReadStandardError,
-            this, &MinerProcess::onReadyToReadStderr);
-    connect(&_miner, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished),
-            this, &MinerProcess::onExit);
-    connect (&_miner, &QProcess::started,
-            this, &MinerProcess::onStarted);
-    _miner.setReadChannel(QProcess::StandardOutput);
+    _io = new minerIO();
+    _standby = new minerIO();
+    connectIO(_io);
+    connectIO(_standby);
+    _standbyTimer = new QTimer(this);
+    _standbyTimer->setSingleShot(true);
+    connect(_standbyTimer, &QTimer::timeout, this, &MinerProcess::startStandby);
+    _costTimer = new QTimer(this);
+    _costTimer->setSingleShot(true);
+    _costTimer->setInterval(STANDBY_MEASURE_MSEC);
+    connect(_costTimer, &QTimer::timeout, this, &MinerProcess::onStandbyMeasured);
     _anyHR = new anyMHsWaitter(_delayBeforeNoHash, this);
     connect(_anyHR, SIGNAL(notHashing()), this, SLOT(onNoHashing()));
     _donate = new donateThrd(this);
@@ -84,117 +103,406 @@ MinerProcess::MinerProcess(QSettings* settings):
 MinerProcess::~MinerProcess()
 {
     if(_donate && _donate->isRunning()) _donate->terminate();
+    delete _io;
+    delete _standby;
 }
 
-void MinerProcess::onReadyToReadStdout()
+// Both instances report here; what does not come from the current run of
+// the primary is dropped
+void MinerProcess::connectIO(minerIO* io)
 {
-    QTextStream stream(&_miner);
-    while (!stream.atEnd())
-    {
-        QString line = stream.readLine();
-        if(line.length() > 1 && !_shareOnly)
-            _log->append(line.trimmed());
-    }
+    _consumer = io->addConsumer();
+    connect(io, &minerIO::linesReady, this, [this, io](int){ onLinesReady(io); });
+    connect(io, &minerIO::finished, this, &MinerProcess::onExit);
+    connect(io, &minerIO::started, this, &MinerProcess::onStarted);
+    connect(io, &minerIO::stopped, this, [this, io](quint32, qint64 terminateMs, qint64 killMs, bool killed){
+        QString name = io == _io ? "miner" : "standby miner";
+        if(killed)
+            _log->append(QString("%1 killed after %2 ms, gone %3 ms later").arg(name).arg(terminateMs).arg(killMs));
+        else
+            _log->append(QString("%1 stopped in %2 ms").arg(name).arg(terminateMs));
+    });
+    connect(io, &minerIO::stopStalled, this, [this](quint32, qint64 elapsedMs){
+        _log->append(QString("miner still exiting after %1 ms").arg(elapsedMs));
+    });
+    io->startThread();
 }
 
-
-void MinerProcess::onReadyToReadStderr()
+void MinerProcess::onLinesReady(minerIO* io)
 {
-    QByteArray array = _miner.readAllStandardError();
+    SELECTUM_TRACE_SCOPE("miner.lines");
+    minerLine line;
+    while(io->take(_consumer, &line))
+    {
+        // the first hashrate of the full miner started after a takeover
+        // hands the rig back to it; its lines count from here on
+        if(io == _standby && _restoreRun && line.run == _restoreRun && line.text.indexOf(" Mh/s") != -1)
+            restorePrimary();
+        // what a killed miner printed last is not about the one running now,
+        // nor is what the standby prints while it waits
+        if(io != _io || line.run != _run)
+            continue;
+        if(line.stdErr)
+            onStderrLine(line.text);
+        else
+            onStdoutLine(line.text);
+    }
+    if(_metrics)
+        _metrics->setShares(_ledger);
 
-    QString line(array);
+    if(io != _io)
+        return;
+    quint64 dropped = _io->dropped(_consumer);
+    if(dropped != _reportedDrops)
+    {
+        appendLog(QString("%1 miner lines dropped, the window was busy").arg(dropped - _reportedDrops), Highlighter::Error);
+        _reportedDrops = dropped;
+    }
+}
 
-    _outHelper += line;
+void MinerProcess::onStdoutLine(const QString& line)
+{
+    if(line.length() > 1 && !_shareOnly)
+        appendLog(line.trimmed(), line.indexOf(" Mh/s") != -1 ? Highlighter::Hashrate : Highlighter::Plain);
+}
 
-    if(line.indexOf("\r\n") == -1)
+void MinerProcess::onStderrLine(const QString& line)
+{
+    SELECTUM_TRACE_SCOPE("miner.stderrLine");
+    if(line.length() <= 1)
         return;
 
-    line = _outHelper;
-
-    if(line.length() > 1)
+    int mhsPos = line.indexOf(" Mh/s") == -1 ? -1 : line.indexOf(QRegExp("[0-9]{1,5}.[0-9]{1,2} Mh/s"));
+    if(mhsPos != -1)
     {
-        _outHelper.clear();
+        int endPos = line.indexOf("  ", mhsPos);
+        QString hashRate = line.mid(mhsPos, endPos - mhsPos);
 
-        int mhsPos = line.indexOf(QRegExp("[0-9]{1,5}.[0-9]{1,2} Mh/s"));
-        if(mhsPos != -1)
+        double mhs = hashRate.section(' ', 0, 0).toDouble();
+        if(_readyToMonitor)
         {
-            int endPos = line.indexOf("  ", mhsPos);
-            QString hashRate = line.mid(mhsPos, endPos - mhsPos);
+            if(mhs <= 0)
+                _0mhs++;
+            else
+                _0mhs = 0;
 
-            if(_readyToMonitor)
+            bool dropped = _detector.addHashrate(mhs);
+            bool noShares = _detector.sharesStalled();
+            if(dropped || noShares)
             {
-                if(hashRate == "0.00 Mh/s")
-                    _0mhs++;
-                else
-                    _0mhs = 0;
-
-                if(_0mhs > _max0mhs)
-                {
-                    restart();
-                }
+                _log->append(dropped ? QString("hashrate dropped to %1 Mh/s, usual %2 Mh/s").arg(mhs).arg(_detector.hashrateMean(), 0, 'f', 2)
+                                     : QString("no share for too long, usual %1 shares/min").arg(_detector.sharesPerMinute(), 0, 'f', 2));
+                _detector.rebaseline();
+                emit emitError();
+                restart();
             }
+            else if(_0mhs > _max0mhs)
+            {
+                restart();
+            }
+        }
 
-            hashRate += " ";
-            hashRate += _shareNumber;
-
-            emit emitHashRate(hashRate);
+        if(_metrics)
+            _metrics->setHashrate(mhs);
 
-            _hashrateCount++;
+        _rateSum += mhs;
+        _rateSamples++;
+        if(_takingOver && mhs > 0)
+        {
+            _takingOver = false;
+            _lastTakeover = _takeoverClock.elapsed();
+            _log->append(QString("standby miner hashing %1 ms after the primary died").arg(_lastTakeover));
         }
 
-        int miningOnPos = line.indexOf(" [A");
-        if(miningOnPos != -1)
-        {
+        hashRate += " ";
+        hashRate += _shareNumber;
+
+        emit emitHashRate(hashRate);
+
+        _hashrateCount++;
+    }
+
+    int miningOnPos = line.indexOf(" [A");
+    if(miningOnPos != -1)
+    {
+
+        miningOnPos = line.indexOf("[", miningOnPos);
+        int endPos = line.indexOf("]", miningOnPos) + 1;
+        _shareNumber = line.mid(miningOnPos, endPos - miningOnPos);
+    }
+
+    foreach(const gpuHashrateTracker::sample& sample, _gpuRates.parseLine(line))
+    {
+        if(_metrics)
+            _metrics->setGpuHashrate(physicalGpu(sample.gpu), sample.rate, sample.baseline);
+        if(_readyToMonitor && sample.current != sample.previous)
+            onGpuStateChanged(sample);
+    }
 
-            miningOnPos = line.indexOf("[", miningOnPos);
-            int endPos = line.indexOf("]", miningOnPos) + 1;
-            _shareNumber = line.mid(miningOnPos, endPos - miningOnPos);
+    // the highlighter colors the line from what the parsers found in it
+    Highlighter::lineClass cls = Highlighter::Plain;
+    bool fatal = false;
+    shareLedger::result result;
+    int gpu;
+    if(_ledger.parseLine(line, &result, &gpu))
+    {
+        if(result != shareLedger::Rejected)
+            _detector.addShare();
+        emit emitShare(shareLedger::resultName(result));
+        if(result == shareLedger::Rejected)
+            checkRejectRatio(gpu);
+        cls = result == shareLedger::Accepted ? Highlighter::Accepted
+                                              : result == shareLedger::Rejected ? Highlighter::Rejected : Highlighter::Stale;
+    }
+    else if(_detector.classify(line) == anomalyDetector::Restart)
+    {
+        cls = Highlighter::Error;
+        fatal = true;
+    }
+    else if(mhsPos != -1)
+    {
+        cls = Highlighter::Hashrate;
+    }
+
+    if(_shareOnly)
+    {
+        if(line.indexOf("**Accepted") != -1 || line.indexOf("**Rejected") != -1)
+        {
+            appendLog(line.trimmed(), cls);
         }
+    }
+    else
+    {
+        appendLog(line.trimmed(), cls);
+    }
 
+    // only lines the rule table rates as fatal restart the miner; pool hiccups are left to the miner
+    if(fatal)
+    {
+        appendLog("fatal miner error, restarting", Highlighter::Error);
+        emit emitError();
+        restart();
+    }
+}
+
+void MinerProcess::appendLog(const QString& line, Highlighter::lineClass cls)
+{
+    SELECTUM_TRACE_SCOPE("ui.appendLog");
+    if(_highlighter)
+        _highlighter->setNextLine(cls, line);
+    _log->append(line);
+}
+
+// A single card with a bad reject ratio is usually an unstable memory OC:
+// let the owner derate it. A rig-wide spike needs a restart.
+void MinerProcess::checkRejectRatio(int gpu)
+{
+    const unsigned int minShares = 20;
+    if(_maxRejectRatio <= 0)
+        return;
+
+    if(gpu >= 0 && _ledger.windowShares(gpu) >= minShares && _ledger.rejectRatio(gpu) > _maxRejectRatio)
+    {
+        double ratio = _ledger.rejectRatio(gpu);
+        _log->append(QString("GPU%1 reject ratio %2%").arg(physicalGpu(gpu)).arg(ratio * 100, 0, 'f', 1));
+        _ledger.resetWindow(gpu);
+        emit emitRejectSpike(physicalGpu(gpu), ratio);
+        return;
+    }
+
+    if(_ledger.windowShares() >= minShares && _ledger.rejectRatio() > _maxRejectRatio)
+    {
+        double ratio = _ledger.rejectRatio();
+        _log->append(QString("reject ratio %1%, restarting").arg(ratio * 100, 0, 'f', 1));
+        _ledger.resetWindow();
+        emit emitRejectSpike(-1, ratio);
+        emit emitError();
+        restart();
+    }
+}
 
-        QStringList list = line.split(QRegExp("\r\n"), QString::SkipEmptyParts);
-        for(int i = 0; i < list.size(); i++)
+// The miner numbers the cards it was given from 0, reports are made with
+// the physical index
+void MinerProcess::onGpuStateChanged(const gpuHashrateTracker::sample& sample)
+{
+    int gpu = physicalGpu(sample.gpu);
+    switch(sample.current)
+    {
+    case gpuHashrateTracker::Degraded:
+        _log->append(QString("GPU%1 at %2 Mh/s, baseline %3 Mh/s")
+                     .arg(gpu).arg(sample.rate, 0, 'f', 2).arg(sample.baseline, 0, 'f', 2));
+        emit emitGpuDegraded(gpu, sample.rate, sample.baseline);
+        break;
+    case gpuHashrateTracker::Stalled:
+        _log->append(QString("GPU%1 stopped hashing").arg(gpu));
+        if(_devices.isEmpty())
+            _gpuTotal = qMax(_gpuTotal, _gpuRates.gpuCount());
+        if(gpu >= _gpuStalls.size())
+            _gpuStalls.resize(gpu + 1);
+        // a card that keeps stalling is left out of the next starts, if the miner
+        // supports it, as long as another card is left to mine
+        if(++_gpuStalls[gpu] >= 2 && !_isolateArgs.isEmpty() && !_isolated.contains(gpu))
         {
-            if(_shareOnly)
+            if(_isolated.size() + 1 < _gpuTotal)
             {
-                if(list.at(i).indexOf("**Accepted") != -1 || list.at(i).indexOf("**Rejected") != -1)
-                {
-                    _log->append(list.at(i).trimmed());
-                }
+                _isolated << gpu;
+                _log->append(QString("GPU%1 isolated").arg(gpu));
             }
             else
-            {
-                _log->append(list.at(i).trimmed());
-            }
+                _log->append(QString("GPU%1 not isolated, it is the last card mining").arg(gpu));
         }
+        emit emitError();
+        restart();
+        break;
+    default:
+        break;
+    }
+}
 
-
-        if(line.indexOf("error") != -1 || line.indexOf("Error") != -1)
-        {
-            emit emitError();
-            restart();
-            return;
-        }
+void MinerProcess::onExit(quint32 run)
+{
+    if(run == _standbyRun)
+    {
+        _standbyRun = 0;
+        _costTimer->stop();
+        _log->append("standby miner exit");
+        if(_isRunning && _standbyEnabled)
+            _standbyTimer->start(_standbyDelay * 1000);
     }
+    else if(run == _restoreRun)
+    {
+        _restoreRun = 0;
+        _log->append("full miner exit, still mining with the standby arguments until the next restart");
+    }
+    else if(run == _run)
+    {
+        if(_standbyRun)
+            promoteStandby();
+        else if(_restoreRun)
+            restorePrimary();
+        else
+            exited();
+    }
+}
+
+// The primary died on its own: the standby is already initialised and
+// becomes the primary, the dead instance will host the next standby
+void MinerProcess::promoteStandby()
+{
+    std::swap(_io, _standby);
+    _run = _standbyRun;
+    _standbyRun = 0;
+    _costTimer->stop();
+    _io->setNormalPriority();
+    // the old producer is detached first, see minerIO::setArchive
+    _standby->setArchive(Q_NULLPTR);
+    _io->setArchive(_archive);
+    _reportedDrops = _io->dropped(_consumer);
+    _takeovers++;
+    _takingOver = true;
+    _takeoverClock.start();
+    _0mhs = 0;
+    _detector.rebaseline();
+    if(_metrics)
+        _metrics->addRestart();
+    _log->append("miner exit, the standby miner takes over with the standby arguments");
+    // the standby only runs a light job: the full one is started next to it
+    // and takes over again once it hashes, the next standby comes after that
+    _log->append("starting a full miner");
+    _restoreRun = _standby->start(_minerPath, _startArgs);
 }
 
-void MinerProcess::onExit()
+// The full miner started after a takeover hashes: it is the primary again
+void MinerProcess::restorePrimary()
 {
+    std::swap(_io, _standby);
+    _standby->stop();
+    _run = _restoreRun;
+    _restoreRun = 0;
+    // the old producer is detached first, see minerIO::setArchive
+    _standby->setArchive(Q_NULLPTR);
+    _io->setArchive(_archive);
+    _reportedDrops = _io->dropped(_consumer);
+    _takingOver = false;
+    _0mhs = 0;
+    _detector.rebaseline();
+    _log->append("full miner back, the standby miner is stopped");
+    if(_standbyEnabled)
+        _standbyTimer->start(_standbyDelay * 1000);
+}
+
+void MinerProcess::startStandby()
+{
+    if(!_standbyEnabled || !_isRunning || _standbyRun || _restoreRun || _standbyArgs.trimmed().isEmpty())
+        return;
+    _standbyBaseline = _rateSamples ? _rateSum / _rateSamples : 0;
+    _rateSum = 0;
+    _rateSamples = 0;
+    _standbyRun = _standby->start(_minerPath, _standbyArgs.split(" "), true);
+}
+
+// Hashrate of the primary with the standby around against the one before
+void MinerProcess::onStandbyMeasured()
+{
+    if(!_rateSamples || _standbyBaseline <= 0)
+        return;
+    _standbyCost = 1 - (_rateSum / _rateSamples) / _standbyBaseline;
+    _log->append(QString("the standby miner costs %1% of the hashrate").arg(_standbyCost * 100, 0, 'f', 1));
+}
+
+QJsonObject MinerProcess::standbyJson() const
+{
+    QJsonObject json;
+    json["enabled"] = _standbyEnabled;
+    json["running"] = _standbyRun != 0;
+    json["cost"] = _standbyCost;
+    json["takeovers"] = (int)_takeovers;
+    json["lastTakeoverMs"] = (double)_lastTakeover;
+    return json;
+}
+
+void MinerProcess::exited()
+{
+    _run = 0;
     _log->append("miner exit");
     _isRunning = false;
     _0mhs = 0;
     if(_waitter && _waitter->isRunning()) _waitter->terminate();
     if(_anyHR && _anyHR->isRunning()) _anyHR->terminate();
+    if(_metrics)
+        _metrics->setMinerRunning(false);
 
     emit emitStoped();
 }
 
-void MinerProcess::onStarted()
+void MinerProcess::onStarted(quint32 run)
 {
+    if(run == _standbyRun)
+    {
+        _log->append("standby miner start");
+        _costTimer->start();
+        return;
+    }
+    if(run == _restoreRun)
+    {
+        _log->append("full miner start");
+        return;
+    }
+    if(run != _run)
+        return;
     _log->append("miner start");
     _isRunning = true;
     _0mhs = 0;
     _shareNumber = "";
+    _ledger.resetWindow();
+    _gpuRates.reset();
+    _detector.rebaseline();
+    if(_metrics)
+        _metrics->setMinerRunning(true);
+    _rateSum = 0;
+    _rateSamples = 0;
+    if(_standbyEnabled)
+        _standbyTimer->start(_standbyDelay * 1000);
     emit emitStarted();
 }
 
@@ -209,6 +517,16 @@ void MinerProcess::onNoHashing()
     restart();
 }
 
+// A critical XID (e.g. 79, GPU has fallen off the bus) won't recover by
+// itself, so restart right away instead of waiting for the no-hash timeout
+void MinerProcess::onGpuXid(unsigned int gpu, unsigned long long xid)
+{
+    _log->append(QString("GPU%1 critical XID %2").arg((int)gpu).arg(xid));
+    if(!_isRunning)
+        return;
+    emit emitError();
+    restart();
+}
 
 void MinerProcess::onDonate()
 {
@@ -245,11 +563,30 @@ void MinerProcess::onReadyToRestart()
 
 void MinerProcess::start(const QString &path, const QString& args)
 {
+    SELECTUM_TRACE_SCOPE("miner.start");
     MINER = path;
     _minerPath = path;
     _minerArgs = args;
+    _ledger.setPool(shareLedger::poolFromArgs(args));
 
     QStringList arglist = args.split(" ");
+    QList<int> devices;
+    if(!_isolated.isEmpty())
+    {
+        QStringList ids;
+        for(int i = 0; i < _gpuTotal; i++)
+        {
+            if(_isolated.contains(i))
+                continue;
+            devices << i;
+            ids << QString::number(i);
+        }
+        arglist << _isolateArgs.arg(ids.join(" ")).split(" ");
+    }
+    // the per-GPU baselines belong to the old numbering
+    if(devices != _devices)
+        _gpuRates.clear();
+    _devices = devices;
 
     if(_delayBefore0MHs > 0)
     {
@@ -264,15 +601,26 @@ void MinerProcess::start(const QString &path, const QString& args)
         _readyToMonitor = true;
     _hashrateCount = 0;
     if(_anyHR && !_anyHR->isRunning()) _anyHR->start();
-    _miner.start(path, arglist);
+    _startArgs = arglist;
+    _run = _io->start(path, arglist);
     _isRunning = true;
 }
 
 void MinerProcess::stop()
 {
+    SELECTUM_TRACE_SCOPE("miner.stop");
     _log->append("onStop");
-    _miner.kill();
-    _miner.waitForFinished();
+    _io->stop();
+    _standby->stop();
+    _standbyRun = 0;
+    _restoreRun = 0;
+    _standbyTimer->stop();
+    _costTimer->stop();
+    _takingOver = false;
+    // the miner is gone as far as we are concerned, the late exit and
+    // lines belong to a run that is over
+    if(_run)
+        exited();
     _0mhs = 0;
     _isRunning = false;
     if(_waitter && _waitter->isRunning()) _waitter->terminate();
@@ -286,10 +634,31 @@ void MinerProcess::setLEDOptions(unsigned short hash, unsigned short share, bool
     _ledActivated = activated;
 }
 
+void MinerProcess::setConfig(const configPtr& config)
+{
+    _shareOnly = config->shareOnly;
+    _maxRejectRatio = config->watchdog.maxRejectRatio;
+    _isolateArgs = config->watchdog.isolateArgs;
+    _detector.setRules(config->errorRules);
+    _io->setGracePeriod(config->watchdog.stopGrace * 1000);
+    _standby->setGracePeriod(config->watchdog.stopGrace * 1000);
+    _standbyEnabled = config->watchdog.standby;
+    _standbyArgs = config->watchdog.standbyArgs;
+    _standbyDelay = config->watchdog.standbyDelay;
+    if(!_standbyEnabled && _standbyRun)
+    {
+        _standby->stop();
+        _standbyRun = 0;
+    }
+}
+
 void MinerProcess::restart()
 {
+    SELECTUM_TRACE_SCOPE("miner.restart");
     if(_autoRestart)
     {
+        if(_metrics)
+            _metrics->addRestart();
         stop();
         rstart->_delay = _restartDelay;
         rstart->start();
@@ -5,7 +5,18 @@
 #include <QProcess>
 #include <QTextEdit>
 #include <QThread>
-#include <QSettings>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include "metricsexporter.h"
+#include "shareledger.h"
+#include "gpuhashrate.h"
+#include "anomalydetector.h"
+#include "selectumconfig.h"
+#include "logarchive.h"
+#include "highlighter.h"
+#include "minerio.h"
 
 class MinerProcess;
 class donateThrd;
@@ -49,7 +60,7 @@ class MinerProcess : public QObject
 {
     Q_OBJECT
 public:
-    MinerProcess(QSettings* settings);
+    MinerProcess();
     ~MinerProcess();
     QString MINER;
     QString MONERO_MINER_ARGS = "";
@@ -59,6 +70,7 @@ public:
     void start(const QString& path, const QString& args);
     void stop();
     void setLogControl(QTextEdit* log){_log = log;}
+    void setHighlighter(Highlighter* highlighter){_highlighter = highlighter;}
     void setRestartDelay(unsigned int delay){ _restartDelay = delay;}
     void setRestartOption(bool restart){_autoRestart = restart;}
     void setMax0MHs(unsigned int max0mhs){_max0mhs = max0mhs;}
@@ -67,19 +79,35 @@ public:
     void setDelayBeforeNoHash(unsigned int delay){_delayBeforeNoHash = delay;}
     unsigned int getCurrentHRCount(){return _hashrateCount;}
     void setLEDOptions(unsigned short hash, unsigned short share, bool activated);
+    void setMetricsExporter(metricsExporter* metrics){_metrics = metrics;}
+    // every line, whatever the log widget shows
+    void setLogArchive(logArchive* archive){_archive = archive; _io->setArchive(archive);}
+    void setMaxRejectRatio(double ratio){_maxRejectRatio = ratio;}
+    shareLedger& ledger(){return _ledger;}
+    gpuHashrateTracker& gpuRates(){return _gpuRates;}
+    // the card behind the miner's GPU index, the miner skips isolated ones
+    int physicalGpu(int gpu) const {return _devices.value(gpu, gpu);}
+    anomalyDetector& detector(){return _detector;}
+    void setIsolateArgs(const QString& args){_isolateArgs = args;}
+    // share display, reject ratio, isolation args and error rules
+    void setConfig(const configPtr& config);
     void restart();
     bool isRunning(){return _isRunning;}
+    // warm standby: enabled, running, cost (hashrate fraction), takeovers
+    QJsonObject standbyJson() const;
+    const QString& minerPath() const {return _minerPath;}
+    const QString& minerArgs() const {return _minerArgs;}
 private:
     QString backupArgs;
-    QProcess    _miner;
+    minerIO*    _io;
+    minerIO*    _standby;       // swapped with _io when the standby takes over
+    int         _consumer;
     zeroMHsWaitter* _waitter;
     anyMHsWaitter*  _anyHR;
     donateThrd* _donate;
     QTextEdit*  _log;
     QString     _minerPath;
     QString     _minerArgs;
-    QSettings* _settings;
-    QString _outHelper = QString();
     bool _isRunning;
     bool _autoRestart;
     bool _shareOnly;
@@ -90,26 +118,69 @@ private:
     unsigned int _delayBefore0MHs;
     unsigned int _delayBeforeNoHash;
     unsigned int _hashrateCount;
-    unsigned int _acceptedShare;
-    unsigned int _staleShare;
+    shareLedger _ledger;
+    double _maxRejectRatio;
+    gpuHashrateTracker _gpuRates;
+    anomalyDetector _detector;
+    QString _isolateArgs;
+    QVector<unsigned int> _gpuStalls;     // per physical GPU
+    QList<int> _isolated;                 // physical GPUs left out of the starts
+    QList<int> _devices;                  // physical GPU of each miner index, empty = all
+    int _gpuTotal;                        // cards seen while the miner had all of them
+    metricsExporter* _metrics;
+    Highlighter* _highlighter;
+    quint32 _run;               // 0 when no miner runs
+    quint64 _reportedDrops;
+    logArchive* _archive;
+    QStringList _startArgs;
+    bool _standbyEnabled;
+    QString _standbyArgs;
+    unsigned int _standbyDelay;
+    quint32 _standbyRun;        // 0 when no standby runs
+    quint32 _restoreRun;        // full miner started after a takeover, 0 when none
+    QTimer* _standbyTimer;
+    QTimer* _costTimer;
+    double _standbyBaseline;
+    double _standbyCost;        // -1 until measured
+    double _rateSum;
+    unsigned int _rateSamples;
+    bool _takingOver;
+    QElapsedTimer _takeoverClock;
+    qint64 _lastTakeover;       // ms from the primary's death to the standby's first hashrate
+    unsigned int _takeovers;
     QString _shareNumber;
     unsigned short _ledHash;
     unsigned short _ledShare;
     bool _ledActivated;
-    void onReadyToReadStdout();
-    void onReadyToReadStderr();
-    void onExit();
-    void onStarted();
+    void appendLog(const QString& line, Highlighter::lineClass cls);
+    void onStdoutLine(const QString& line);
+    void onStderrLine(const QString& line);
+    void checkRejectRatio(int gpu);
+    void onGpuStateChanged(const gpuHashrateTracker::sample& sample);
+    static const int STANDBY_MEASURE_MSEC = 120 * 1000;
+    void connectIO(minerIO* io);
+    void onLinesReady(minerIO* io);
+    void promoteStandby();
+    void restorePrimary();
+    void startStandby();
+    void onStandbyMeasured();
+    void onExit(quint32 run);
+    void exited();
+    void onStarted(quint32 run);
 public slots:
     void onReadyToMonitor();
     void onNoHashing();
     void onDonate();
     void onBackToNormal();
     void onReadyToRestart();
+    void onGpuXid(unsigned int gpu, unsigned long long xid);
 signals:
     void emitStarted();
     void emitStoped();
     void emitHashRate(QString& hashrate);
+    void emitShare(const QString& result);
+    void emitRejectSpike(int gpu, double ratio);
+    void emitGpuDegraded(int gpu, double rate, double baseline);
     void emitError();
 };
 
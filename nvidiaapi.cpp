@@ -1,23 +1,33 @@
 #include "nvidiaapi.h"
 #include <QDebug>
+#include <QJsonObject>
 
 fanSpeedThread::fanSpeedThread(nvidiaAPI *nvapi, QObject *) :
     _nvapi(nvapi),
     _downLimit(30),
-    _upLimit(65)
+    _upLimit(65),
+    _sampler(250, 10000)
 {
-
+    // only temperature drives the fan curve, and it must not lag too far behind
+    _sampler.setEnabled(adaptiveSampler::Power, false);
+    _sampler.setEnabled(adaptiveSampler::FanSpeed, false);
+    _sampler.setEnabled(adaptiveSampler::Clock, false);
 }
 
 void fanSpeedThread::run()
 {
     unsigned int gpuCount = _nvapi->getGPUCount();
+    QVector<int> temps(gpuCount);
     while(!_needToStop)
     {
         int previous = 0;
+        for(uint i = 0; i < gpuCount; i++)
+            temps[i] = _nvapi->getGpuTemperature(i);
+        _sampler.addSamples(adaptiveSampler::Temperature, temps);
+
         for(uint i = 0; i < gpuCount; i++)
         {
-            int gpuTemp = _nvapi->getGpuTemperature(i);
+            int gpuTemp = temps.at(i);
             if(gpuTemp > _downLimit)
             {
                 float step = 100 / (float)(_upLimit - _downLimit);
@@ -29,70 +39,52 @@ void fanSpeedThread::run()
                 }
             }
         }
-        QThread::sleep(2);
+        // sleep in small steps so stopFanThread() never waits for a long interval
+        unsigned int interval = _sampler.nextInterval();
+        for(unsigned int slept = 0; slept < interval && !_needToStop; slept += 50)
+            QThread::msleep(50);
     }
 }
 
 nvidiaAPI::nvidiaAPI():
     QLibrary("nvapi64"),
-    _gpuHandles{0},
-    _gpuCount(0),
-    _libLoaded(false),
     NvQueryInterface(NULL),
-    NvInit(NULL),
-    NvUnload(NULL),
-    NvEnumGPUs(NULL),
-    NvGetSysType(NULL),
-    NvGetName(NULL),
-    NvGetMemSize(NULL),
-    NvGetMemType(NULL),
-    NvGetBiosName(NULL),
-    NvGetFreq(NULL),
-    NvGetPstates(NULL),
-    NvSetPstates(NULL),
-    NvGetPStatesInfoEx(NULL),
-    NvQueryIlluminationSupport(NULL),
-    NvGetIllumination(NULL),
-    NvSetIllumination(NULL),
-    NvGetCoolersSettings(NULL),
-    NvSetCoolerLevel(NULL),
-    NvGetThermalSettings(NULL)
+    NvInit(this, "Initialize", 0x0150E828),
+    NvUnload(this, "Unload", 0xD22BDD7E),
+    NvEnumGPUs(this, "EnumPhysicalGPUs", 0xE5AC921F),
+    NvGetSysType(this, "GPU_GetSystemType", 0xBAAABFCC),
+    NvGetName(this, "GPU_GetFullName", 0xCEEE8E9F),
+    NvGetMemSize(this, "GPU_GetPhysicalFrameBufferSize", 0x46FBEB03),
+    NvGetMemType(this, "GPU_GetRamType", 0x57F7CAAC),
+    NvGetBiosName(this, "GPU_GetVbiosVersionString", 0xA561FD7D),
+    NvGetFreq(this, "GPU_GetAllClockFrequencies", 0xDCB616C3),
+    NvGetPstates(this, "GPU_GetPstates20", 0x6FF81213),
+    NvSetPstates(this, "GPU_SetPstates20", 0x0F4DAE6B),
+    NvGetPStatesInfoEx(this, "GPU_GetPstatesInfoEx", 0x843C0256),
+    NvGetIllumination(this, "GPU_GetIllumination", 0x9A1B9365),
+    NvSetIllumination(this, "GPU_SetIllumination", 0x254A187),
+    NvQueryIlluminationSupport(this, "GPU_QueryIlluminationSupport", 0xA629DA31),
+    NvClientPowerPoliciesGetStatus(this, "DLL_ClientPowerPoliciesGetStatus", 0x70916171),
+    NvClientPowerPoliciesGetInfo(this, "DLL_ClientPowerPoliciesGetInfo", 0x34206D86),
+    NvClientPowerPoliciesSetStatus(this, "DLL_ClientPowerPoliciesSetStatus", 0xAD95F5ED),
+    NvGetCoolersSettings(this, "GPU_GetCoolersSettings", 0xDA141340),
+    NvSetCoolerLevel(this, "GPU_SetCoolerLevel", 0x891FA0AE),
+    NvGetThermalSettings(this, "GPU_GetThermalSettings", 0xE3640A56),
+    _gpuCount(0),
+    _gpuHandles{0},
+    _libLoaded(false)
 {
+    // the other entry points are looked up when first called, a rig that
+    // never overclocks never resolves the OC ones
     NvQueryInterface = (NvAPI_QueryInterface_t)resolve("nvapi_QueryInterface");
     if(NvQueryInterface)
     {
-        NvInit = (NvAPI_Initialize_t)NvQueryInterface(0x0150E828);
-        NvUnload = (NvAPI_Unload_t)NvQueryInterface(0xD22BDD7E);
-        NvEnumGPUs = (NvAPI_EnumPhysicalGPUs_t)NvQueryInterface(0xE5AC921F);
-        NvGetSysType = (NvAPI_GPU_GetSystemType_t)NvQueryInterface(0xBAAABFCC);
-        NvGetName = (NvAPI_GPU_GetFullName_t)NvQueryInterface(0xCEEE8E9F);
-        NvGetMemSize = (NvAPI_GPU_GetPhysicalFrameBufferSize_t)NvQueryInterface(0x46FBEB03);
-        NvGetMemType = (NvAPI_GPU_GetRamType_t)NvQueryInterface(0x57F7CAAC);
-        NvGetBiosName = (NvAPI_GPU_GetVbiosVersionString_t)NvQueryInterface(0xA561FD7D);
-        NvGetFreq = (NvAPI_GPU_GetAllClockFrequencies_t)NvQueryInterface(0xDCB616C3);
-        NvGetPstates = (NvAPI_GPU_GetPstates20_t)NvQueryInterface(0x6FF81213);
-        NvSetPstates = (NvAPI_GPU_SetPstates20_t)NvQueryInterface(0x0F4DAE6B);
-        NvGetPStatesInfoEx  = (NvAPI_GPU_GetPstatesInfoEx_t)NvQueryInterface(0x843C0256);
-
-        NvClientPowerPoliciesGetStatus = (NvAPI_DLL_ClientPowerPoliciesGetStatus_t)NvQueryInterface(0x70916171);
-        NvClientPowerPoliciesGetInfo = (NvAPI_DLL_ClientPowerPoliciesGetInfo_t)NvQueryInterface(0x34206D86);
-        NvClientPowerPoliciesSetStatus = (NvAPI_DLL_ClientPowerPoliciesSetStatus_t)NvQueryInterface(0xAD95F5ED);
-
-        NvQueryIlluminationSupport = (NvAPI_GPU_QueryIlluminationSupport_t)NvQueryInterface(0xA629DA31);
-        NvGetIllumination = (NvAPI_GPU_GetIllumination_t)NvQueryInterface(0x9A1B9365);
-        NvSetIllumination = (NvAPI_GPU_SetIllumination_t)NvQueryInterface(0x254A187);
-
-        NvGetCoolersSettings = (NvAPI_GPU_GetCoolersSettings_t)NvQueryInterface(0xDA141340);
-        NvSetCoolerLevel =  (NvAPI_GPU_SetCoolerLevel_t)NvQueryInterface(0x891FA0AE);
-
-        NvGetThermalSettings = (NvAPI_GPU_GetThermalSettings_t)NvQueryInterface(0xE3640A56);
-
-
-        NvAPI_Status ret = NvInit();
+        NvAPI_Status ret = call(NvInit);
 
-        qDebug() << "NVAPI success " << ret;
+        qDebug() << "NVAPI initialize" << ret;
 
-        _libLoaded = true;
+        // without NvAPI_Initialize every other call fails
+        _libLoaded = ret == NVAPI_OK;
     }
 }
 
@@ -102,9 +94,51 @@ nvidiaAPI::~nvidiaAPI()
 
 }
 
+void* nvidiaAPI::resolveEntry(entryPoint& entry)
+{
+    int status = entry.status.load();
+    if(status == entryPoint::Available)
+        return entry.address.load();
+    if(status == entryPoint::Missing || !NvQueryInterface)
+        return Q_NULLPTR;
+
+    void* address = NvQueryInterface(entry.id);
+    entry.address.store(address);
+    entry.status.store(address ? entryPoint::Available : entryPoint::Missing);
+    if(!address)
+        qDebug() << "NVAPI" << entry.name << "not available";
+    return address;
+}
+
+QJsonArray nvidiaAPI::entryPointsJson() const
+{
+    static const char* states[] = {"unresolved", "available", "missing"};
+    QJsonArray entries;
+    foreach(const entryPoint* entry, _entryPoints)
+    {
+        QJsonObject e;
+        e["name"] = entry->name;
+        e["state"] = states[entry->status.load()];
+        // the counters are driverCallStats', past its function limit there are none
+        if(entry->statsId >= 0)
+        {
+            const driverCallStats::function& f = driverCallStats::instance().at(entry->statsId);
+            e["calls"] = (double)f.calls.load();
+            e["failures"] = (double)f.errors.load();
+        }
+        else
+        {
+            e["calls"] = 0;
+            e["failures"] = 0;
+        }
+        entries.append(e);
+    }
+    return entries;
+}
+
 unsigned int nvidiaAPI::getGPUCount()
 {
-    NvEnumGPUs(_gpuHandles, &_gpuCount);
+    call(NvEnumGPUs, _gpuHandles, &_gpuCount);
     return _gpuCount;
 }
 
@@ -117,19 +151,19 @@ void nvidiaAPI::setLED(unsigned int gpu, int color)
     illu.version = NV_GPU_QUERY_ILLUMINATION_SUPPORT_PARM_VER;
     illu.hPhysicalGpu = _gpuHandles[gpu];
     illu.Attribute = NV_GPU_IA_LOGO_BRIGHTNESS;
-    ret = NvQueryIlluminationSupport(&illu);
+    ret = call(NvQueryIlluminationSupport, &illu);
     if (!ret && illu.bSupported)
     {
         NV_GPU_GET_ILLUMINATION_PARM led;
         led.version = NV_GPU_GET_ILLUMINATION_PARM_VER;
         led.hPhysicalGpu = _gpuHandles[gpu];
         led.Attribute = NV_GPU_IA_LOGO_BRIGHTNESS;
-        NvGetIllumination(&led);
+        call(NvGetIllumination, &led);
 
         qDebug( "GPU %x: Led level was %d, set to %d", (int) _gpuHandles[gpu], led.Value, color);
 
         led.Value = (uint32_t) color;
-        ret = NvSetIllumination((NV_GPU_SET_ILLUMINATION_PARM*)&led);
+        ret = call(NvSetIllumination, (NV_GPU_SET_ILLUMINATION_PARM*)&led);
     }
     else
     {
@@ -147,7 +181,7 @@ int nvidiaAPI::getGpuTemperature(unsigned int gpu)
     thermal.sensor[0].controller = NVAPI_THERMAL_CONTROLLER_GPU_INTERNAL;
     thermal.sensor[0].target = NVAPI_THERMAL_TARGET_GPU;
 
-    ret = NvGetThermalSettings(_gpuHandles[gpu], 0, &thermal);
+    ret = call(NvGetThermalSettings, _gpuHandles[gpu], 0, &thermal);
     if (ret != NVAPI_OK)
     {
         qDebug() << "NVAPI NvAPI_GPU_GetThermalSettings error " << ret;
@@ -169,7 +203,7 @@ int nvidiaAPI::getGPUOffset(unsigned int gpu)
     // Ok on both 1080 and 970
     pset1.pstates[0].clocks[0].domainId = NVAPI_GPU_PUBLIC_CLOCK_GRAPHICS;
 
-    ret = NvGetPstates(_gpuHandles[gpu], &pset1);
+    ret = call(NvGetPstates, _gpuHandles[gpu], &pset1);
     if (ret == NVAPI_OK) {
         return pset1.pstates[0].clocks[0].freqDelta_kHz.value / 1000;
     }
@@ -187,7 +221,7 @@ int nvidiaAPI::getMemOffset(unsigned int gpu)
     pset1.numClocks = 1;
     pset1.pstates[0].clocks[0].domainId = NVAPI_GPU_PUBLIC_CLOCK_MEMORY;
 
-    ret = NvGetPstates(_gpuHandles[gpu], &pset1);
+    ret = call(NvGetPstates, _gpuHandles[gpu], &pset1);
     if (ret == NVAPI_OK) {
         return pset1.pstates[0].clocks[1].freqDelta_kHz.value / 1000;
     }
@@ -203,7 +237,7 @@ unsigned int nvidiaAPI::getGpuClock(unsigned int gpu)
     NV_GPU_CLOCK_FREQUENCIES freqs = { 0 };
     freqs.version = NV_GPU_CLOCK_FREQUENCIES_VER;
     freqs.ClockType = NV_GPU_CLOCK_FREQUENCIES_CURRENT_FREQ;
-    ret = NvGetFreq(_gpuHandles[gpu], &freqs);
+    ret = call(NvGetFreq, _gpuHandles[gpu], &freqs);
     if (ret == NVAPI_OK) {
         freq = freqs.domain[NVAPI_GPU_PUBLIC_CLOCK_GRAPHICS].frequency / 1000;
     }
@@ -216,7 +250,7 @@ unsigned int nvidiaAPI::getPowerLimit(unsigned int gpu)
     NvAPI_Status ret = NVAPI_OK;
     NVAPI_GPU_POWER_STATUS pol = { 0 };
     pol.version = NVAPI_GPU_POWER_STATUS_VER;
-    if ((ret = NvClientPowerPoliciesGetStatus(_gpuHandles[gpu], &pol)) != NVAPI_OK)
+    if ((ret = call(NvClientPowerPoliciesGetStatus, _gpuHandles[gpu], &pol)) != NVAPI_OK)
     {
         qDebug() << "error";
         return 0;
@@ -231,7 +265,7 @@ unsigned int nvidiaAPI::getFanSpeed(unsigned int gpu)
     NV_GPU_COOLER_SETTINGS coolerSettings;
     coolerSettings.version = NV_GPU_COOLER_SETTINGS_VER;
 
-    NvAPI_Status ret = NvGetCoolersSettings(_gpuHandles[gpu], 0, &coolerSettings);
+    NvAPI_Status ret = call(NvGetCoolersSettings, _gpuHandles[gpu], 0, &coolerSettings);
     if(ret == NVAPI_OK)
     {
         return coolerSettings.cooler[0].currentLevel;
@@ -249,7 +283,7 @@ int nvidiaAPI::setPowerLimitPercent(unsigned int gpu, unsigned int percent)
 
     NVAPI_GPU_POWER_INFO nfo = { 0 };
     nfo.version = NVAPI_GPU_POWER_INFO_VER;
-    ret = NvClientPowerPoliciesGetInfo(_gpuHandles[gpu], &nfo);
+    ret = call(NvClientPowerPoliciesGetInfo, _gpuHandles[gpu], &nfo);
     if (ret == NVAPI_OK) {
         if (val == 0)
             val = nfo.entries[0].def_power;
@@ -263,7 +297,7 @@ int nvidiaAPI::setPowerLimitPercent(unsigned int gpu, unsigned int percent)
     pol.version = NVAPI_GPU_POWER_STATUS_VER;
     pol.flags = 1;
     pol.entries[0].power = val;
-    if ((ret = NvClientPowerPoliciesSetStatus(_gpuHandles[gpu], &pol)) != NVAPI_OK)
+    if ((ret = call(NvClientPowerPoliciesSetStatus, _gpuHandles[gpu], &pol)) != NVAPI_OK)
     {
 
         return -1;
@@ -283,7 +317,7 @@ int nvidiaAPI::setMemClockOffset(unsigned int gpu, int clock)
     pset1.numClocks = 1;
     pset1.pstates[0].clocks[0].domainId = NVAPI_GPU_PUBLIC_CLOCK_MEMORY;
     pset1.pstates[0].clocks[0].freqDelta_kHz.value = deltaKHz;
-    ret = NvSetPstates(_gpuHandles[gpu], &pset1);
+    ret = call(NvSetPstates, _gpuHandles[gpu], &pset1);
     if (ret == NVAPI_OK)
         qDebug("GPU #%u: Memory clock offset set to %+d MHz", gpu, deltaKHz / 1000);
 
@@ -301,7 +335,7 @@ int nvidiaAPI::setGPUOffset(unsigned int gpu, int offset)
     pset1.numClocks = 1;
     pset1.pstates[0].clocks[0].domainId = NVAPI_GPU_PUBLIC_CLOCK_GRAPHICS;
     pset1.pstates[0].clocks[0].freqDelta_kHz.value = deltaKHz;
-    ret = NvSetPstates(_gpuHandles[gpu], &pset1);
+    ret = call(NvSetPstates, _gpuHandles[gpu], &pset1);
     if (ret == NVAPI_OK) {
         qDebug("GPU #%u: pu clock offset set to %d MHz", gpu, deltaKHz/1000);
     }
@@ -321,7 +355,7 @@ int nvidiaAPI::setFanSpeed(unsigned int gpu, unsigned int percent)
     coolerLvl.version = NV_GPU_COOLER_LEVELS_VER;
     coolerLvl.cooler[0].level = percent;
 
-    NvAPI_Status ret = NvSetCoolerLevel(_gpuHandles[gpu], 0, &coolerLvl);
+    NvAPI_Status ret = call(NvSetCoolerLevel, _gpuHandles[gpu], 0, &coolerLvl);
 
     return ret;
 }
@@ -5,7 +5,13 @@
 #include <QLibrary>
 #include <QByteArray>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QJsonArray>
+#include <atomic>
 #include "nvapi.h"
+#include "adaptivesampler.h"
+#include "drivercallstats.h"
 
 typedef struct {
     NvU32 version;
@@ -322,6 +328,8 @@ private:
 
     bool _needToStop = false;
 
+    adaptiveSampler _sampler;
+
 public slots:
 
     void onStop(){_needToStop = true;}
@@ -358,6 +366,8 @@ public:
     void setAllLED(int color);
 
     bool libLoaded(){return _libLoaded;}
+    // name, state and call counts of every driver entry point
+    QJsonArray entryPointsJson() const;
 
     void startFanThread();
     void stopFanThread();
@@ -388,28 +398,77 @@ private:
     typedef NvAPI_Status (*NvAPI_GPU_SetCoolerLevel_t)(NvPhysicalGpuHandle hPhysicalGpu, NvU32 coolerIndex, NV_GPU_COOLER_LEVELS* coolerLevel);
     typedef NvAPI_Status (*NvAPI_GPU_GetThermalSettings_t)(NvPhysicalGpuHandle hPhysicalGpu, NvU32 gpuIndex, NV_GPU_THERMAL_SETTINGS* thermalSettings);
 
+    // One driver entry point, looked up through nvapi_QueryInterface the
+    // first time it is called. A function the driver does not export stays
+    // Missing and its calls return NVAPI_NO_IMPLEMENTATION. Its calls are
+    // counted in driverCallStats only.
+    struct entryPoint
+    {
+        enum state
+        {
+            Unresolved = 0,
+            Available,
+            Missing
+        };
+
+        entryPoint(const char* n, unsigned int i) : name(n), id(i), statsId(driverCallStats::instance().functionId(driverCallStats::Nvapi, n))
+                                                  , status(Unresolved), address(Q_NULLPTR) {}
+        const char* name;
+        unsigned int id;
+        int statsId;
+        std::atomic<int> status;
+        std::atomic<void*> address;
+    };
+
+    template<typename F>
+    struct function : entryPoint
+    {
+        function(nvidiaAPI* api, const char* n, unsigned int i) : entryPoint(n, i) {api->_entryPoints << this;}
+    };
+
+    // Resolving twice from two threads is harmless, both get the same address
+    void* resolveEntry(entryPoint& entry);
+
+    template<typename F, typename... Args>
+    NvAPI_Status call(function<F>& entry, Args... args)
+    {
+        void* address = entry.status.load() == entryPoint::Available ? entry.address.load() : resolveEntry(entry);
+        if(!address)
+        {
+            driverCallStats::instance().record(entry.statsId, 0, NVAPI_NO_IMPLEMENTATION);
+            return NVAPI_NO_IMPLEMENTATION;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        NvAPI_Status ret = reinterpret_cast<F>(address)(args...);
+        driverCallStats::instance().record(entry.statsId, timer.nsecsElapsed(), ret);
+        return ret;
+    }
+
     NvAPI_QueryInterface_t NvQueryInterface;
-    NvAPI_Initialize_t NvInit;
-    NvAPI_Unload_t NvUnload;
-    NvAPI_EnumPhysicalGPUs_t NvEnumGPUs;
-    NvAPI_GPU_GetSystemType_t NvGetSysType;
-    NvAPI_GPU_GetFullName_t NvGetName;
-    NvAPI_GPU_GetPhysicalFrameBufferSize_t NvGetMemSize;
-    NvAPI_GPU_GetRamType_t NvGetMemType;
-    NvAPI_GPU_GetVbiosVersionString_t NvGetBiosName;
-    NvAPI_GPU_GetAllClockFrequencies_t NvGetFreq;
-    NvAPI_GPU_GetPstates20_t NvGetPstates;
-    NvAPI_GPU_SetPstates20_t NvSetPstates;
-    NvAPI_GPU_GetPstatesInfoEx_t NvGetPStatesInfoEx;
-    NvAPI_GPU_GetIllumination_t NvGetIllumination;
-    NvAPI_GPU_SetIllumination_t NvSetIllumination;
-    NvAPI_GPU_QueryIlluminationSupport_t NvQueryIlluminationSupport;
-    NvAPI_DLL_ClientPowerPoliciesGetStatus_t NvClientPowerPoliciesGetStatus;
-    NvAPI_DLL_ClientPowerPoliciesGetInfo_t NvClientPowerPoliciesGetInfo;
-    NvAPI_DLL_ClientPowerPoliciesSetStatus_t NvClientPowerPoliciesSetStatus;
-    NvAPI_GPU_GetCoolersSettings_t NvGetCoolersSettings;
-    NvAPI_GPU_SetCoolerLevel_t NvSetCoolerLevel;
-    NvAPI_GPU_GetThermalSettings_t NvGetThermalSettings;
+    QVector<entryPoint*> _entryPoints;
+
+    function<NvAPI_Initialize_t> NvInit;
+    function<NvAPI_Unload_t> NvUnload;
+    function<NvAPI_EnumPhysicalGPUs_t> NvEnumGPUs;
+    function<NvAPI_GPU_GetSystemType_t> NvGetSysType;
+    function<NvAPI_GPU_GetFullName_t> NvGetName;
+    function<NvAPI_GPU_GetPhysicalFrameBufferSize_t> NvGetMemSize;
+    function<NvAPI_GPU_GetRamType_t> NvGetMemType;
+    function<NvAPI_GPU_GetVbiosVersionString_t> NvGetBiosName;
+    function<NvAPI_GPU_GetAllClockFrequencies_t> NvGetFreq;
+    function<NvAPI_GPU_GetPstates20_t> NvGetPstates;
+    function<NvAPI_GPU_SetPstates20_t> NvSetPstates;
+    function<NvAPI_GPU_GetPstatesInfoEx_t> NvGetPStatesInfoEx;
+    function<NvAPI_GPU_GetIllumination_t> NvGetIllumination;
+    function<NvAPI_GPU_SetIllumination_t> NvSetIllumination;
+    function<NvAPI_GPU_QueryIlluminationSupport_t> NvQueryIlluminationSupport;
+    function<NvAPI_DLL_ClientPowerPoliciesGetStatus_t> NvClientPowerPoliciesGetStatus;
+    function<NvAPI_DLL_ClientPowerPoliciesGetInfo_t> NvClientPowerPoliciesGetInfo;
+    function<NvAPI_DLL_ClientPowerPoliciesSetStatus_t> NvClientPowerPoliciesSetStatus;
+    function<NvAPI_GPU_GetCoolersSettings_t> NvGetCoolersSettings;
+    function<NvAPI_GPU_SetCoolerLevel_t> NvSetCoolerLevel;
+    function<NvAPI_GPU_GetThermalSettings_t> NvGetThermalSettings;
 
 private:
 
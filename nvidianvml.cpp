@@ -1,4 +1,5 @@
 #include "nvidianvml.h"
+#include "drivercallstats.h"
 #include <QDebug>
 
 nvidiaNVML::nvidiaNVML()
@@ -8,7 +9,7 @@ nvidiaNVML::nvidiaNVML()
 
 bool nvidiaNVML::initNVML()
 {
-    nvmlReturn_t result = nvmlInit();
+    nvmlReturn_t result = DRIVER_CALL(driverCallStats::Nvml, nvmlInit);
     if (NVML_SUCCESS != result)
     {
         qDebug() << nvmlErrorString(result);
@@ -22,7 +23,7 @@ unsigned int nvidiaNVML::getGPUCount()
     unsigned int deviceCount = 0;
     nvmlReturn_t result;
 
-    result = nvmlDeviceGetCount(&deviceCount);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetCount, &deviceCount);
     if (NVML_SUCCESS != result)
     {
         qDebug() << nvmlErrorString(result);
@@ -33,7 +34,7 @@ unsigned int nvidiaNVML::getGPUCount()
 
 void nvidiaNVML::shutDownNVML()
 {
-    nvmlShutdown();
+    DRIVER_CALL(driverCallStats::Nvml, nvmlShutdown);
 }
 
 int nvidiaNVML::getGPUTemp(unsigned int index)
@@ -43,14 +44,14 @@ int nvidiaNVML::getGPUTemp(unsigned int index)
     nvmlDevice_t device;
     unsigned int temp = 0;
 
-    result = nvmlDeviceGetHandleByIndex(index, &device);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, index, &device);
     if(result != NVML_SUCCESS )
     {
         qDebug() << nvmlErrorString(result);
         return -1;
     }
 
-    result = nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temp);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetTemperature, device, NVML_TEMPERATURE_GPU, &temp);
 
     return temp;
 }
@@ -62,14 +63,14 @@ int nvidiaNVML::getFanSpeed(unsigned int index)
     nvmlDevice_t device;
     unsigned int temp = 0;
 
-    result = nvmlDeviceGetHandleByIndex(index, &device);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, index, &device);
     if(result != NVML_SUCCESS )
     {
         qDebug() << nvmlErrorString(result);
         return -1;
     }
 
-    result = nvmlDeviceGetFanSpeed(device, &temp);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetFanSpeed, device, &temp);
 
     return temp;
 
@@ -82,14 +83,14 @@ int nvidiaNVML::getMemClock(unsigned int index)
     nvmlDevice_t device;
     unsigned int clock = 0;
 
-    result = nvmlDeviceGetHandleByIndex(index, &device);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, index, &device);
     if(result != NVML_SUCCESS )
     {
         qDebug() << nvmlErrorString(result);
         return -1;
     }
 
-    result = nvmlDeviceGetClockInfo(device, NVML_CLOCK_MEM, &clock);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetClockInfo, device, NVML_CLOCK_MEM, &clock);
 
     return clock;
 
@@ -102,14 +103,14 @@ int nvidiaNVML::getGPUClock(unsigned int index)
     nvmlDevice_t device;
     unsigned int clock = 0;
 
-    result = nvmlDeviceGetHandleByIndex(index, &device);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, index, &device);
     if(result != NVML_SUCCESS )
     {
         qDebug() << nvmlErrorString(result);
         return -1;
     }
 
-    result = nvmlDeviceGetClockInfo(device, NVML_CLOCK_GRAPHICS, &clock);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetClockInfo, device, NVML_CLOCK_GRAPHICS, &clock);
 
     return clock;
 
@@ -122,14 +123,14 @@ int nvidiaNVML::getPowerDraw(unsigned int index)
     nvmlDevice_t device;
     unsigned int power = 0;
 
-    result = nvmlDeviceGetHandleByIndex(index, &device);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, index, &device);
     if(result != NVML_SUCCESS )
     {
         qDebug() << nvmlErrorString(result);
         return -1;
     }
 
-    result = nvmlDeviceGetPowerUsage(device, &power);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetPowerUsage, device, &power);
 
     return power;
 }
@@ -142,7 +143,7 @@ int nvidiaNVML::getMaxSupportedMemClock(unsigned int index)
     unsigned int* clock = 0;
     unsigned int max = 0;
 
-    result = nvmlDeviceGetHandleByIndex(index, &device);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, index, &device);
     if(result != NVML_SUCCESS )
     {
         qDebug() << nvmlErrorString(result);
@@ -150,13 +151,13 @@ int nvidiaNVML::getMaxSupportedMemClock(unsigned int index)
     }
 
     unsigned int count = 0;
-    result = nvmlDeviceGetSupportedMemoryClocks(device, &count, clock);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetSupportedMemoryClocks, device, &count, clock);
     if(result == NVML_ERROR_INSUFFICIENT_SIZE)
     {
         qDebug() << "NVML_ERROR_INSUFFICIENT_SIZE";
         qDebug() << count;
         clock = new unsigned int[count];
-        result = nvmlDeviceGetSupportedMemoryClocks(device, &count, clock);
+        result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetSupportedMemoryClocks, device, &count, clock);
         if(result == NVML_SUCCESS)
         {
             for(unsigned int i = 0; i < count; i++)
@@ -320,7 +321,7 @@ void nvidiaNVML::setClock(unsigned int index)
     nvmlDevice_t device;
 
 
-    result = nvmlDeviceGetHandleByIndex(index, &device);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, index, &device);
     if(result != NVML_SUCCESS )
     {
         qDebug() << nvmlErrorString(result);
@@ -329,15 +330,131 @@ void nvidiaNVML::setClock(unsigned int index)
 
     nvmlEnableState_t enablestate;
 
-    nvmlDeviceGetAPIRestriction(device, NVML_RESTRICTED_API_SET_APPLICATION_CLOCKS, &enablestate);
+    DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetAPIRestriction, device, NVML_RESTRICTED_API_SET_APPLICATION_CLOCKS, &enablestate);
     if(enablestate == NVML_FEATURE_ENABLED)
     {
-        result = nvmlDeviceSetAPIRestriction(device, NVML_RESTRICTED_API_SET_APPLICATION_CLOCKS, NVML_FEATURE_DISABLED);
+        result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceSetAPIRestriction, device, NVML_RESTRICTED_API_SET_APPLICATION_CLOCKS, NVML_FEATURE_DISABLED);
     }
 
-    result = nvmlDeviceSetApplicationsClocks(device, 4700, 1750);
+    result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceSetApplicationsClocks, device, 4700, 1750);
     if(result != NVML_SUCCESS)
         qDebug() << nvmlErrorString(result);
 
 
 }
+
+
+nvmlEventWaiter::nvmlEventWaiter(QObject* pParent) : QThread(pParent)
+                                                    , _needToStop(false)
+                                                    , _gpuLost(false)
+                                                    , _retryDelay(5000)
+{
+}
+
+bool nvmlEventWaiter::registerDevices(nvmlEventSet_t set)
+{
+    const unsigned long long wanted = nvmlEventTypeXidCriticalError
+                                    | nvmlEventTypeClock
+                                    | nvmlEventTypePState;
+    unsigned int count = 0;
+    DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetCount, &count);
+
+    bool registered = false;
+    for(unsigned int i = 0; i < count; i++)
+    {
+        nvmlDevice_t device;
+        if(DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetHandleByIndex, i, &device) != NVML_SUCCESS)
+            continue;
+
+        unsigned long long supported = 0;
+        nvmlReturn_t result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetSupportedEventTypes, device, &supported);
+        if(result != NVML_SUCCESS)
+        {
+            qDebug() << "GPU" << i << "events:" << nvmlErrorString(result);
+            continue;
+        }
+
+        result = DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceRegisterEvents, device, supported & wanted, set);
+        if(result != NVML_SUCCESS)
+        {
+            qDebug() << "GPU" << i << "events:" << nvmlErrorString(result);
+            continue;
+        }
+        registered = true;
+    }
+    return registered;
+}
+
+// A lost GPU is reported once, then NVML and the event set are set up
+// again with a growing delay until the driver answers
+void nvmlEventWaiter::run()
+{
+    while(waitEvents() && !_needToStop)
+    {
+        for(unsigned long waited = 0; waited < _retryDelay && !_needToStop; waited += 100)
+            QThread::msleep(100);
+        _retryDelay = qMin(_retryDelay * 2, 60000UL);
+    }
+}
+
+// true when the event set has to be created again
+bool nvmlEventWaiter::waitEvents()
+{
+    if(DRIVER_CALL(driverCallStats::Nvml, nvmlInit) != NVML_SUCCESS)
+        return _gpuLost;
+
+    nvmlEventSet_t set;
+    if(DRIVER_CALL(driverCallStats::Nvml, nvmlEventSetCreate, &set) != NVML_SUCCESS)
+    {
+        DRIVER_CALL(driverCallStats::Nvml, nvmlShutdown);
+        return _gpuLost;
+    }
+
+    bool retry = _gpuLost;
+    // not every driver/OS supports events (WDDM often doesn't); polling stays in charge then
+    if(registerDevices(set))
+    {
+        retry = false;
+        while(!_needToStop)
+        {
+            nvmlEventData_t data;
+            // waiting is its job: not timed with the other driver calls
+            nvmlReturn_t result = nvmlEventSetWait(set, &data, 1000);
+            if(result == NVML_SUCCESS || result == NVML_ERROR_TIMEOUT)
+            {
+                _gpuLost = false;
+                _retryDelay = 5000;
+            }
+            if(result == NVML_ERROR_TIMEOUT)
+                continue;
+            if(result != NVML_SUCCESS)
+            {
+                qDebug() << "nvmlEventSetWait:" << nvmlErrorString(result);
+                if(result == NVML_ERROR_GPU_IS_LOST)
+                {
+                    if(!_gpuLost)
+                        emit xidError((unsigned int)-1, 79);
+                    _gpuLost = true;
+                    retry = true;
+                    break;
+                }
+                QThread::msleep(1000);
+                continue;
+            }
+
+            unsigned int gpu = (unsigned int)-1;
+            DRIVER_CALL(driverCallStats::Nvml, nvmlDeviceGetIndex, data.device, &gpu);
+
+            if(data.eventType & nvmlEventTypeXidCriticalError)
+                emit xidError(gpu, data.eventData);
+            if(data.eventType & nvmlEventTypeClock)
+                emit clockChanged(gpu);
+            if(data.eventType & nvmlEventTypePState)
+                emit powerStateChanged(gpu);
+        }
+    }
+
+    DRIVER_CALL(driverCallStats::Nvml, nvmlEventSetFree, set);
+    DRIVER_CALL(driverCallStats::Nvml, nvmlShutdown);
+    return retry;
+}
@@ -3,6 +3,7 @@
 
 
 #include <nvml.h>
+#include <QThread>
 
 
 class nvidiaNVML
@@ -50,4 +51,23 @@ private:
 
 };
 
+class nvmlEventWaiter : public QThread
+{
+    Q_OBJECT
+public:
+    nvmlEventWaiter(QObject* pParent = Q_NULLPTR);
+    void run();
+    void stop(){_needToStop = true;}
+private:
+    bool registerDevices(nvmlEventSet_t set);
+    bool waitEvents();
+    volatile bool _needToStop;
+    bool _gpuLost;
+    unsigned long _retryDelay;
+signals:
+    void xidError(unsigned int gpu, unsigned long long xid);
+    void clockChanged(unsigned int gpu);
+    void powerStateChanged(unsigned int gpu);
+};
+
 #endif
@@ -0,0 +1,201 @@
+#include "poolprober.h"
+#include <QSslSocket>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QDebug>
+
+poolProber::poolProber(QObject* pParent) : QThread(pParent)
+                                         , _current(-1)
+                                         , _dialect(Subscribe)
+                                         , _interval(60)
+                                         , _timeout(5000)
+                                         , _switchRatio(0.2)
+                                         , _needToStop(false)
+{
+}
+
+void poolProber::setPools(const QList<selectumConfig::pool>& pools)
+{
+    QMutexLocker lock(&_mutex);
+    _pools.clear();
+    foreach(const selectumConfig::pool& entry, pools)
+    {
+        pool p;
+        p.host = entry.host;
+        p.port = entry.port;
+        p.ssl = entry.ssl;
+        p.connectMs = 0;
+        p.responseMs = 0;
+        p.score = 0;
+        p.probes = 0;
+        p.failures = 0;
+        _pools << p;
+    }
+    findCurrent();
+}
+
+int poolProber::poolCount() const
+{
+    QMutexLocker lock(&_mutex);
+    return _pools.size();
+}
+
+void poolProber::setCurrent(const QString& hostPort)
+{
+    QMutexLocker lock(&_mutex);
+    _currentPool = hostPort;
+    findCurrent();
+}
+
+void poolProber::findCurrent()
+{
+    _current = -1;
+    for(int i = 0; i < _pools.size(); i++)
+        if(_pools.at(i).host + ":" + QString::number(_pools.at(i).port) == _currentPool) _current = i;
+}
+
+void poolProber::setDialect(dialect d)
+{
+    QMutexLocker lock(&_mutex);
+    _dialect = d;
+}
+
+poolProber::dialect poolProber::dialectFor(const QString& algo)
+{
+    return algo == "cryptonight" ? Login : Subscribe;
+}
+
+bool poolProber::probe(pool& p, dialect d)
+{
+    QSslSocket socket;
+    QElapsedTimer timer;
+    timer.start();
+    if(p.ssl)
+    {
+        socket.connectToHostEncrypted(p.host, p.port);
+        if(!socket.waitForEncrypted(_timeout))
+            return false;
+    }
+    else
+    {
+        socket.connectToHost(p.host, p.port);
+        if(!socket.waitForConnected(_timeout))
+            return false;
+    }
+    p.connectMs = timer.elapsed();
+
+    // any answer counts, an error for the probe's login comes just as fast;
+    // a request of another dialect may get no answer at all.
+    // The first reply is timed, not the first job (mining.notify, or the job
+    // of a login result): pools only send work to an authorized worker, and
+    // the probe doesn't log in with the rig's wallet so it never shows up as
+    // a second worker on the pool. Job latency follows the same round trip.
+    timer.restart();
+    if(d == Login)
+        socket.write("{\"id\":1,\"jsonrpc\":\"2.0\",\"method\":\"login\",\"params\":{\"login\":\"selectum-probe\",\"pass\":\"x\",\"agent\":\"selectum-probe\"}}\n");
+    else
+        socket.write("{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[\"selectum-probe\"]}\n");
+    while(!socket.canReadLine())
+    {
+        if(timer.elapsed() >= _timeout || !socket.waitForReadyRead(_timeout - timer.elapsed()))
+            return false;
+    }
+    p.responseMs = timer.elapsed();
+    socket.abort();
+    return true;
+}
+
+int poolProber::best() const
+{
+    int best = -1;
+    for(int i = 0; i < _pools.size(); i++)
+    {
+        if(healthy(_pools.at(i)) && (best == -1 || _pools.at(i).score < _pools.at(best).score))
+            best = i;
+    }
+    return best;
+}
+
+void poolProber::run()
+{
+    while(!_needToStop)
+    {
+        int count = poolCount();
+        for(int i = 0; i < count && !_needToStop; i++)
+        {
+            pool p;
+            dialect d;
+            {
+                // the list may have been replaced by a config reload
+                QMutexLocker lock(&_mutex);
+                if(i >= _pools.size())
+                    break;
+                p = _pools.at(i);
+                d = _dialect;
+            }
+            bool ok = probe(p, d);
+            double latency = p.connectMs + p.responseMs;
+            if(ok)
+            {
+                p.score = p.probes++ == 0 ? latency : p.score + 0.3 * (latency - p.score);
+                p.failures = 0;
+            }
+            else
+            {
+                p.failures++;
+                qDebug() << "pool probe failed" << p.host << p.port;
+            }
+            QMutexLocker lock(&_mutex);
+            if(i < _pools.size())
+                _pools[i] = p;
+        }
+
+        {
+            QMutexLocker lock(&_mutex);
+            int candidate = best();
+            // a pool set by hand outside the list is kept
+            bool unlisted = _current == -1 && !_currentPool.isEmpty();
+            if(candidate != -1 && candidate != _current && !unlisted)
+            {
+                bool currentDown = _current == -1 || !healthy(_pools.at(_current));
+                // hysteresis, a marginally faster pool isn't worth the reconnect
+                if(currentDown || _pools.at(candidate).score < _pools.at(_current).score * (1 - _switchRatio))
+                {
+                    _current = candidate;
+                    const pool& p = _pools.at(candidate);
+                    _currentPool = p.host + ":" + QString::number(p.port);
+                    emit poolChanged(p.host, p.port, p.ssl);
+                }
+            }
+        }
+
+        for(unsigned int slept = 0; slept < _interval * 1000 && !_needToStop; slept += 100)
+            QThread::msleep(100);
+    }
+}
+
+QList<poolProber::pool> poolProber::pools() const
+{
+    QMutexLocker lock(&_mutex);
+    return _pools;
+}
+
+QJsonArray poolProber::toJson() const
+{
+    QMutexLocker lock(&_mutex);
+    QJsonArray array;
+    for(int i = 0; i < _pools.size(); i++)
+    {
+        const pool& p = _pools.at(i);
+        QJsonObject json;
+        json["pool"] = p.host + ":" + QString::number(p.port);
+        json["ssl"] = p.ssl;
+        json["connectMs"] = p.connectMs;
+        json["responseMs"] = p.responseMs;
+        json["score"] = p.score;
+        json["healthy"] = healthy(p);
+        json["current"] = i == _current;
+        array.append(json);
+    }
+    return array;
+}
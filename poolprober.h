@@ -0,0 +1,73 @@
+#ifndef POOLPROBER_H
+#define POOLPROBER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QList>
+#include <QString>
+#include <QJsonArray>
+#include "selectumconfig.h"
+
+// Probes every pool of the [pools] list in the background: TCP/TLS
+// connect time and the round trip of a first stratum request, in the
+// dialect of the algorithm (not the time to a first job, see probe()). Pools are ranked on a smoothed latency and a
+// switch is only suggested when the current pool fails or another one is
+// clearly faster, never away from a pool that isn't in the list.
+class poolProber : public QThread
+{
+    Q_OBJECT
+public:
+    enum dialect
+    {
+        Subscribe = 0,  // stratum v1, EthereumStratum: mining.subscribe
+        Login           // cryptonight pools: login
+    };
+
+    struct pool
+    {
+        QString host;
+        quint16 port;
+        bool ssl;
+        double connectMs;
+        double responseMs;
+        double score;            // smoothed connect + response
+        unsigned int probes;
+        unsigned int failures;   // consecutive
+    };
+
+    poolProber(QObject* pParent = Q_NULLPTR);
+
+    void setPools(const QList<selectumConfig::pool>& pools);
+    int poolCount() const;
+    void setInterval(unsigned int sec){_interval = sec;}
+    void setCurrent(const QString& hostPort);
+    void setDialect(dialect d);
+    static dialect dialectFor(const QString& algo);
+    void stop(){_needToStop = true;}
+    void run();
+
+    QList<pool> pools() const;
+    QJsonArray toJson() const;
+
+    static bool healthy(const pool& p){return p.probes > 0 && p.failures < 2;}
+
+signals:
+    void poolChanged(const QString& host, quint16 port, bool ssl);
+
+private:
+    bool probe(pool& p, dialect d);
+    int best() const;
+    void findCurrent();
+
+    mutable QMutex _mutex;
+    QList<pool> _pools;
+    QString _currentPool;   // host:port the miner uses, listed or not
+    int _current;           // -1 when not in the list
+    dialect _dialect;
+    unsigned int _interval;
+    unsigned int _timeout;
+    double _switchRatio;
+    volatile bool _needToStop;
+};
+
+#endif // POOLPROBER_H
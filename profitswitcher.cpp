@@ -0,0 +1,126 @@
+#include "profitswitcher.h"
+#include <QSettings>
+#include <QTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+profitSwitcher::profitSwitcher(QSettings* settings, QObject* pParent) : QObject(pParent)
+                                                                     , _settings(settings)
+                                                                     , _timer(new QTimer(this))
+                                                                     , _electricity(-1)
+                                                                     , _hysteresis(0.05)
+                                                                     , _minDwell(15 * 60)
+{
+    connect(_timer, &QTimer::timeout, this, &profitSwitcher::evaluate);
+    _since.start();
+}
+
+void profitSwitcher::setCurrent(const QString& coinName)
+{
+    if(coinName != _current)
+        _since.restart();
+    _current = coinName;
+}
+
+void profitSwitcher::start(unsigned int intervalSec)
+{
+    _timer->start(intervalSec * 1000);
+    evaluate();
+}
+
+void profitSwitcher::stop()
+{
+    _timer->stop();
+}
+
+bool profitSwitcher::readFeed()
+{
+    QFile file(_feed);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "cannot open profit feed" << _feed;
+        return false;
+    }
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if(!doc.isObject())
+    {
+        qDebug() << "invalid profit feed" << _feed << error.errorString();
+        return false;
+    }
+
+    QJsonObject root = doc.object();
+    // the setting wins over the feed
+    double electricity = _electricity >= 0 ? _electricity : root.value("electricity").toDouble();
+
+    _coins.clear();
+    _settings->beginGroup("benchmark");
+    foreach(const QJsonValue& value, root.value("coins").toArray())
+    {
+        QJsonObject entry = value.toObject();
+        coin c;
+        c.name = entry.value("coin").toString();
+        c.algo = entry.value("algo").toString();
+        double difficulty = entry.value("difficulty").toDouble();
+        double hashrate = _settings->value(c.algo + "_hashrate").toDouble();
+        double power = _settings->value(c.algo + "_power").toDouble();
+        if(c.name.isEmpty() || difficulty <= 0 || hashrate <= 0)
+            continue;
+        // expected blocks a day are hashes a day over the hashes needed per block
+        c.revenue = hashrate * 86400 / difficulty * entry.value("reward").toDouble() * entry.value("price").toDouble();
+        c.cost = power * 24 / 1000 * electricity;
+        c.net = c.revenue - c.cost;
+        _coins << c;
+    }
+    _settings->endGroup();
+    return true;
+}
+
+void profitSwitcher::evaluate()
+{
+    if(!readFeed() || _coins.isEmpty())
+        return;
+
+    int best = 0;
+    int current = -1;
+    for(int i = 0; i < _coins.size(); i++)
+    {
+        if(_coins.at(i).net > _coins.at(best).net)
+            best = i;
+        if(_coins.at(i).name == _current)
+            current = i;
+    }
+    if(_coins.at(best).name == _current)
+        return;
+
+    if(current != -1)
+    {
+        if(_since.elapsed() < (qint64)_minDwell * 1000)
+            return;
+        double threshold = _coins.at(current).net + qAbs(_coins.at(current).net) * _hysteresis;
+        if(_coins.at(best).net <= threshold)
+            return;
+    }
+
+    setCurrent(_coins.at(best).name);
+    emit switchTo(_coins.at(best).name, _coins.at(best).algo);
+}
+
+QJsonArray profitSwitcher::toJson() const
+{
+    QJsonArray array;
+    foreach(const coin& c, _coins)
+    {
+        QJsonObject json;
+        json["coin"] = c.name;
+        json["algo"] = c.algo;
+        json["revenue"] = c.revenue;
+        json["cost"] = c.cost;
+        json["net"] = c.net;
+        json["current"] = c.name == _current;
+        array.append(json);
+    }
+    return array;
+}
@@ -0,0 +1,67 @@
+#ifndef PROFITSWITCHER_H
+#define PROFITSWITCHER_H
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QJsonArray>
+#include <QElapsedTimer>
+
+class QSettings;
+class QTimer;
+
+// Picks the most profitable coin from a local JSON feed:
+//   {"electricity": 0.12,
+//    "coins": [{"coin": "monero", "algo": "cryptonight",
+//               "price": 150, "difficulty": 5.2e10, "reward": 4.6}, ...]}
+// Hashrate (H/s) and power (W) per algo come from the [benchmark] group
+// (<algo>_hashrate, <algo>_power). Net profit per day is the expected
+// reward minus electricity; a switch needs the new coin to beat the
+// current one by the hysteresis and the current one to have run long enough.
+class profitSwitcher : public QObject
+{
+    Q_OBJECT
+public:
+    struct coin
+    {
+        QString name;
+        QString algo;
+        double revenue;     // per day
+        double cost;        // per day
+        double net;
+    };
+
+    profitSwitcher(QSettings* settings, QObject* pParent = Q_NULLPTR);
+
+    void setFeed(const QString& path){_feed = path;}
+    void setElectricityCost(double perKWh){_electricity = perKWh;}
+    void setHysteresis(double ratio){_hysteresis = ratio;}
+    void setMinDwell(unsigned int sec){_minDwell = sec;}
+    void setCurrent(const QString& coinName);
+    void start(unsigned int intervalSec);
+    void stop();
+
+    QList<coin> coins() const {return _coins;}
+    QJsonArray toJson() const;
+
+signals:
+    void switchTo(const QString& coinName, const QString& algo);
+
+public slots:
+    void evaluate();
+
+private:
+    bool readFeed();
+
+    QSettings* _settings;
+    QTimer* _timer;
+    QString _feed;
+    double _electricity;
+    double _hysteresis;
+    unsigned int _minDwell;
+    QString _current;
+    QElapsedTimer _since;
+    QList<coin> _coins;
+};
+
+#endif // PROFITSWITCHER_H
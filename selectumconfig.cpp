@@ -0,0 +1,203 @@
+#include "selectumconfig.h"
+#include <QSettings>
+#include <QDir>
+#include <QSysInfo>
+
+static unsigned int readUInt(QSettings* settings, const QString& key, unsigned int def
+                             , unsigned int min, unsigned int max, QStringList* warnings)
+{
+    if(!settings->contains(key))
+        return def;
+    bool ok = false;
+    unsigned int value = settings->value(key).toUInt(&ok);
+    if(!ok || value < min || value > max)
+    {
+        if(warnings)
+            *warnings << QString("%1=%2 out of range [%3, %4], using %5").arg(key).arg(settings->value(key).toString()).arg(min).arg(max).arg(def);
+        return def;
+    }
+    return value;
+}
+
+static double readDouble(QSettings* settings, const QString& key, double def
+                         , double min, double max, QStringList* warnings)
+{
+    if(!settings->contains(key))
+        return def;
+    bool ok = false;
+    double value = settings->value(key).toDouble(&ok);
+    if(!ok || value < min || value > max)
+    {
+        if(warnings)
+            *warnings << QString("%1=%2 out of range [%3, %4], using %5").arg(key).arg(settings->value(key).toString()).arg(min).arg(max).arg(def);
+        return def;
+    }
+    return value;
+}
+
+static QVector<int> readGpuValues(QSettings* settings, const QString& prefix, int min, int max, QStringList* warnings)
+{
+    QVector<int> values;
+    for(int i = 0; i < 32; i++)
+    {
+        QString key = prefix + QString::number(i);
+        if(!settings->contains(key))
+            continue;
+        int value = settings->value(key).toInt();
+        if(value < min || value > max)
+        {
+            if(warnings)
+                *warnings << QString("%1/%2=%3 out of range [%4, %5], ignored").arg(settings->group()).arg(key).arg(value).arg(min).arg(max);
+            continue;
+        }
+        while(values.size() <= i)
+            values << selectumConfig::ocProfile::UNSET;
+        values[i] = value;
+    }
+    return values;
+}
+
+selectumConfig::selectumConfig()
+{
+}
+
+configPtr selectumConfig::load(QSettings* settings, QStringList* warnings)
+{
+    std::shared_ptr<selectumConfig> config(new selectumConfig);
+
+    config->minerPath = settings->value(MINERPATH).toString();
+    config->minerArgs = settings->value(MINERARGS).toString();
+    config->autoStart = settings->value(AUTOSTART).toBool();
+    config->shareOnly = settings->value(DISPLAYSHAREONLY).toBool();
+
+    config->watchdog.autoRestart = settings->value(AUTORESTART).toBool();
+    config->watchdog.max0mhs = readUInt(settings, MAX0MHS, 0, 0, 1000, warnings);
+    config->watchdog.restartDelay = readUInt(settings, RESTARTDELAY, 0, 0, 3600, warnings);
+    config->watchdog.delayBefore0mhs = readUInt(settings, ZEROMHSDELAY, 0, 0, 3600, warnings);
+    config->watchdog.delayNoHash = readUInt(settings, DELAYNOHASH, 0, 0, 3600, warnings);
+    config->watchdog.maxRejectRatio = readDouble(settings, MAXREJECTRATIO, 0, 0, 100, warnings) / 100;
+    config->watchdog.isolateArgs = settings->value(ISOLATEARGS).toString();
+    config->watchdog.stopGrace = readUInt(settings, STOPGRACE, 5, 0, 60, warnings);
+    config->watchdog.standby = settings->value(STANDBY).toBool();
+    config->watchdog.standbyArgs = settings->value(STANDBYARGS).toString();
+    config->watchdog.standbyDelay = readUInt(settings, STANDBYDELAY, 120, 10, 3600, warnings);
+    // a second copy of the primary's job would hold a second DAG in VRAM and
+    // a second pool session: the standby must be given a light job of its own
+    if(config->watchdog.standby && config->watchdog.standbyArgs.trimmed().isEmpty())
+    {
+        if(warnings)
+            *warnings << QString("%1 needs %2, standby disabled").arg(STANDBY).arg(STANDBYARGS);
+        config->watchdog.standby = false;
+    }
+    config->errorRules = anomalyDetector::readRules(settings);
+
+    config->ocApplyOnStart = settings->value("nvoc/nvoc_applyonstart").toBool();
+    foreach(const QString& group, settings->childGroups())
+    {
+        if(group != "nvoc" && !group.startsWith("nvoc_"))
+            continue;
+        settings->beginGroup(group);
+        ocProfile profile;
+        profile.powerLimit = readGpuValues(settings, "powerlimitoffset", 0, 200, warnings);
+        profile.gpuOffset = readGpuValues(settings, "gpuoffset", -1000, 1000, warnings);
+        profile.memOffset = readGpuValues(settings, "memoffset", -2000, 3000, warnings);
+        profile.fanSpeed = readGpuValues(settings, "fanspeed", 0, 101, warnings);
+        settings->endGroup();
+        config->ocProfiles[group] = profile;
+    }
+
+    config->poolSSL = settings->value("SSL").toInt();
+    config->poolPort = settings->value("POOLPORT").toString();
+    config->wallet = settings->value("WALLET").toString();
+    config->worker = settings->value("WORKER").toString();
+    config->email = settings->value("EMAIL").toString();
+    int size = settings->beginReadArray("pools");
+    for(int i = 0; i < size; i++)
+    {
+        settings->setArrayIndex(i);
+        QString hostPort = settings->value("pool").toString();
+        int colon = hostPort.lastIndexOf(':');
+        bool ok = false;
+        pool p;
+        p.port = colon == -1 ? 0 : hostPort.mid(colon + 1).toUShort(&ok);
+        if(!ok || p.port == 0)
+        {
+            if(warnings)
+                *warnings << QString("pools/%1/pool=%2 is not host:port, ignored").arg(i + 1).arg(hostPort);
+            continue;
+        }
+        p.host = hostPort.left(colon);
+        p.ssl = settings->value("ssl").toBool();
+        config->pools << p;
+    }
+    settings->endArray();
+    foreach(const QString& group, settings->childGroups())
+    {
+        if(!group.startsWith("pool_"))
+            continue;
+        settings->beginGroup(group);
+        algoPool p;
+        p.poolPort = settings->value("pool").toString();
+        p.ssl = settings->value("ssl").toBool();
+        p.wallet = settings->value("wallet").toString();
+        p.worker = settings->value("worker").toString();
+        p.email = settings->value("email").toString();
+        p.currency = settings->value("currency").toString();
+        settings->endGroup();
+        if(p.poolPort.lastIndexOf(':') == -1 || p.wallet.isEmpty())
+        {
+            if(warnings)
+                *warnings << QString("%1 needs pool=host:port and wallet, ignored").arg(group);
+            continue;
+        }
+        config->algoPools[group.mid(5)] = p;
+    }
+    config->poolProbeInterval = readUInt(settings, POOLPROBEINTERVAL, 60, 5, 86400, warnings);
+
+    config->metricsPort = readUInt(settings, METRICSPORT, 0, 0, 65535, warnings);
+    config->controlSocket = settings->value(CONTROLSOCKET, "selectum-control").toString();
+    config->controlPort = readUInt(settings, CONTROLPORT, 0, 0, 65535, warnings);
+    config->proxyPort = readUInt(settings, PROXYPORT, 0, 0, 65535, warnings);
+
+    config->profitSwitch = settings->value(PROFITSWITCH).toBool();
+    config->profitFeed = settings->value(PROFITFEED, QDir::currentPath() + QDir::separator() + "profit.json").toString();
+    config->profitInterval = readUInt(settings, PROFITINTERVAL, 300, 10, 86400, warnings);
+    config->electricityCost = readDouble(settings, ELECTRICITYCOST, -1, -1, 100, warnings);
+    config->profitHysteresis = readDouble(settings, PROFITHYSTERESIS, 5, 0, 100, warnings) / 100;
+    config->profitMinDwell = readUInt(settings, PROFITMINDWELL, 15, 0, 24 * 60, warnings) * 60;
+
+    config->benchmarkWarmup = readUInt(settings, BENCHMARKWARMUP, 120, 10, 3600, warnings);
+    config->benchmarkWindow = readUInt(settings, BENCHMARKWINDOW, 300, 10, 3600, warnings);
+
+    config->fleetPort = readUInt(settings, FLEETPORT, 0, 0, 65535, warnings);
+    config->fleetKey = settings->value(FLEETKEY).toString();
+    config->rigName = settings->value(RIGNAME, QSysInfo::machineHostName()).toString();
+
+    config->logArchiveDir = settings->value(LOGARCHIVE, QDir::currentPath() + QDir::separator() + "logs").toString();
+    config->logSegmentSize = readUInt(settings, LOGSEGMENTSIZE, 8, 1, 1024, warnings);
+    config->logSegmentAge = readUInt(settings, LOGSEGMENTAGE, 24, 1, 24 * 30, warnings);
+    config->logKeepDays = readUInt(settings, LOGKEEPDAYS, 14, 0, 3650, warnings);
+
+    return config;
+}
+
+const selectumConfig::ocProfile& selectumConfig::ocProfileFor(const QString& algo) const
+{
+    static const ocProfile empty;
+    QMap<QString, ocProfile>::const_iterator it = ocProfiles.find("nvoc_" + algo);
+    if(it == ocProfiles.end())
+        it = ocProfiles.find("nvoc");
+    return it == ocProfiles.end() ? empty : it.value();
+}
+
+static configPtr _current;
+
+configPtr configStore::current()
+{
+    return std::atomic_load(&_current);
+}
+
+void configStore::publish(const configPtr& config)
+{
+    std::atomic_store(&_current, config);
+}
@@ -0,0 +1,166 @@
+#ifndef SELECTUMCONFIG_H
+#define SELECTUMCONFIG_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QMap>
+#include <memory>
+#include <climits>
+#include "anomalydetector.h"
+
+class QSettings;
+
+#define MINERPATH           "minerpath"
+#define MINERARGS           "minerargs"
+#define AUTORESTART         "autorestart"
+#define MAX0MHS             "max0mhs"
+#define RESTARTDELAY        "restartdelay"
+#define ZEROMHSDELAY        "zeromhsdelay"
+#define AUTOSTART           "autostart"
+#define DISPLAYSHAREONLY    "shareonly"
+#define DELAYNOHASH         "delaynohash"
+#define METRICSPORT         "metricsport"
+#define MAXREJECTRATIO      "maxrejectratio"
+#define ISOLATEARGS         "isolateargs"
+#define STOPGRACE           "stopgrace"
+#define STANDBY             "standby"
+#define STANDBYARGS         "standbyargs"
+#define STANDBYDELAY        "standbydelay"
+#define CONTROLSOCKET       "controlsocket"
+#define CONTROLPORT         "controlport"
+#define PROXYPORT           "proxyport"
+#define POOLPROBEINTERVAL   "poolprobeinterval"
+#define PROFITSWITCH        "profitswitch"
+#define PROFITFEED          "profitfeed"
+#define PROFITINTERVAL      "profitinterval"
+#define ELECTRICITYCOST     "electricitycost"
+#define PROFITHYSTERESIS    "profithysteresis"
+#define PROFITMINDWELL      "profitmindwell"
+#define BENCHMARKWARMUP     "benchmarkwarmup"
+#define BENCHMARKWINDOW     "benchmarkwindow"
+#define FLEETPORT           "fleetport"
+#define FLEETKEY            "fleetkey"
+#define RIGNAME             "rigname"
+#define LOGARCHIVE          "logarchive"
+#define LOGSEGMENTSIZE      "logsegmentsize"
+#define LOGSEGMENTAGE       "logsegmentage"
+#define LOGKEEPDAYS         "logkeepdays"
+
+// Everything read from selectum.ini, parsed and validated once.
+// A snapshot never changes after load(); a new one is published instead
+// and readers on any thread keep the one they took until they are done.
+class selectumConfig
+{
+public:
+    // A GPU without a key in the profile is UNSET and left as it is
+    struct ocProfile
+    {
+        static const int UNSET = INT_MIN;
+
+        QVector<int> powerLimit;    // percent
+        QVector<int> gpuOffset;     // MHz
+        QVector<int> memOffset;     // MHz
+        QVector<int> fanSpeed;      // percent, 101 = automatic
+    };
+
+    struct pool
+    {
+        QString host;
+        quint16 port;
+        bool ssl;
+        bool operator==(const pool& other) const {return host == other.host && port == other.port && ssl == other.ssl;}
+    };
+
+    // [pool_<algo>]: where another algorithm than the current one mines,
+    // for the benchmark
+    struct algoPool
+    {
+        QString poolPort;
+        bool ssl;
+        QString wallet;
+        QString worker;
+        QString email;
+        QString currency;
+    };
+
+    struct watchdogParams
+    {
+        bool autoRestart;
+        unsigned int max0mhs;
+        unsigned int restartDelay;
+        unsigned int delayBefore0mhs;
+        unsigned int delayNoHash;
+        double maxRejectRatio;      // 0..1, 0 = off
+        QString isolateArgs;
+        unsigned int stopGrace;     // seconds between terminate and kill
+        bool standby;               // keep a second, low priority miner ready
+        QString standbyArgs;        // required, a light job (few threads, one card)
+        unsigned int standbyDelay;  // seconds after the primary starts
+    };
+
+    // Invalid values are replaced by defaults and reported in warnings
+    static std::shared_ptr<const selectumConfig> load(QSettings* settings, QStringList* warnings = Q_NULLPTR);
+
+    // The profile of the algorithm ([nvoc_<algo>]), [nvoc] otherwise
+    const ocProfile& ocProfileFor(const QString& algo) const;
+
+    QString minerPath;
+    QString minerArgs;
+    bool autoStart;
+    bool shareOnly;
+    watchdogParams watchdog;
+    QList<anomalyDetector::errorRule> errorRules;
+
+    bool ocApplyOnStart;
+    QMap<QString, ocProfile> ocProfiles;
+
+    int poolSSL;
+    QString poolPort;
+    QString wallet;
+    QString worker;
+    QString email;
+    QList<pool> pools;
+    unsigned int poolProbeInterval;
+    QMap<QString, algoPool> algoPools;      // by algorithm
+
+    quint16 metricsPort;
+    QString controlSocket;
+    quint16 controlPort;
+    quint16 proxyPort;
+
+    bool profitSwitch;
+    QString profitFeed;
+    unsigned int profitInterval;
+    double electricityCost;         // per kWh, negative = from the feed
+    double profitHysteresis;        // 0..1
+    unsigned int profitMinDwell;    // seconds
+
+    unsigned int benchmarkWarmup;
+    unsigned int benchmarkWindow;
+
+    quint16 fleetPort;              // 0 = not part of a fleet
+    QString fleetKey;               // required from aggregators sending commands
+    QString rigName;
+
+    QString logArchiveDir;          // empty = miner output is not archived
+    unsigned int logSegmentSize;    // MB
+    unsigned int logSegmentAge;     // hours
+    unsigned int logKeepDays;       // 0 = forever
+
+private:
+    selectumConfig();
+};
+
+typedef std::shared_ptr<const selectumConfig> configPtr;
+
+// The current snapshot, swapped atomically
+class configStore
+{
+public:
+    static configPtr current();
+    static void publish(const configPtr& config);
+};
+
+#endif // SELECTUMCONFIG_H
@@ -0,0 +1,217 @@
+#include "shareledger.h"
+#include <QRegularExpression>
+#include <QJsonArray>
+
+shareLedger::counters::counters() : acceptedDifficulty(0)
+{
+    for(int i = 0; i < ResultCount; i++)
+        count[i] = 0;
+}
+
+shareLedger::shareLedger(unsigned int windowSec) : _windowMs((qint64)windowSec * 1000)
+                                                  , _windowStart(0)
+                                                  , _difficulty(1)
+                                                  , _lastSolutionGpu(-1)
+{
+    _clock.start();
+}
+
+const char* shareLedger::resultName(result res)
+{
+    switch(res)
+    {
+    case Accepted: return "accepted";
+    case Rejected: return "rejected";
+    case Stale:    return "stale";
+    default:       return "unknown";
+    }
+}
+
+// stratum URL from the miner command line, without scheme and credentials
+QString shareLedger::poolFromArgs(const QString& args)
+{
+    static const QRegularExpression url("stratum[^ ]*://([^ ]+)");
+    QRegularExpressionMatch match = url.match(args);
+    if(!match.hasMatch())
+        return QString();
+    QString pool = match.captured(1);
+    pool = pool.mid(pool.lastIndexOf('@') + 1);
+    return pool.section('/', 0, 0);
+}
+
+bool shareLedger::parseLine(const QString& line, result* res, int* gpu)
+{
+    static const QRegularExpression gpuId("(?:gpu|cuda-|cl-|gpu ?#)(\\d+)", QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression shareDiff("diff (\\d+(?:\\.\\d+)?)");
+    static const QRegularExpression poolDiff("difficulty[^0-9]*(\\d+(?:\\.\\d+)?) *(k|m|g|t)?", QRegularExpression::CaseInsensitiveOption);
+
+    // ethminer: "**Accepted", "**Accepted (stale)", "**Rejected"
+    // xmrig: "accepted (12/0) diff 120001", xmr-stak: "Result accepted by the pool."
+    result found = ResultCount;
+    if(line.indexOf("**Accepted") != -1 || line.indexOf("accepted (") != -1 || line.indexOf("Result accepted") != -1)
+        found = line.indexOf("stale", 0, Qt::CaseInsensitive) != -1 ? Stale : Accepted;
+    else if(line.indexOf("**Rejected") != -1 || line.indexOf("rejected (") != -1 || line.indexOf("Result rejected") != -1)
+        found = Rejected;
+
+    if(found == ResultCount)
+    {
+        if(line.indexOf("difficulty", 0, Qt::CaseInsensitive) != -1)
+        {
+            QRegularExpressionMatch match = poolDiff.match(line);
+            if(match.hasMatch())
+            {
+                double value = match.captured(1).toDouble();
+                QString unit = match.captured(2).toLower();
+                if(unit == "k") value *= 1e3;
+                else if(unit == "m") value *= 1e6;
+                else if(unit == "g") value *= 1e9;
+                else if(unit == "t") value *= 1e12;
+                if(value > 0)
+                    _difficulty = value;
+            }
+        }
+        // remember which GPU found the solution the next result refers to
+        else if(line.indexOf("sol", 0, Qt::CaseInsensitive) != -1 || line.indexOf("nonce", 0, Qt::CaseInsensitive) != -1)
+        {
+            QRegularExpressionMatch match = gpuId.match(line);
+            if(match.hasMatch())
+                _lastSolutionGpu = match.captured(1).toInt();
+        }
+        return false;
+    }
+
+    int shareGpu = _lastSolutionGpu;
+    QRegularExpressionMatch gpuMatch = gpuId.match(line);
+    if(gpuMatch.hasMatch())
+        shareGpu = gpuMatch.captured(1).toInt();
+    _lastSolutionGpu = -1;
+
+    double difficulty = _difficulty;
+    QRegularExpressionMatch diffMatch = shareDiff.match(line);
+    if(diffMatch.hasMatch())
+        difficulty = diffMatch.captured(1).toDouble();
+
+    addShare(found, shareGpu, difficulty);
+    if(res) *res = found;
+    if(gpu) *gpu = shareGpu;
+    return true;
+}
+
+void shareLedger::addShare(result res, int gpu, double difficulty)
+{
+    share s;
+    s.time = _clock.elapsed();
+    s.gpu = gpu;
+    s.res = res;
+    s.difficulty = difficulty;
+    _window.append(s);
+
+    _total.count[res]++;
+    counters& pool = _pools[_pool];
+    pool.count[res]++;
+    if(gpu >= 0)
+        _gpus[gpu].count[res]++;
+    if(res == Accepted)
+    {
+        _total.acceptedDifficulty += difficulty;
+        pool.acceptedDifficulty += difficulty;
+        if(gpu >= 0)
+            _gpus[gpu].acceptedDifficulty += difficulty;
+    }
+    prune();
+}
+
+void shareLedger::prune()
+{
+    qint64 oldest = _clock.elapsed() - _windowMs;
+    while(!_window.isEmpty() && _window.first().time < oldest)
+        _window.removeFirst();
+}
+
+unsigned int shareLedger::windowShares(int gpu)
+{
+    prune();
+    if(gpu < 0)
+        return _window.size();
+    unsigned int count = 0;
+    foreach(const share& s, _window)
+        if(s.gpu == gpu) count++;
+    return count;
+}
+
+double shareLedger::rejectRatio(int gpu)
+{
+    prune();
+    unsigned int total = 0;
+    unsigned int rejected = 0;
+    foreach(const share& s, _window)
+    {
+        if(gpu >= 0 && s.gpu != gpu)
+            continue;
+        total++;
+        if(s.res == Rejected)
+            rejected++;
+    }
+    return total ? (double)rejected / total : 0;
+}
+
+// hashes/s implied by the accepted difficulty over the window
+double shareLedger::effectiveHashrate()
+{
+    prune();
+    qint64 now = _clock.elapsed();
+    qint64 span = qMin(_windowMs, now - _windowStart);
+    if(span <= 0)
+        return 0;
+    double difficulty = 0;
+    foreach(const share& s, _window)
+        if(s.res == Accepted) difficulty += s.difficulty;
+    return difficulty * 1000.0 / span;
+}
+
+void shareLedger::resetWindow(int gpu)
+{
+    if(gpu < 0)
+    {
+        _window.clear();
+        _windowStart = _clock.elapsed();
+        return;
+    }
+    for(int i = _window.size() - 1; i >= 0; i--)
+        if(_window.at(i).gpu == gpu) _window.removeAt(i);
+}
+
+static QJsonObject countersToJson(const shareLedger::counters& c)
+{
+    QJsonObject json;
+    json["accepted"] = (double)c.count[shareLedger::Accepted];
+    json["rejected"] = (double)c.count[shareLedger::Rejected];
+    json["stale"] = (double)c.count[shareLedger::Stale];
+    json["acceptedDifficulty"] = c.acceptedDifficulty;
+    return json;
+}
+
+QJsonObject shareLedger::toJson()
+{
+    QJsonObject json = countersToJson(_total);
+    json["pool"] = _pool;
+    json["difficulty"] = _difficulty;
+    json["windowShares"] = (int)windowShares();
+    json["rejectRatio"] = rejectRatio();
+    json["effectiveHashrate"] = effectiveHashrate();
+
+    QJsonObject gpus;
+    for(QMap<int, counters>::const_iterator it = _gpus.constBegin(); it != _gpus.constEnd(); ++it)
+    {
+        QJsonObject gpu = countersToJson(it.value());
+        gpu["rejectRatio"] = rejectRatio(it.key());
+        gpus[QString::number(it.key())] = gpu;
+    }
+    json["gpus"] = gpus;
+
+    QJsonObject pools;
+    for(QMap<QString, counters>::const_iterator it = _pools.constBegin(); it != _pools.constEnd(); ++it)
+        pools[it.key()] = countersToJson(it.value());
+    json["pools"] = pools;
+    return json;
+}
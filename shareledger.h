@@ -0,0 +1,81 @@
+#ifndef SHARELEDGER_H
+#define SHARELEDGER_H
+
+#include <QString>
+#include <QMap>
+#include <QList>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+// Keeps share results per GPU and per pool, parsed from the miner output.
+// Lifetime totals never reset; ratios and the effective hashrate are
+// computed over a rolling window.
+class shareLedger
+{
+public:
+    enum result
+    {
+        Accepted = 0,
+        Rejected,
+        Stale,
+        ResultCount
+    };
+
+    struct counters
+    {
+        counters();
+        quint64 count[ResultCount];
+        double acceptedDifficulty;
+        quint64 total() const {return count[Accepted] + count[Rejected] + count[Stale];}
+    };
+
+    shareLedger(unsigned int windowSec = 15 * 60);
+
+    void setWindow(unsigned int windowSec){_windowMs = (qint64)windowSec * 1000;}
+    void setPool(const QString& pool){_pool = pool;}
+    const QString& pool() const {return _pool;}
+
+    // Feed one line of miner output; returns true if it reported a share result
+    bool parseLine(const QString& line, result* res = Q_NULLPTR, int* gpu = Q_NULLPTR);
+    void addShare(result res, int gpu, double difficulty);
+
+    const counters& total() const {return _total;}
+    counters gpuTotal(int gpu) const {return _gpus.value(gpu);}
+    QList<int> gpus() const {return _gpus.keys();}
+
+    // over the rolling window, gpu -1 means the whole rig
+    unsigned int windowShares(int gpu = -1);
+    double rejectRatio(int gpu = -1);
+    double effectiveHashrate();
+    void resetWindow(int gpu = -1);
+
+    double difficulty() const {return _difficulty;}
+    QJsonObject toJson();
+
+    static QString poolFromArgs(const QString& args);
+    static const char* resultName(result res);
+
+private:
+    struct share
+    {
+        qint64 time;
+        int gpu;
+        result res;
+        double difficulty;
+    };
+
+    void prune();
+
+    QElapsedTimer _clock;
+    qint64 _windowMs;
+    qint64 _windowStart;
+    QString _pool;
+    double _difficulty;
+    int _lastSolutionGpu;
+    counters _total;
+    QMap<int, counters> _gpus;
+    QMap<QString, counters> _pools;
+    QList<share> _window;
+};
+
+#endif // SHARELEDGER_H
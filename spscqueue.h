@@ -0,0 +1,62 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. push() never blocks: it fails when the queue is full and the
+// caller decides whether to drop. Capacity is rounded up to a power of two.
+template<typename T>
+class spscQueue
+{
+public:
+    explicit spscQueue(size_t capacity) : _head(0)
+                                        , _tail(0)
+    {
+        size_t size = 2;
+        while(size < capacity)
+            size <<= 1;
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    bool push(const T& value)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if(tail - _head.load(std::memory_order_acquire) > _mask)
+            return false;
+        _slots[tail & _mask] = value;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T* value)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if(head == _tail.load(std::memory_order_acquire))
+            return false;
+        *value = _slots[head & _mask];
+        // release the slot's copy now, not when it is overwritten
+        _slots[head & _mask] = T();
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // approximate when called from a third thread
+    size_t size() const {return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);}
+    size_t capacity() const {return _mask + 1;}
+
+private:
+    spscQueue(const spscQueue&);
+    spscQueue& operator=(const spscQueue&);
+
+    std::vector<T> _slots;
+    size_t _mask;
+    // apart so producer and consumer don't share a cache line
+    alignas(64) std::atomic<size_t> _head;
+    alignas(64) std::atomic<size_t> _tail;
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,616 @@
+#include "stratumproxy.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QSslSocket>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QTimer>
+#include <QDebug>
+#include <algorithm>
+
+#define MAX_LATENCY_SAMPLES 1024
+
+stratumProxy::stratumProxy(QObject* pParent) : QObject(pParent)
+                                              , _server(Q_NULLPTR)
+                                              , _port(0)
+                                              , _upstreamPort(0)
+                                              , _ssl(false)
+                                              , _shared(Q_NULLPTR)
+                                              , _next(Q_NULLPTR)
+                                              , _nextId(1)
+                                              , _flushScheduled(false)
+                                              , _retryTimer(new QTimer(this))
+                                              , _retryDelay(1000)
+                                              , _latencyPos(0)
+                                              , _submitted(0)
+                                              , _accepted(0)
+                                              , _rejected(0)
+{
+    _clock.start();
+    _retryTimer->setSingleShot(true);
+    connect(_retryTimer, &QTimer::timeout, this, &stratumProxy::retryUpstream);
+}
+
+stratumProxy::~stratumProxy()
+{
+    qDeleteAll(_sessions);
+    qDeleteAll(_clients);
+}
+
+bool stratumProxy::listen(quint16 port)
+{
+    _server = new QTcpServer(this);
+    connect(_server, &QTcpServer::newConnection, this, &stratumProxy::onNewConnection);
+    if(!_server->listen(QHostAddress::LocalHost, port))
+    {
+        qDebug() << "stratum proxy cannot listen on port" << port << _server->errorString();
+        return false;
+    }
+    _port = _server->serverPort();
+    return true;
+}
+
+bool stratumProxy::isSessionMethod(const QString& method)
+{
+    return method == "mining.subscribe"
+        || method == "mining.authorize"
+        || method == "mining.extranonce.subscribe"
+        || method == "login"
+        || method == "eth_submitLogin";
+}
+
+static bool isSubmitMethod(const QString& method)
+{
+    return method == "mining.submit" || method == "submit" || method == "eth_submitWork";
+}
+
+QString stratumProxy::localArgs(const QString& args, const QString& pool, quint16 localPort)
+{
+    QString local = args;
+    local.replace(pool, "127.0.0.1:" + QString::number(localPort));
+    // cryptonight takes its TLS pool with -O
+    local.replace("-O stratum+ssl://", "-o stratum://");
+    local.replace("stratum+ssl://", "stratum://");
+    return local;
+}
+
+void stratumProxy::setUpstream(const QString& host, quint16 port, bool ssl)
+{
+    if(host == _host && port == _upstreamPort && ssl == _ssl)
+    {
+        // asked again while a failed switch waits: try now
+        if(_retryTimer->isActive())
+        {
+            _retryTimer->stop();
+            retryUpstream();
+        }
+        return;
+    }
+    _host = host;
+    _upstreamPort = port;
+    _ssl = ssl;
+    _retryTimer->stop();
+    _retryDelay = 1000;
+
+    // dedicated sessions can't be moved, their miners reconnect to the new pool
+    foreach(session* s, QList<session*>(_sessions))
+    {
+        if(!s->shared)
+            destroySession(s, true);
+    }
+
+    if(!_shared || _sessionRequests.isEmpty())
+    {
+        if(_shared)
+            destroySession(_shared, true);
+        emit upstreamChanged(upstream());
+        return;
+    }
+
+    switchSession();
+}
+
+// log in on the new pool first, the miners are moved once it answered
+void stratumProxy::switchSession()
+{
+    if(_next)
+        destroySession(_next, false);
+    _next = createSession(true);
+    _next->replayPending = _sessionRequests.size();
+    foreach(const QJsonObject& request, _sessionRequests)
+        forward(_next, Q_NULLPTR, request, false);
+}
+
+void stratumProxy::retryUpstream()
+{
+    if(!_shared || _sessionRequests.isEmpty() || _shared->host == upstream())
+        return;
+    qDebug() << "stratum proxy retrying" << upstream();
+    switchSession();
+}
+
+stratumProxy::session* stratumProxy::createSession(bool shared)
+{
+    session* s = new session;
+    s->socket = new QSslSocket(this);
+    s->shared = shared;
+    s->ready = false;
+    s->host = upstream();
+    s->replayPending = 0;
+    _sessions << s;
+
+    connect(s->socket, &QSslSocket::readyRead, this, &stratumProxy::onUpstreamReadyRead);
+    connect(s->socket, &QSslSocket::disconnected, this, &stratumProxy::onUpstreamDisconnected);
+    // queued: a failed lookup may report before the session is handed out
+    connect(s->socket, static_cast<void (QAbstractSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error)
+            , this, &stratumProxy::onUpstreamError, Qt::QueuedConnection);
+    if(_ssl)
+    {
+        connect(s->socket, &QSslSocket::encrypted, this, &stratumProxy::onUpstreamConnected);
+        s->socket->connectToHostEncrypted(_host, _upstreamPort);
+    }
+    else
+    {
+        connect(s->socket, &QSslSocket::connected, this, &stratumProxy::onUpstreamConnected);
+        s->socket->connectToHost(_host, _upstreamPort);
+    }
+    return s;
+}
+
+void stratumProxy::destroySession(session* s, bool dropClients)
+{
+    foreach(client* c, s->clients)
+    {
+        c->owner = Q_NULLPTR;
+        if(dropClients)
+            c->socket->disconnectFromHost();
+    }
+    for(QMap<int, pending>::iterator it = _pending.begin(); it != _pending.end();)
+    {
+        if(it.value().s == s)
+            it = _pending.erase(it);
+        else
+            ++it;
+    }
+    s->socket->disconnect(this);
+    s->socket->abort();
+    s->socket->deleteLater();
+    _sessions.removeAll(s);
+    if(_shared == s) _shared = Q_NULLPTR;
+    if(_next == s) _next = Q_NULLPTR;
+    delete s;
+}
+
+void stratumProxy::promote(session* s)
+{
+    session* old = _shared;
+    _shared = s;
+    _next = Q_NULLPTR;
+    _retryDelay = 1000;
+    if(old)
+        destroySession(old, true);
+    emit upstreamChanged(upstream());
+}
+
+void stratumProxy::onNewConnection()
+{
+    while(_server->hasPendingConnections())
+    {
+        client* c = new client;
+        c->socket = _server->nextPendingConnection();
+        c->owner = Q_NULLPTR;
+        c->slot = 0;
+        _clients << c;
+        connect(c->socket, &QTcpSocket::readyRead, this, &stratumProxy::onClientReadyRead);
+        connect(c->socket, &QTcpSocket::disconnected, this, &stratumProxy::onClientDisconnected);
+    }
+}
+
+void stratumProxy::onClientReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    client* c = Q_NULLPTR;
+    foreach(client* candidate, _clients)
+        if(candidate->socket == socket) c = candidate;
+    if(!c)
+        return;
+
+    c->buffer += socket->readAll();
+    int end;
+    while((end = c->buffer.indexOf('\n')) != -1)
+    {
+        QJsonDocument doc = QJsonDocument::fromJson(c->buffer.left(end));
+        c->buffer.remove(0, end + 1);
+        if(doc.isObject())
+            handleClientRequest(c, doc.object());
+    }
+}
+
+void stratumProxy::onClientDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    client* c = Q_NULLPTR;
+    foreach(client* candidate, _clients)
+        if(candidate->socket == socket) c = candidate;
+    if(!c)
+        return;
+
+    for(QMap<int, pending>::iterator it = _pending.begin(); it != _pending.end(); ++it)
+        if(it.value().c == c) it.value().c = Q_NULLPTR;
+
+    session* s = c->owner;
+    if(s)
+    {
+        s->clients.removeAll(c);
+        for(QMap<QString, QList<QPair<client*, QJsonValue> > >::iterator it = s->waiters.begin(); it != s->waiters.end(); ++it)
+        {
+            for(int i = it.value().size() - 1; i >= 0; i--)
+                if(it.value().at(i).first == c) it.value().removeAt(i);
+        }
+        if(!s->shared)
+            destroySession(s, false);
+    }
+    _clients.removeAll(c);
+    socket->deleteLater();
+    delete c;
+}
+
+void stratumProxy::handleClientRequest(client* c, const QJsonObject& request)
+{
+    QString method = request.value("method").toString();
+
+    if(!c->owner)
+    {
+        if(method == "login" || method == "eth_submitLogin")
+            c->owner = createSession(false);
+        else
+        {
+            if(!_shared)
+                _shared = createSession(true);
+            c->owner = _shared;
+            // lowest free extranonce byte
+            QList<int> used;
+            foreach(client* other, _shared->clients)
+                used << other->slot;
+            while(used.contains(c->slot) && c->slot < 255)
+                c->slot++;
+        }
+        c->owner->clients << c;
+    }
+
+    session* s = c->owner;
+    if(!s->shared || !isSessionMethod(method))
+    {
+        forward(s, c, request, isSubmitMethod(method));
+        return;
+    }
+
+    QJsonValue id = request.value("id");
+    if(s->results.contains(method))
+    {
+        answerSessionRequest(c, method, id);
+        return;
+    }
+
+    bool inFlight = s->waiters.contains(method);
+    s->waiters[method] << qMakePair(c, id);
+    if(inFlight)
+        return;
+
+    bool known = false;
+    foreach(const QJsonObject& known_request, _sessionRequests)
+        if(known_request.value("method").toString() == method) known = true;
+    if(!known)
+        _sessionRequests << request;
+    forward(s, Q_NULLPTR, request, false);
+}
+
+void stratumProxy::forward(session* s, client* c, const QJsonObject& request, bool batch)
+{
+    QString method = request.value("method").toString();
+    int id = _nextId++;
+
+    pending p;
+    p.c = c;
+    p.s = s;
+    p.id = request.value("id");
+    p.method = method;
+    p.sent = _clock.elapsed();
+    _pending[id] = p;
+
+    QJsonObject out = request;
+    out["id"] = id;
+    // the miner's extranonce is ours plus its slot byte, give that byte back to the pool
+    if(c && s->shared && method == "mining.submit")
+    {
+        QJsonArray params = out.value("params").toArray();
+        if(params.size() > 2)
+        {
+            params[2] = QString("%1").arg(c->slot, 2, 16, QChar('0')) + params.at(2).toString();
+            out["params"] = params;
+        }
+    }
+
+    s->outQueue += QJsonDocument(out).toJson(QJsonDocument::Compact);
+    s->outQueue += '\n';
+    if(!s->ready)
+        return;
+
+    if(batch)
+    {
+        if(!_flushScheduled)
+        {
+            _flushScheduled = true;
+            QTimer::singleShot(2, this, SLOT(flushSubmits()));
+        }
+        return;
+    }
+    s->socket->write(s->outQueue);
+    s->outQueue.clear();
+}
+
+// Submits arriving within the same couple of milliseconds go out in one write
+void stratumProxy::flushSubmits()
+{
+    _flushScheduled = false;
+    foreach(session* s, _sessions)
+    {
+        if(s->ready && !s->outQueue.isEmpty())
+        {
+            s->socket->write(s->outQueue);
+            s->outQueue.clear();
+        }
+    }
+}
+
+void stratumProxy::onUpstreamConnected()
+{
+    foreach(session* s, _sessions)
+    {
+        if(s->socket != sender())
+            continue;
+        s->ready = true;
+        if(!s->outQueue.isEmpty())
+        {
+            s->socket->write(s->outQueue);
+            s->outQueue.clear();
+        }
+    }
+}
+
+void stratumProxy::onUpstreamDisconnected()
+{
+    foreach(session* s, QList<session*>(_sessions))
+    {
+        if(s->socket != sender())
+            continue;
+        qDebug() << "stratum proxy lost" << s->host;
+        // the miners reconnect to us and a fresh session is opened
+        destroySession(s, true);
+    }
+}
+
+// Refused, unreachable, TLS handshake failed or dropped: the socket never
+// gets (or stops being) ready and nothing queued on it would be answered
+void stratumProxy::onUpstreamError(QAbstractSocket::SocketError)
+{
+    foreach(session* s, QList<session*>(_sessions))
+    {
+        if(s->socket == sender())
+            failSession(s, s->socket->errorString());
+    }
+}
+
+void stratumProxy::failSession(session* s, const QString& reason)
+{
+    qDebug() << "stratum proxy upstream" << s->host << reason;
+
+    // stratum v1 errors are [code, message, data], the login dialect's an object
+    QJsonValue error;
+    if(s->shared)
+        error = QJsonArray() << 20 << "pool unavailable: " + reason << QJsonValue();
+    else
+    {
+        QJsonObject object;
+        object["code"] = -1;
+        object["message"] = "pool unavailable: " + reason;
+        error = object;
+    }
+    QList<QPair<client*, QJsonValue> > waiting;
+    foreach(const pending& p, _pending)
+        if(p.s == s && p.c) waiting << qMakePair(p.c, p.id);
+    foreach(const QList<QPair<client*, QJsonValue> >& waiters, s->waiters)
+        waiting << waiters;
+    for(int i = 0; i < waiting.size(); i++)
+    {
+        QJsonObject reply;
+        reply["id"] = waiting.at(i).second;
+        reply["result"] = QJsonValue();
+        reply["error"] = error;
+        sendToClient(waiting.at(i).first, reply);
+    }
+
+    if(s == _next)
+    {
+        // the miners stay on the old pool meanwhile
+        destroySession(s, false);
+        _retryTimer->start(_retryDelay);
+        _retryDelay = qMin(_retryDelay * 2, 60 * 1000);
+        return;
+    }
+    destroySession(s, true);
+}
+
+void stratumProxy::onUpstreamReadyRead()
+{
+    session* s = Q_NULLPTR;
+    foreach(session* candidate, _sessions)
+        if(candidate->socket == sender()) s = candidate;
+    if(!s)
+        return;
+
+    s->buffer += s->socket->readAll();
+    int end;
+    while((end = s->buffer.indexOf('\n')) != -1)
+    {
+        QJsonDocument doc = QJsonDocument::fromJson(s->buffer.left(end));
+        s->buffer.remove(0, end + 1);
+        if(doc.isObject())
+            handleUpstreamMessage(s, doc.object());
+        // a promotion or an error may have destroyed the session
+        if(!_sessions.contains(s))
+            return;
+    }
+}
+
+void stratumProxy::handleUpstreamMessage(session* s, const QJsonObject& message)
+{
+    QJsonValue idValue = message.value("id");
+
+    if(message.contains("method"))
+    {
+        // notification (or a request from the pool): remembered and sent to every miner
+        if(s->shared)
+            s->notifies[message.value("method").toString()] = message;
+        foreach(client* c, s->clients)
+            sendToClient(c, clientNotify(c, message));
+        return;
+    }
+
+    int id = idValue.toInt();
+    if(!_pending.contains(id))
+        return;
+    pending p = _pending.take(id);
+
+    bool failed = !message.value("error").isNull() && !message.value("error").isUndefined();
+    if(isSubmitMethod(p.method))
+    {
+        QJsonValue result = message.value("result");
+        bool accepted = !failed && (result.toBool() || result.toObject().value("status").toString() == "OK");
+        recordLatency(_clock.elapsed() - p.sent, accepted);
+    }
+
+    if(!p.c && s->shared && isSessionMethod(p.method))
+    {
+        QList<QPair<client*, QJsonValue> > waiters = s->waiters.take(p.method);
+        if(failed)
+        {
+            for(int i = 0; i < waiters.size(); i++)
+            {
+                QJsonObject reply = message;
+                reply["id"] = waiters.at(i).second;
+                sendToClient(waiters.at(i).first, reply);
+            }
+            if(s == _next)
+                destroySession(s, false);
+            return;
+        }
+        s->results[p.method] = message.value("result");
+        for(int i = 0; i < waiters.size(); i++)
+            answerSessionRequest(waiters.at(i).first, p.method, waiters.at(i).second);
+        if(s->replayPending && --s->replayPending == 0)
+            promote(s);
+        return;
+    }
+
+    if(p.c)
+    {
+        QJsonObject reply = message;
+        reply["id"] = p.id;
+        sendToClient(p.c, reply);
+    }
+}
+
+void stratumProxy::answerSessionRequest(client* c, const QString& method, const QJsonValue& id)
+{
+    session* s = c->owner;
+    QJsonObject reply;
+    reply["id"] = id;
+    reply["result"] = clientResult(c, method, s->results.value(method));
+    reply["error"] = QJsonValue();
+    sendToClient(c, reply);
+
+    // a late miner needs the current target and job right away
+    if(method == "mining.authorize")
+    {
+        foreach(const QString& notify, QStringList() << "mining.set_extranonce" << "mining.set_difficulty" << "mining.set_target" << "mining.notify")
+            if(s->notifies.contains(notify))
+                sendToClient(c, clientNotify(c, s->notifies.value(notify)));
+    }
+}
+
+QJsonValue stratumProxy::clientResult(client* c, const QString& method, const QJsonValue& result) const
+{
+    if(method != "mining.subscribe" || !result.isArray())
+        return result;
+
+    // [subscriptions, extranonce1, extranonce2_size] or EthereumStratum [subscriptions, extranonce]
+    QJsonArray array = result.toArray();
+    if(array.size() >= 2 && array.at(1).isString())
+        array[1] = array.at(1).toString() + QString("%1").arg(c->slot, 2, 16, QChar('0'));
+    if(array.size() >= 3 && array.at(2).isDouble())
+        array[2] = array.at(2).toInt() - 1;
+    return array;
+}
+
+QJsonObject stratumProxy::clientNotify(client* c, const QJsonObject& notify) const
+{
+    if(!c->owner || !c->owner->shared || notify.value("method").toString() != "mining.set_extranonce")
+        return notify;
+
+    QJsonObject out = notify;
+    QJsonArray params = out.value("params").toArray();
+    if(params.size() >= 1)
+        params[0] = params.at(0).toString() + QString("%1").arg(c->slot, 2, 16, QChar('0'));
+    if(params.size() >= 2 && params.at(1).isDouble())
+        params[1] = params.at(1).toInt() - 1;
+    out["params"] = params;
+    return out;
+}
+
+void stratumProxy::sendToClient(client* c, const QJsonObject& message)
+{
+    c->socket->write(QJsonDocument(message).toJson(QJsonDocument::Compact));
+    c->socket->write("\n");
+}
+
+void stratumProxy::recordLatency(double ms, bool accepted)
+{
+    _submitted++;
+    accepted ? _accepted++ : _rejected++;
+    if(_latencies.size() < MAX_LATENCY_SAMPLES)
+        _latencies << ms;
+    else
+        _latencies[_latencyPos] = ms;
+    _latencyPos = (_latencyPos + 1) % MAX_LATENCY_SAMPLES;
+    emit shareLatency(ms, accepted);
+}
+
+QJsonObject stratumProxy::stats() const
+{
+    QJsonObject json;
+    json["upstream"] = upstream();
+    json["clients"] = _clients.size();
+    json["sessions"] = _sessions.size();
+    json["submitted"] = (double)_submitted;
+    json["accepted"] = (double)_accepted;
+    json["rejected"] = (double)_rejected;
+
+    QList<double> sorted = _latencies;
+    std::sort(sorted.begin(), sorted.end());
+    if(!sorted.isEmpty())
+    {
+        double sum = 0;
+        foreach(double ms, sorted)
+            sum += ms;
+        QJsonObject latency;
+        latency["samples"] = sorted.size();
+        latency["mean"] = sum / sorted.size();
+        latency["min"] = sorted.first();
+        latency["p50"] = sorted.at(sorted.size() / 2);
+        latency["p95"] = sorted.at(sorted.size() * 95 / 100);
+        latency["max"] = sorted.last();
+        json["latencyMs"] = latency;
+    }
+    return json;
+}
@@ -0,0 +1,135 @@
+#ifndef STRATUMPROXY_H
+#define STRATUMPROXY_H
+
+#include <QObject>
+#include <QMap>
+#include <QList>
+#include <QStringList>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QElapsedTimer>
+#include <QAbstractSocket>
+
+class QTcpServer;
+class QTimer;
+class QTcpSocket;
+class QSslSocket;
+
+// Local stratum endpoint for the miners. Miners speaking a subscribe based
+// dialect (stratum v1, EthereumStratum/1.0.0) share one upstream session
+// per pool and get their own extranonce byte, so their work never
+// overlaps. Login based dialects (cryptonight) get a session each.
+// Submissions are written upstream in batches and their round trip is timed.
+// When the pool can't be reached the waiting miners get an error and are
+// dropped (they reconnect by themselves); a failed switch to another pool
+// is retried with a growing delay while the miners stay on the old one.
+class stratumProxy : public QObject
+{
+    Q_OBJECT
+public:
+    stratumProxy(QObject* pParent = Q_NULLPTR);
+    ~stratumProxy();
+
+    bool listen(quint16 port);
+    quint16 port() const {return _port;}
+
+    // Switching pool keeps the miners' connections until the new session is ready
+    void setUpstream(const QString& host, quint16 port, bool ssl);
+    QString upstream() const {return _host + ":" + QString::number(_upstreamPort);}
+
+    // The miner's command line pointed at the proxy on localPort instead of
+    // pool, in plain stratum: the proxy does the TLS
+    static QString localArgs(const QString& args, const QString& pool, quint16 localPort);
+
+    QJsonObject stats() const;
+
+signals:
+    void shareLatency(double ms, bool accepted);
+    void upstreamChanged(const QString& pool);
+
+private slots:
+    void onNewConnection();
+    void onClientReadyRead();
+    void onClientDisconnected();
+    void onUpstreamConnected();
+    void onUpstreamReadyRead();
+    void onUpstreamDisconnected();
+    void onUpstreamError(QAbstractSocket::SocketError error);
+    void flushSubmits();
+    void retryUpstream();
+
+private:
+    struct session;
+
+    struct client
+    {
+        QTcpSocket* socket;
+        QByteArray buffer;
+        session* owner;
+        int slot;
+    };
+
+    struct session
+    {
+        QSslSocket* socket;
+        QByteArray buffer;
+        QByteArray outQueue;
+        bool shared;
+        bool ready;
+        QString host;
+        QList<client*> clients;
+        QMap<QString, QJsonValue> results;      // session method -> result
+        QMap<QString, QJsonObject> notifies;    // last notification per method
+        QMap<QString, QList<QPair<client*, QJsonValue> > > waiters;
+        unsigned int replayPending;
+    };
+
+    struct pending
+    {
+        client* c;
+        session* s;
+        QJsonValue id;
+        QString method;
+        qint64 sent;
+    };
+
+    static bool isSessionMethod(const QString& method);
+    session* createSession(bool shared);
+    void destroySession(session* s, bool dropClients);
+    void failSession(session* s, const QString& reason);
+    void switchSession();
+    void handleClientRequest(client* c, const QJsonObject& request);
+    void handleUpstreamMessage(session* s, const QJsonObject& message);
+    void forward(session* s, client* c, const QJsonObject& request, bool batch);
+    void answerSessionRequest(client* c, const QString& method, const QJsonValue& id);
+    QJsonValue clientResult(client* c, const QString& method, const QJsonValue& result) const;
+    QJsonObject clientNotify(client* c, const QJsonObject& notify) const;
+    void sendToClient(client* c, const QJsonObject& message);
+    void recordLatency(double ms, bool accepted);
+    void promote(session* s);
+
+    QTcpServer* _server;
+    quint16 _port;
+    QString _host;
+    quint16 _upstreamPort;
+    bool _ssl;
+    session* _shared;
+    session* _next;
+    QList<session*> _sessions;
+    QList<client*> _clients;
+    QMap<int, pending> _pending;
+    QList<QJsonObject> _sessionRequests;
+    int _nextId;
+    bool _flushScheduled;
+    QElapsedTimer _clock;
+    QTimer* _retryTimer;
+    int _retryDelay;        // ms
+
+    QList<double> _latencies;
+    int _latencyPos;
+    quint64 _submitted;
+    quint64 _accepted;
+    quint64 _rejected;
+};
+
+#endif // STRATUMPROXY_H
@@ -0,0 +1,327 @@
+#include "telemetrycodec.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+#define GPU_FIELDS 5
+
+void bitWriter::writeBits(quint64 value, int count)
+{
+    for(int i = count - 1; i >= 0; i--)
+    {
+        _bits = (_bits << 1) | ((value >> i) & 1);
+        if(++_count == 8)
+        {
+            _out.append((char)_bits);
+            _bits = 0;
+            _count = 0;
+        }
+    }
+}
+
+void bitWriter::writeVarint(quint64 value)
+{
+    while(value >= 0x80)
+    {
+        writeBits((value & 0x7f) | 0x80, 8);
+        value >>= 7;
+    }
+    writeBits(value, 8);
+}
+
+QByteArray bitWriter::finish()
+{
+    if(_count)
+        _out.append((char)(_bits << (8 - _count)));
+    _bits = 0;
+    _count = 0;
+    return _out;
+}
+
+quint64 bitReader::readBits(int count)
+{
+    if(count < 0 || count > 64)
+    {
+        _failed = true;
+        return 0;
+    }
+    quint64 value = 0;
+    for(int i = 0; i < count; i++)
+    {
+        if(_pos >= (qint64)_data.size() * 8)
+        {
+            _failed = true;
+            return 0;
+        }
+        quint8 byte = _data.at(_pos / 8);
+        value = (value << 1) | ((byte >> (7 - _pos % 8)) & 1);
+        _pos++;
+    }
+    return value;
+}
+
+quint64 bitReader::readVarint()
+{
+    quint64 value = 0;
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        quint64 byte = readBits(8);
+        value |= (byte & 0x7f) << shift;
+        if(!(byte & 0x80) || _failed)
+            return value;
+    }
+    _failed = true;
+    return 0;
+}
+
+void xorFloat::write(bitWriter& out, double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    quint64 x = bits ^ _previous;
+    _previous = bits;
+    if(x == 0)
+    {
+        out.writeBit(false);
+        return;
+    }
+    out.writeBit(true);
+
+    int leading = qMin(31, (int)qCountLeadingZeroBits(x));
+    int trailing = qCountTrailingZeroBits(x);
+    if(_leading >= 0 && leading >= _leading && trailing >= _trailing)
+    {
+        out.writeBit(false);
+        out.writeBits(x >> _trailing, 64 - _leading - _trailing);
+        return;
+    }
+    int significant = 64 - leading - trailing;
+    out.writeBit(true);
+    out.writeBits(leading, 5);
+    out.writeBits(significant & 63, 6);     // 64 is written as 0
+    out.writeBits(x >> trailing, significant);
+    _leading = leading;
+    _trailing = trailing;
+}
+
+double xorFloat::read(bitReader& in)
+{
+    if(in.readBit())
+    {
+        quint64 x;
+        if(!in.readBit())
+        {
+            // the previous window, there is none yet after a reset
+            if(_leading < 0)
+            {
+                in.fail();
+                return 0;
+            }
+            x = in.readBits(64 - _leading - _trailing) << _trailing;
+        }
+        else
+        {
+            int leading = in.readBits(5);
+            int significant = in.readBits(6);
+            if(significant == 0)
+                significant = 64;
+            // a corrupt window would shift by a negative count
+            if(in.failed() || leading + significant > 64)
+            {
+                in.fail();
+                return 0;
+            }
+            _leading = leading;
+            _trailing = 64 - leading - significant;
+            x = in.readBits(significant) << _trailing;
+        }
+        _previous ^= x;
+    }
+    double value;
+    std::memcpy(&value, &_previous, sizeof(value));
+    return value;
+}
+
+static void gpuFields(const fleetProtocol::gpuSample& g, qint32* fields)
+{
+    fields[0] = g.temp;
+    fields[1] = g.fan;
+    fields[2] = g.gpuClock;
+    fields[3] = g.memClock;
+    fields[4] = g.power;
+}
+
+static void setGpuFields(fleetProtocol::gpuSample& g, const qint32* fields)
+{
+    g.temp = fields[0];
+    g.fan = fields[1];
+    g.gpuClock = fields[2];
+    g.memClock = fields[3];
+    g.power = fields[4];
+}
+
+static fleetProtocol::telemetry emptyTelemetry(int gpus)
+{
+    fleetProtocol::telemetry t;
+    t.time = 0;
+    t.minerUp = false;
+    t.hashrate = 0;
+    t.accepted = t.rejected = t.stale = 0;
+    fleetProtocol::gpuSample zero;
+    std::memset(&zero, 0, sizeof(zero));
+    t.gpus.fill(zero, gpus);
+    return t;
+}
+
+telemetryEncoder::telemetryEncoder() : _time(0)
+                                     , _delta(0)
+                                     , _sinceKey(-1)
+{
+}
+
+QByteArray telemetryEncoder::encode(const fleetProtocol::telemetry& t)
+{
+    bitWriter out;
+    bool key = _sinceKey < 0 || _sinceKey >= KEY_INTERVAL || t.gpus.size() != _last.gpus.size();
+    out.writeBits(VERSION, 8);
+    out.writeBit(key);
+    out.writeBit(t.minerUp);
+
+    if(key)
+    {
+        _last = emptyTelemetry(t.gpus.size());
+        _hashrate.reset();
+        _gpuHashrate = QVector<xorFloat>(t.gpus.size());
+        _delta = 0;
+        _sinceKey = 0;
+        out.writeVarint(t.time);
+        out.writeVarint(t.gpus.size());
+    }
+    else
+    {
+        qint64 delta = t.time - _time;
+        out.writeSigned(delta - _delta);
+        _delta = delta;
+    }
+    _time = t.time;
+
+    out.writeSigned(t.accepted - _last.accepted);
+    out.writeSigned(t.rejected - _last.rejected);
+    out.writeSigned(t.stale - _last.stale);
+    _hashrate.write(out, t.hashrate);
+
+    for(int i = 0; i < t.gpus.size(); i++)
+    {
+        qint32 current[GPU_FIELDS];
+        qint32 previous[GPU_FIELDS];
+        gpuFields(t.gpus.at(i), current);
+        gpuFields(_last.gpus.at(i), previous);
+        quint64 mask = 0;
+        for(int f = 0; f < GPU_FIELDS; f++)
+            if(current[f] != previous[f]) mask |= 1 << f;
+        out.writeBits(mask, GPU_FIELDS);
+        for(int f = 0; f < GPU_FIELDS; f++)
+            if(mask & (1 << f)) out.writeSigned((qint64)current[f] - previous[f]);
+        _gpuHashrate[i].write(out, t.gpus.at(i).hashrate);
+    }
+
+    _last = t;
+    _sinceKey++;
+    return out.finish();
+}
+
+QByteArray telemetryEncoder::encodeEvent(const fleetProtocol::event& e)
+{
+    bitWriter out;
+    out.writeBits(VERSION, 8);
+    out.writeVarint(e.time);
+    foreach(const QString& text, QStringList() << e.kind << e.text)
+    {
+        QByteArray utf8 = text.toUtf8();
+        out.writeVarint(utf8.size());
+        for(int i = 0; i < utf8.size(); i++)
+            out.writeBits((quint8)utf8.at(i), 8);
+    }
+    return out.finish();
+}
+
+telemetryDecoder::telemetryDecoder() : _synced(false)
+                                     , _time(0)
+                                     , _delta(0)
+{
+}
+
+bool telemetryDecoder::decode(const QByteArray& payload, fleetProtocol::telemetry* t)
+{
+    bitReader in(payload);
+    if(in.readBits(8) != telemetryEncoder::VERSION)
+        return false;
+    bool key = in.readBit();
+    bool minerUp = in.readBit();
+
+    if(key)
+    {
+        _time = in.readVarint();
+        // checked before narrowing: a huge varint must not wrap to a negative count
+        quint64 count = in.readVarint();
+        if(in.failed() || count > 255)
+            return _synced = false;
+        _last = emptyTelemetry((int)count);
+        _hashrate.reset();
+        _gpuHashrate = QVector<xorFloat>((int)count);
+        _delta = 0;
+        _synced = true;
+    }
+    else
+    {
+        if(!_synced)
+            return false;
+        _delta += in.readSigned();
+        _time += _delta;
+    }
+
+    fleetProtocol::telemetry next = _last;
+    next.time = _time;
+    next.minerUp = minerUp;
+    next.accepted += in.readSigned();
+    next.rejected += in.readSigned();
+    next.stale += in.readSigned();
+    next.hashrate = _hashrate.read(in);
+
+    for(int i = 0; i < next.gpus.size(); i++)
+    {
+        qint32 fields[GPU_FIELDS];
+        gpuFields(next.gpus.at(i), fields);
+        quint64 mask = in.readBits(GPU_FIELDS);
+        for(int f = 0; f < GPU_FIELDS; f++)
+            if(mask & (1 << f)) fields[f] += in.readSigned();
+        setGpuFields(next.gpus[i], fields);
+        next.gpus[i].hashrate = _gpuHashrate[i].read(in);
+    }
+
+    if(in.failed())
+        return _synced = false;
+    _last = next;
+    *t = next;
+    return true;
+}
+
+bool telemetryDecoder::decodeEvent(const QByteArray& payload, fleetProtocol::event* e)
+{
+    bitReader in(payload);
+    if(in.readBits(8) != telemetryEncoder::VERSION)
+        return false;
+    e->time = in.readVarint();
+    QString* texts[] = {&e->kind, &e->text};
+    for(int t = 0; t < 2; t++)
+    {
+        quint64 size = in.readVarint();
+        if(in.failed() || size > (quint64)payload.size())
+            return false;
+        QByteArray utf8;
+        utf8.reserve(size);
+        for(quint64 i = 0; i < size; i++)
+            utf8.append((char)in.readBits(8));
+        *texts[t] = QString::fromUtf8(utf8);
+    }
+    return !in.failed();
+}
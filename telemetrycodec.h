@@ -0,0 +1,101 @@
+#ifndef TELEMETRYCODEC_H
+#define TELEMETRYCODEC_H
+
+#include <QByteArray>
+#include <QVector>
+#include "fleetprotocol.h"
+
+class bitWriter
+{
+public:
+    bitWriter() : _bits(0), _count(0) {}
+    void writeBits(quint64 value, int count);
+    void writeBit(bool bit){writeBits(bit ? 1 : 0, 1);}
+    void writeVarint(quint64 value);
+    void writeSigned(qint64 value){writeVarint(((quint64)value << 1) ^ (quint64)(value >> 63));}
+    QByteArray finish();
+private:
+    QByteArray _out;
+    quint64 _bits;
+    int _count;
+};
+
+class bitReader
+{
+public:
+    bitReader(const QByteArray& data) : _data(data), _pos(0), _failed(false) {}
+    quint64 readBits(int count);
+    bool readBit(){return readBits(1) != 0;}
+    quint64 readVarint();
+    qint64 readSigned(){quint64 v = readVarint(); return (qint64)(v >> 1) ^ -(qint64)(v & 1);}
+    bool failed() const {return _failed;}
+    // for a decoder that finds the bits it read inconsistent
+    void fail(){_failed = true;}
+private:
+    const QByteArray _data;
+    qint64 _pos;        // in bits
+    bool _failed;
+};
+
+// Gorilla style float compression: XOR with the previous value, only the
+// meaningful bits are written, reusing the previous leading/trailing window
+class xorFloat
+{
+public:
+    xorFloat() : _previous(0), _leading(-1), _trailing(0) {}
+    void reset(){_previous = 0; _leading = -1; _trailing = 0;}
+    void write(bitWriter& out, double value);
+    double read(bitReader& in);
+private:
+    quint64 _previous;
+    int _leading;
+    int _trailing;
+};
+
+// Stateful telemetry encoding for one stream, payload of the Telemetry frame:
+//   version, flags (key frame, miner up)
+//   time: absolute on key frames, delta-of-delta otherwise
+//   share counters as varint deltas, hashrates as XOR floats
+//   per GPU a mask of the integer fields that changed and their deltas,
+//   the unchanged ones come from the per-GPU dictionary of last values
+// A key frame resets both sides; one is sent every KEY_INTERVAL samples,
+// when the GPU count changes or after reset() (a new reader joined).
+class telemetryEncoder
+{
+public:
+    static const quint8 VERSION = 2;
+    static const int KEY_INTERVAL = 300;
+
+    telemetryEncoder();
+    void reset(){_sinceKey = -1;}
+    QByteArray encode(const fleetProtocol::telemetry& t);
+    // events are rare and self-contained, they don't touch the stream state
+    static QByteArray encodeEvent(const fleetProtocol::event& e);
+
+private:
+    qint64 _time;
+    qint64 _delta;
+    int _sinceKey;
+    fleetProtocol::telemetry _last;
+    xorFloat _hashrate;
+    QVector<xorFloat> _gpuHashrate;
+};
+
+class telemetryDecoder
+{
+public:
+    telemetryDecoder();
+    // false on a version mismatch, a corrupt payload or deltas without a key frame
+    bool decode(const QByteArray& payload, fleetProtocol::telemetry* t);
+    static bool decodeEvent(const QByteArray& payload, fleetProtocol::event* e);
+
+private:
+    bool _synced;
+    qint64 _time;
+    qint64 _delta;
+    fleetProtocol::telemetry _last;
+    xorFloat _hashrate;
+    QVector<xorFloat> _gpuHashrate;
+};
+
+#endif // TELEMETRYCODEC_H
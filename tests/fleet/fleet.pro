@@ -0,0 +1,22 @@
+QT += core network testlib
+QT -= gui
+TARGET = tst_fleet
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../.. $$PWD/../../aggregator
+
+SOURCES += \
+    tst_fleet.cpp \
+    ../../fleetprotocol.cpp \
+    ../../telemetrycodec.cpp \
+    ../../controlserver.cpp \
+    ../../aggregator/fleetaggregator.cpp
+
+HEADERS += \
+    ../../fleetprotocol.h \
+    ../../telemetrycodec.h \
+    ../../controlserver.h \
+    ../../aggregator/fleetaggregator.h
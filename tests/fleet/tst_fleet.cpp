@@ -0,0 +1,296 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QDateTime>
+#include <QJsonArray>
+#include "fleetprotocol.h"
+#include "telemetrycodec.h"
+#include "controlserver.h"
+#include "fleetaggregator.h"
+
+// A rig on localhost: says hello, streams what it is given and keeps
+// the commands it receives
+class mockRig : public QObject
+{
+    Q_OBJECT
+public:
+    mockRig() : _socket(Q_NULLPTR)
+    {
+        connect(&_server, &QTcpServer::newConnection, this, &mockRig::onNewConnection);
+        _server.listen(QHostAddress::LocalHost);
+    }
+
+    quint16 port() const {return _server.serverPort();}
+    bool connected() const {return _socket && _socket->state() == QAbstractSocket::ConnectedState;}
+    const QList<fleetProtocol::command>& commands() const {return _commands;}
+
+    void send(fleetProtocol::messageType type, const QByteArray& payload)
+    {
+        _socket->write(fleetProtocol::frame(type, payload));
+    }
+
+    void sendTelemetry(const fleetProtocol::telemetry& t)
+    {
+        send(fleetProtocol::Telemetry, _encoder.encode(t));
+    }
+
+private slots:
+    void onNewConnection()
+    {
+        _socket = _server.nextPendingConnection();
+        connect(_socket, &QTcpSocket::readyRead, this, &mockRig::onReadyRead);
+        fleetProtocol::hello h;
+        h.name = "rig1";
+        h.version = fleetProtocol::VERSION;
+        h.algo = "ethash";
+        h.pool = "pool.example:4444";
+        send(fleetProtocol::Hello, fleetProtocol::encodeHello(h));
+    }
+
+    void onReadyRead()
+    {
+        _buffer += _socket->readAll();
+        fleetProtocol::messageType type;
+        QByteArray payload;
+        bool error = false;
+        while(fleetProtocol::nextFrame(_buffer, &type, &payload, &error))
+        {
+            fleetProtocol::command c;
+            if(type == fleetProtocol::Command && fleetProtocol::decodeCommand(payload, &c))
+                _commands << c;
+        }
+    }
+
+private:
+    QTcpServer _server;
+    QTcpSocket* _socket;
+    QByteArray _buffer;
+    telemetryEncoder _encoder;
+    QList<fleetProtocol::command> _commands;
+};
+
+class tst_fleet : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void frames();
+    void corruptFrame();
+    void messages();
+    void beacon();
+    void seriesMinutes();
+    void aggregatesRigs();
+
+private:
+    static fleetProtocol::telemetry sample(qint64 time, double perGpu);
+};
+
+fleetProtocol::telemetry tst_fleet::sample(qint64 time, double perGpu)
+{
+    fleetProtocol::telemetry t;
+    t.time = time;
+    t.minerUp = true;
+    t.hashrate = 2 * perGpu;
+    t.accepted = 10;
+    t.rejected = 1;
+    t.stale = 1;
+    for(int i = 0; i < 2; i++)
+    {
+        fleetProtocol::gpuSample g;
+        g.temp = 60 + i * 5;
+        g.fan = 50;
+        g.gpuClock = 1500;
+        g.memClock = 4000;
+        g.power = 100000;
+        g.hashrate = perGpu;
+        t.gpus << g;
+    }
+    return t;
+}
+
+void tst_fleet::frames()
+{
+    QByteArray stream = fleetProtocol::frame(fleetProtocol::Event, "first")
+                      + fleetProtocol::frame(fleetProtocol::Telemetry, QByteArray());
+    fleetProtocol::messageType type;
+    QByteArray payload;
+    bool error = false;
+
+    // a frame arriving a byte at a time is only taken once complete
+    QByteArray buffer;
+    for(int i = 0; i < 9; i++)
+    {
+        buffer += stream.at(i);
+        QVERIFY(!fleetProtocol::nextFrame(buffer, &type, &payload, &error));
+        QVERIFY(!error);
+    }
+    buffer += stream.mid(9);
+    QVERIFY(fleetProtocol::nextFrame(buffer, &type, &payload, &error));
+    QCOMPARE(type, fleetProtocol::Event);
+    QCOMPARE(payload, QByteArray("first"));
+    QVERIFY(fleetProtocol::nextFrame(buffer, &type, &payload, &error));
+    QCOMPARE(type, fleetProtocol::Telemetry);
+    QVERIFY(payload.isEmpty());
+    QVERIFY(buffer.isEmpty());
+    QVERIFY(!fleetProtocol::nextFrame(buffer, &type, &payload, &error));
+    QVERIFY(!error);
+}
+
+void tst_fleet::corruptFrame()
+{
+    fleetProtocol::messageType type;
+    QByteArray payload;
+    bool error = false;
+
+    QByteArray empty("\0\0\0\0", 4);
+    QVERIFY(!fleetProtocol::nextFrame(empty, &type, &payload, &error));
+    QVERIFY(error);
+
+    QByteArray huge("\x7f\xff\xff\xff", 4);
+    QVERIFY(!fleetProtocol::nextFrame(huge, &type, &payload, &error));
+    QVERIFY(error);
+}
+
+void tst_fleet::messages()
+{
+    fleetProtocol::hello h;
+    h.name = "rig1";
+    h.version = fleetProtocol::VERSION;
+    h.key = "secret";
+    h.algo = "cryptonight";
+    h.pool = "pool.example:3333";
+    fleetProtocol::hello decoded;
+    QVERIFY(fleetProtocol::decodeHello(fleetProtocol::encodeHello(h), &decoded));
+    QCOMPARE(decoded.name, h.name);
+    QCOMPARE(decoded.version, h.version);
+    QCOMPARE(decoded.key, h.key);
+    QCOMPARE(decoded.algo, h.algo);
+    QCOMPARE(decoded.pool, h.pool);
+    QVERIFY(!fleetProtocol::decodeHello(QByteArray("\0\2", 2), &decoded));
+
+    fleetProtocol::command c;
+    c.id = 42;
+    c.method = "oc.apply";
+    c.params["powerlimit"] = 80;
+    fleetProtocol::command command;
+    QVERIFY(fleetProtocol::decodeCommand(fleetProtocol::encodeCommand(c), &command));
+    QCOMPARE(command.id, c.id);
+    QCOMPARE(command.method, c.method);
+    QCOMPARE(command.params, c.params);
+
+    c.result["result"] = true;
+    c.error = "busy";
+    fleetProtocol::command result;
+    QVERIFY(fleetProtocol::decodeCommandResult(fleetProtocol::encodeCommandResult(c), &result));
+    QCOMPARE(result.id, c.id);
+    QCOMPARE(result.result, c.result);
+    QCOMPARE(result.error, c.error);
+
+    fleetProtocol::event e;
+    e.time = 1500000000000LL;
+    e.kind = "xid";
+    e.text = "GPU 1 fell off the bus";
+    fleetProtocol::event event;
+    QVERIFY(telemetryDecoder::decodeEvent(telemetryEncoder::encodeEvent(e), &event));
+    QCOMPARE(event.time, e.time);
+    QCOMPARE(event.kind, e.kind);
+    QCOMPARE(event.text, e.text);
+}
+
+void tst_fleet::beacon()
+{
+    QString name;
+    quint16 port = 0;
+    QVERIFY(fleetProtocol::parseBeacon(fleetProtocol::beacon("rig one", 45460), &name, &port));
+    QCOMPARE(name, QString("rig one"));
+    QCOMPARE(port, quint16(45460));
+    QVERIFY(!fleetProtocol::parseBeacon("SELECTUM 2 0 rig", &name, &port));
+    QVERIFY(!fleetProtocol::parseBeacon("SELECTUM 2 45460", &name, &port));
+    QVERIFY(!fleetProtocol::parseBeacon("M-SEARCH * HTTP/1.1", &name, &port));
+}
+
+void tst_fleet::seriesMinutes()
+{
+    fleetSeries series;
+    qint64 start = 1500000000000LL / 60000 * 60000;
+    // two full minutes, the third one only started
+    for(int s = 0; s <= 120; s++)
+    {
+        fleetSeries::point p;
+        p.time = start + s * 1000;
+        p.hashrate = s < 60 ? 100 : 200;
+        p.power = s < 60 ? 10 : 30;
+        p.maxTemp = s == 30 ? 80 : 60;
+        p.accepted = s;
+        p.rejected = 0;
+        series.add(p);
+    }
+    QCOMPARE(series.seconds().size(), 121);
+    QCOMPARE(series.seconds().last().time, start + 120000);
+
+    QList<fleetSeries::point> minutes = series.minutes();
+    QCOMPARE(minutes.size(), 2);
+    QCOMPARE(minutes.at(0).time, start);
+    QCOMPARE(minutes.at(0).hashrate, 100.0);
+    QCOMPARE(minutes.at(0).power, 10.0);
+    QCOMPARE(minutes.at(0).maxTemp, 80);
+    QCOMPARE(minutes.at(0).accepted, quint64(59));
+    QCOMPARE(minutes.at(1).time, start + 60000);
+    QCOMPARE(minutes.at(1).hashrate, 200.0);
+    QCOMPARE(minutes.at(1).maxTemp, 60);
+}
+
+void tst_fleet::aggregatesRigs()
+{
+    mockRig rig;
+    controlServer control;
+    fleetAggregator fleet(&control);
+    fleet.addRig("127.0.0.1", rig.port());
+    QTRY_VERIFY(rig.connected());
+
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    rig.sendTelemetry(sample(now, 15e6));
+    rig.sendTelemetry(sample(now + 1000, 16e6));
+
+    QString error;
+    QJsonObject rigs;
+    QTRY_VERIFY((rigs = control.call("fleet.rigs", QJsonObject(), &error).toObject())
+                .value("hashrate").toDouble() == 32e6);
+    QJsonObject r = rigs.value("rigs").toArray().at(0).toObject();
+    QCOMPARE(r.value("name").toString(), QString("rig1"));
+    QCOMPARE(r.value("algo").toString(), QString("ethash"));
+    QCOMPARE(r.value("connected").toBool(), true);
+    QCOMPARE(r.value("gpus").toInt(), 2);
+
+    QJsonObject params;
+    params["rig"] = "rig1";
+    QJsonArray gpus = control.call("fleet.gpus", params, &error).toArray();
+    QCOMPARE(gpus.size(), 2);
+    QCOMPARE(gpus.at(1).toObject().value("temp").toInt(), 65);
+    QCOMPARE(gpus.at(1).toObject().value("power").toDouble(), 100.0);
+
+    // one point a second, the GPU powers summed in W
+    params["resolution"] = "second";
+    QJsonArray series = control.call("fleet.series", params, &error).toArray();
+    QCOMPARE(series.size(), 2);
+    QCOMPARE(series.at(1).toObject().value("hashrate").toDouble(), 32e6);
+    QCOMPARE(series.at(1).toObject().value("power").toDouble(), 200.0);
+    QCOMPARE(series.at(1).toObject().value("maxTemp").toInt(), 65);
+
+    params = QJsonObject();
+    params["rig"] = "*";
+    params["method"] = "miner.restart";
+    QJsonArray sent = control.call("fleet.command", params, &error).toArray();
+    QCOMPARE(sent.size(), 1);
+    QTRY_COMPARE(rig.commands().size(), 1);
+    QCOMPARE(rig.commands().first().method, QString("miner.restart"));
+    QCOMPARE((double)rig.commands().first().id, sent.at(0).toObject().value("id").toDouble());
+
+    params = QJsonObject();
+    params["rig"] = "nowhere";
+    control.call("fleet.gpus", params, &error);
+    QCOMPARE(error, QString("unknown rig"));
+}
+
+QTEST_GUILESS_MAIN(tst_fleet)
+#include "tst_fleet.moc"
@@ -0,0 +1,19 @@
+QT += core testlib
+QT -= gui
+TARGET = tst_logarchive
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    tst_logarchive.cpp \
+    ../../logarchive.cpp \
+    ../../logsearch.cpp
+
+HEADERS += \
+    ../../logarchive.h \
+    ../../logsearch.h \
+    ../../spscqueue.h
@@ -0,0 +1,158 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include "logarchive.h"
+#include "logsearch.h"
+
+class tst_logArchive : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void truncatedFinalBlock();
+
+private:
+    // "line<n>" then enough filler for a few lines to fill a block
+    static QString text(int n);
+    static void write(const QString& dir, int from, int count);
+    static QStringList lines(const QByteArray& block);
+    static QList<logArchive::blockEntry> allBlocks(const QString& dir);
+    static logSearch::query find(const QString& term);
+};
+
+QString tst_logArchive::text(int n)
+{
+    return QString("line%1 ").arg(n, 4, 10, QChar('0')) + QString(1000, '.');
+}
+
+// One archive writer from start to stop, as a miner run would
+void tst_logArchive::write(const QString& dir, int from, int count)
+{
+    logArchive archive(dir);
+    archive.start();
+    for(int n = from; n < from + count; n++)
+        archive.append(text(n));
+    archive.stop();
+    QVERIFY(archive.wait(10000));
+    QCOMPARE(archive.dropped(), quint64(0));
+}
+
+QStringList tst_logArchive::lines(const QByteArray& block)
+{
+    QStringList list;
+    foreach(const QByteArray& line, block.split('\n'))
+    {
+        int tab = line.indexOf('\t');
+        if(tab != -1)
+            list << QString::fromUtf8(line.mid(tab + 1));
+    }
+    return list;
+}
+
+QList<logArchive::blockEntry> tst_logArchive::allBlocks(const QString& dir)
+{
+    QList<logArchive::blockEntry> blocks;
+    foreach(const logArchive::segment& s, logArchive::segments(dir))
+        blocks << s.blocks;
+    return blocks;
+}
+
+logSearch::query tst_logArchive::find(const QString& term)
+{
+    logSearch::query q;
+    q.terms << term;
+    q.from = 0;
+    q.to = 0;
+    q.limit = 0;
+    return q;
+}
+
+void tst_logArchive::roundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    write(dir.path(), 0, 150);
+    // reopened: the new blocks follow the old ones, in the same segment or the next
+    write(dir.path(), 150, 10);
+
+    QStringList expected;
+    for(int n = 0; n < 160; n++)
+        expected << text(n);
+
+    QStringList decoded;
+    int blocks = 0;
+    foreach(const logArchive::segment& s, logArchive::segments(dir.path()))
+    {
+        QFile file(s.path);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QFile tok(s.path.left(s.path.length() - 5) + ".tok");
+        QVERIFY(tok.open(QIODevice::ReadOnly));
+        QByteArray filters = tok.readAll();
+        QCOMPARE(filters.size(), s.blocks.size() * logSearch::FILTER_BYTES);
+
+        for(int b = 0; b < s.blocks.size(); b++)
+        {
+            const logArchive::blockEntry& entry = s.blocks.at(b);
+            QByteArray data = logArchive::readBlock(file, entry);
+            QCOMPARE((quint32)data.size(), entry.rawSize);
+            QStringList blockLines = lines(data);
+            QCOMPARE((quint32)blockLines.size(), entry.lines);
+            QVERIFY(entry.first <= entry.last);
+            // the block's filter holds every token of its lines
+            QByteArray filter = filters.mid(b * logSearch::FILTER_BYTES, logSearch::FILTER_BYTES);
+            foreach(const QString& line, blockLines)
+                foreach(const QString& token, logSearch::tokens(line))
+                    QVERIFY2(logSearch::mayContain(filter, token), qPrintable(token));
+            decoded << blockLines;
+            blocks++;
+        }
+    }
+    QVERIFY(blocks >= 3);
+    QCOMPARE(decoded, expected);
+
+    // a lookup only decompresses the blocks whose filter lets the term through
+    logSearch::stats st;
+    QList<logSearch::match> matches = logSearch::search(dir.path(), find("line0077"), &st);
+    QCOMPARE(matches.size(), 1);
+    QCOMPARE(matches.first().line, text(77));
+    QCOMPARE(st.blocks, blocks);
+    QVERIFY(st.decompressed < st.blocks);
+    QVERIFY(logSearch::search(dir.path(), find("line0155")).size() == 1);
+    QVERIFY(logSearch::search(dir.path(), find("line0999")).isEmpty());
+}
+
+void tst_logArchive::truncatedFinalBlock()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    write(dir.path(), 0, 150);
+
+    QList<logArchive::segment> segments = logArchive::segments(dir.path());
+    QCOMPARE(segments.size(), 1);
+    const logArchive::segment& s = segments.first();
+    QVERIFY(s.blocks.size() >= 2);
+    const logArchive::blockEntry last = s.blocks.last();
+
+    // a crash in the middle of the last block, and of the next index entry
+    QVERIFY(QFile::resize(s.path, last.offset + 20));
+    QFile idx(s.path.left(s.path.length() - 5) + ".idx");
+    QVERIFY(idx.open(QIODevice::Append));
+    idx.write(QByteArray(10, '\x01'));
+    idx.close();
+
+    QList<logArchive::blockEntry> blocks = allBlocks(dir.path());
+    QCOMPARE(blocks.size(), s.blocks.size());
+    QFile file(s.path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QVERIFY(logArchive::readBlock(file, blocks.last()).isEmpty());
+    QStringList first = lines(logArchive::readBlock(file, blocks.first()));
+    QCOMPARE((quint32)first.size(), blocks.first().lines);
+    QCOMPARE(first.first(), text(0));
+
+    // the whole blocks are still found, the cut one is skipped
+    QCOMPARE(logSearch::search(dir.path(), find("line0000")).size(), 1);
+    QVERIFY(logSearch::search(dir.path(), find("line0149")).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_logArchive)
+#include "tst_logarchive.moc"
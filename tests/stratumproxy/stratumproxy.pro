@@ -0,0 +1,16 @@
+QT += core network testlib
+QT -= gui
+TARGET = tst_stratumproxy
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    tst_stratumproxy.cpp \
+    ../../stratumproxy.cpp
+
+HEADERS += \
+    ../../stratumproxy.h
@@ -0,0 +1,302 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include "stratumproxy.h"
+
+// Stratum v1 pool on localhost: extranonce1 "abcd" with 4 bytes of
+// extranonce2, one job after authorize, every share accepted
+class mockPool : public QObject
+{
+    Q_OBJECT
+public:
+    mockPool() : _connections(0)
+    {
+        connect(&_server, &QTcpServer::newConnection, this, &mockPool::onNewConnection);
+        _server.listen(QHostAddress::LocalHost);
+    }
+
+    quint16 port() const {return _server.serverPort();}
+    int connections() const {return _connections;}
+    const QList<QJsonObject>& requests() const {return _requests;}
+
+    QJsonObject lastRequest(const QString& method) const
+    {
+        for(int i = _requests.size() - 1; i >= 0; i--)
+            if(_requests.at(i).value("method").toString() == method)
+                return _requests.at(i);
+        return QJsonObject();
+    }
+
+private slots:
+    void onNewConnection()
+    {
+        while(_server.hasPendingConnections())
+        {
+            QTcpSocket* socket = _server.nextPendingConnection();
+            _connections++;
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket](){onReadyRead(socket);});
+        }
+    }
+
+private:
+    void onReadyRead(QTcpSocket* socket)
+    {
+        while(socket->canReadLine())
+        {
+            QJsonObject request = QJsonDocument::fromJson(socket->readLine()).object();
+            _requests << request;
+            QString method = request.value("method").toString();
+
+            QJsonObject reply;
+            reply["id"] = request.value("id");
+            reply["error"] = QJsonValue();
+            if(method == "mining.subscribe")
+                reply["result"] = QJsonArray() << QJsonArray() << "abcd" << 4;
+            else if(method == "mining.authorize" || method == "mining.submit")
+                reply["result"] = true;
+            else
+            {
+                reply["result"] = QJsonValue();
+                reply["error"] = QJsonArray() << 20 << "unsupported" << QJsonValue();
+            }
+            write(socket, reply);
+
+            if(method == "mining.authorize")
+            {
+                QJsonObject notify;
+                notify["id"] = QJsonValue();
+                notify["method"] = "mining.notify";
+                notify["params"] = QJsonArray() << "job1";
+                write(socket, notify);
+            }
+        }
+    }
+
+    void write(QTcpSocket* socket, const QJsonObject& message)
+    {
+        socket->write(QJsonDocument(message).toJson(QJsonDocument::Compact) + "\n");
+    }
+
+    QTcpServer _server;
+    int _connections;
+    QList<QJsonObject> _requests;
+};
+
+// A miner connected to the proxy
+class mockMiner
+{
+public:
+    explicit mockMiner(quint16 port) : _nextId(1)
+    {
+        _socket.connectToHost(QHostAddress::LocalHost, port);
+    }
+
+    bool connected() {return _socket.state() == QAbstractSocket::ConnectedState;}
+
+    int send(const QString& method, const QJsonArray& params)
+    {
+        QJsonObject request;
+        request["id"] = _nextId;
+        request["method"] = method;
+        request["params"] = params;
+        _socket.write(QJsonDocument(request).toJson(QJsonDocument::Compact) + "\n");
+        return _nextId++;
+    }
+
+    // the message received with this id, or the notification with this
+    // method; an empty object until it arrived
+    QJsonObject received(int id, const QString& method = QString())
+    {
+        while(_socket.canReadLine())
+            _messages << QJsonDocument::fromJson(_socket.readLine()).object();
+        foreach(const QJsonObject& message, _messages)
+        {
+            if(method.isEmpty() ? message.value("id").toInt(-1) == id : message.value("method").toString() == method)
+                return message;
+        }
+        return QJsonObject();
+    }
+
+private:
+    QTcpSocket _socket;
+    int _nextId;
+    QList<QJsonObject> _messages;
+};
+
+class tst_stratumProxy : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void localArgs_data();
+    void localArgs();
+    void relaysToPool();
+    void sharesOneSession();
+    void switchesUpstream();
+    void answersWhenPoolDown();
+    void staysWhenSwitchFails();
+
+private:
+    static quint16 closedPort();
+};
+
+void tst_stratumProxy::localArgs_data()
+{
+    QTest::addColumn<QString>("args");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("cryptonight ssl")
+        << "-O stratum+ssl://pool.example:3333 -u wallet --currency monero7 -i 0 -p '' -r ''"
+        << "-o stratum://127.0.0.1:4444 -u wallet --currency monero7 -i 0 -p '' -r ''";
+    QTest::newRow("cryptonight")
+        << "-o stratum://pool.example:3333 -u wallet --currency monero7"
+        << "-o stratum://127.0.0.1:4444 -u wallet --currency monero7";
+    QTest::newRow("ethash ssl")
+        << "-P stratum+ssl://wallet.rig@pool.example:3333"
+        << "-P stratum://wallet.rig@127.0.0.1:4444";
+}
+
+void tst_stratumProxy::localArgs()
+{
+    QFETCH(QString, args);
+    QFETCH(QString, expected);
+    QCOMPARE(stratumProxy::localArgs(args, "pool.example:3333", 4444), expected);
+}
+
+void tst_stratumProxy::relaysToPool()
+{
+    mockPool pool;
+    stratumProxy proxy;
+    QVERIFY(proxy.listen(0));
+    QSignalSpy latency(&proxy, &stratumProxy::shareLatency);
+    proxy.setUpstream("127.0.0.1", pool.port(), false);
+
+    mockMiner miner(proxy.port());
+    QTRY_VERIFY(miner.connected());
+
+    int subscribe = miner.send("mining.subscribe", QJsonArray() << "test/1.0");
+    QTRY_VERIFY(!miner.received(subscribe).isEmpty());
+    // the miner gets one byte of the pool's extranonce2 as its own extranonce1
+    QJsonArray result = miner.received(subscribe).value("result").toArray();
+    QCOMPARE(result.at(1).toString(), QString("abcd00"));
+    QCOMPARE(result.at(2).toInt(), 3);
+
+    int authorize = miner.send("mining.authorize", QJsonArray() << "wallet.rig" << "x");
+    QTRY_VERIFY(!miner.received(authorize).isEmpty());
+    QCOMPARE(miner.received(authorize).value("result").toBool(), true);
+    QTRY_VERIFY(!miner.received(-1, "mining.notify").isEmpty());
+
+    int submit = miner.send("mining.submit", QJsonArray() << "wallet.rig" << "job1" << "000000" << "5b000000" << "00000001");
+    QTRY_VERIFY(!miner.received(submit).isEmpty());
+    QCOMPARE(miner.received(submit).value("result").toBool(), true);
+    // the pool sees the full extranonce2, the miner's byte first
+    QCOMPARE(pool.lastRequest("mining.submit").value("params").toArray().at(2).toString(), QString("00000000"));
+
+    QCOMPARE(latency.count(), 1);
+    QCOMPARE(latency.at(0).at(1).toBool(), true);
+    QJsonObject stats = proxy.stats();
+    QCOMPARE(stats.value("accepted").toInt(), 1);
+    QCOMPARE(stats.value("rejected").toInt(), 0);
+}
+
+void tst_stratumProxy::sharesOneSession()
+{
+    mockPool pool;
+    stratumProxy proxy;
+    QVERIFY(proxy.listen(0));
+    proxy.setUpstream("127.0.0.1", pool.port(), false);
+
+    mockMiner first(proxy.port());
+    mockMiner second(proxy.port());
+    QTRY_VERIFY(first.connected() && second.connected());
+
+    int firstId = first.send("mining.subscribe", QJsonArray());
+    QTRY_VERIFY(!first.received(firstId).isEmpty());
+    int secondId = second.send("mining.subscribe", QJsonArray());
+    QTRY_VERIFY(!second.received(secondId).isEmpty());
+
+    QCOMPARE(pool.connections(), 1);
+    QCOMPARE(first.received(firstId).value("result").toArray().at(1).toString(), QString("abcd00"));
+    QCOMPARE(second.received(secondId).value("result").toArray().at(1).toString(), QString("abcd01"));
+}
+
+void tst_stratumProxy::switchesUpstream()
+{
+    mockPool oldPool;
+    mockPool newPool;
+    stratumProxy proxy;
+    QVERIFY(proxy.listen(0));
+    QSignalSpy changed(&proxy, &stratumProxy::upstreamChanged);
+    proxy.setUpstream("127.0.0.1", oldPool.port(), false);
+    QCOMPARE(changed.count(), 1);
+
+    mockMiner miner(proxy.port());
+    QTRY_VERIFY(miner.connected());
+    int subscribe = miner.send("mining.subscribe", QJsonArray());
+    QTRY_VERIFY(!miner.received(subscribe).isEmpty());
+    int authorize = miner.send("mining.authorize", QJsonArray() << "wallet.rig" << "x");
+    QTRY_VERIFY(!miner.received(authorize).isEmpty());
+
+    // the new pool gets the same login before the upstream is reported moved
+    proxy.setUpstream("127.0.0.1", newPool.port(), false);
+    QTRY_COMPARE(changed.count(), 2);
+    QCOMPARE(changed.at(1).at(0).toString(), "127.0.0.1:" + QString::number(newPool.port()));
+    QCOMPARE(newPool.lastRequest("mining.authorize").value("params").toArray().at(0).toString(), QString("wallet.rig"));
+    QCOMPARE(proxy.upstream(), "127.0.0.1:" + QString::number(newPool.port()));
+}
+
+// a port nothing listens on
+quint16 tst_stratumProxy::closedPort()
+{
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost);
+    quint16 port = server.serverPort();
+    server.close();
+    return port;
+}
+
+void tst_stratumProxy::answersWhenPoolDown()
+{
+    stratumProxy proxy;
+    QVERIFY(proxy.listen(0));
+    proxy.setUpstream("127.0.0.1", closedPort(), false);
+
+    mockMiner miner(proxy.port());
+    QTRY_VERIFY(miner.connected());
+    int subscribe = miner.send("mining.subscribe", QJsonArray());
+    // an error instead of silence, then the miner is let go to reconnect
+    QTRY_VERIFY(!miner.received(subscribe).isEmpty());
+    QVERIFY(miner.received(subscribe).value("error").isArray());
+    QTRY_VERIFY(!miner.connected());
+}
+
+void tst_stratumProxy::staysWhenSwitchFails()
+{
+    mockPool pool;
+    stratumProxy proxy;
+    QVERIFY(proxy.listen(0));
+    QSignalSpy changed(&proxy, &stratumProxy::upstreamChanged);
+    proxy.setUpstream("127.0.0.1", pool.port(), false);
+
+    mockMiner miner(proxy.port());
+    QTRY_VERIFY(miner.connected());
+    int subscribe = miner.send("mining.subscribe", QJsonArray());
+    QTRY_VERIFY(!miner.received(subscribe).isEmpty());
+    int authorize = miner.send("mining.authorize", QJsonArray() << "wallet.rig" << "x");
+    QTRY_VERIFY(!miner.received(authorize).isEmpty());
+
+    proxy.setUpstream("127.0.0.1", closedPort(), false);
+    QTest::qWait(500);
+    // still mining on the old pool
+    QVERIFY(miner.connected());
+    QCOMPARE(changed.count(), 1);
+    int submit = miner.send("mining.submit", QJsonArray() << "wallet.rig" << "job1" << "000000" << "5b000000" << "00000001");
+    QTRY_VERIFY(!miner.received(submit).isEmpty());
+    QCOMPARE(miner.received(submit).value("result").toBool(), true);
+}
+
+QTEST_GUILESS_MAIN(tst_stratumProxy)
+#include "tst_stratumproxy.moc"
@@ -0,0 +1,17 @@
+QT += core testlib
+QT -= gui
+TARGET = tst_telemetrycodec
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += \
+    tst_telemetrycodec.cpp \
+    ../../telemetrycodec.cpp
+
+HEADERS += \
+    ../../telemetrycodec.h \
+    ../../fleetprotocol.h
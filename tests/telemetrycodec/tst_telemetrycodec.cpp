@@ -0,0 +1,196 @@
+#include <QtTest>
+#include "telemetrycodec.h"
+
+class tst_telemetryCodec : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void keyAndDeltaFrames();
+    void gpuCountChange();
+    void deltaWithoutKey();
+    void truncatedPayload();
+    void gpuCountOver255();
+    void corruptFloatWindow();
+
+private:
+    static fleetProtocol::telemetry sample(qint64 time, int gpus, int step);
+    static void compare(const fleetProtocol::telemetry& actual, const fleetProtocol::telemetry& expected);
+    static QByteArray keyHeader(quint64 gpus);
+};
+
+// A rig's sample with a bit of everything moving
+fleetProtocol::telemetry tst_telemetryCodec::sample(qint64 time, int gpus, int step)
+{
+    fleetProtocol::telemetry t;
+    t.time = time;
+    t.minerUp = step % 3 != 2;
+    t.hashrate = 31.25e6 + step * 1234.5;
+    t.accepted = 100 + step * 2;
+    t.rejected = step / 4;
+    t.stale = 1;
+    for(int i = 0; i < gpus; i++)
+    {
+        fleetProtocol::gpuSample g;
+        g.temp = 60 + i + step % 2;
+        g.fan = 70;
+        g.gpuClock = 1500 + 15 * step;
+        g.memClock = 4000;
+        g.power = 120000 - 250 * step * i;
+        g.hashrate = i == 1 ? 0 : 15.6e6 + step * 0.1;
+        t.gpus << g;
+    }
+    return t;
+}
+
+void tst_telemetryCodec::compare(const fleetProtocol::telemetry& actual, const fleetProtocol::telemetry& expected)
+{
+    QCOMPARE(actual.time, expected.time);
+    QCOMPARE(actual.minerUp, expected.minerUp);
+    QCOMPARE(actual.hashrate, expected.hashrate);
+    QCOMPARE(actual.accepted, expected.accepted);
+    QCOMPARE(actual.rejected, expected.rejected);
+    QCOMPARE(actual.stale, expected.stale);
+    QCOMPARE(actual.gpus.size(), expected.gpus.size());
+    for(int i = 0; i < expected.gpus.size(); i++)
+    {
+        QCOMPARE(actual.gpus.at(i).temp, expected.gpus.at(i).temp);
+        QCOMPARE(actual.gpus.at(i).fan, expected.gpus.at(i).fan);
+        QCOMPARE(actual.gpus.at(i).gpuClock, expected.gpus.at(i).gpuClock);
+        QCOMPARE(actual.gpus.at(i).memClock, expected.gpus.at(i).memClock);
+        QCOMPARE(actual.gpus.at(i).power, expected.gpus.at(i).power);
+        QCOMPARE(actual.gpus.at(i).hashrate, expected.gpus.at(i).hashrate);
+    }
+}
+
+// The start of a key frame up to its GPU count, written by hand
+QByteArray tst_telemetryCodec::keyHeader(quint64 gpus)
+{
+    bitWriter out;
+    out.writeBits(telemetryEncoder::VERSION, 8);
+    out.writeBit(true);
+    out.writeBit(true);
+    out.writeVarint(1500000000000LL);
+    out.writeVarint(gpus);
+    return out.finish();
+}
+
+void tst_telemetryCodec::keyAndDeltaFrames()
+{
+    telemetryEncoder encoder;
+    telemetryDecoder decoder;
+    qint64 time = 1500000000000LL;
+    for(int step = 0; step < telemetryEncoder::KEY_INTERVAL + 10; step++)
+    {
+        // a jittery one second period
+        time += 1000 + (step % 5) - 2;
+        fleetProtocol::telemetry t = sample(time, 3, step);
+        QByteArray payload = encoder.encode(t);
+        fleetProtocol::telemetry decoded;
+        QVERIFY(decoder.decode(payload, &decoded));
+        compare(decoded, t);
+    }
+}
+
+void tst_telemetryCodec::gpuCountChange()
+{
+    telemetryEncoder encoder;
+    telemetryDecoder decoder;
+    fleetProtocol::telemetry decoded;
+    QVERIFY(decoder.decode(encoder.encode(sample(1000, 2, 0)), &decoded));
+    QVERIFY(decoder.decode(encoder.encode(sample(2000, 2, 1)), &decoded));
+
+    // a card came back: a key frame, the decoder follows without a reset
+    fleetProtocol::telemetry t = sample(3000, 3, 2);
+    QVERIFY(decoder.decode(encoder.encode(t), &decoded));
+    compare(decoded, t);
+    t = sample(4000, 1, 3);
+    QVERIFY(decoder.decode(encoder.encode(t), &decoded));
+    compare(decoded, t);
+}
+
+void tst_telemetryCodec::deltaWithoutKey()
+{
+    telemetryEncoder encoder;
+    encoder.encode(sample(1000, 2, 0));
+    QByteArray delta = encoder.encode(sample(2000, 2, 1));
+
+    telemetryDecoder late;
+    fleetProtocol::telemetry decoded;
+    QVERIFY(!late.decode(delta, &decoded));
+}
+
+void tst_telemetryCodec::truncatedPayload()
+{
+    telemetryEncoder encoder;
+    QByteArray key = encoder.encode(sample(1000, 2, 0));
+    QByteArray delta = encoder.encode(sample(2000, 2, 1));
+    fleetProtocol::telemetry decoded;
+
+    // every byte holds some of the frame, none of its prefixes decodes
+    for(int size = 0; size < key.size(); size++)
+    {
+        telemetryDecoder decoder;
+        QVERIFY2(!decoder.decode(key.left(size), &decoded), qPrintable(QString::number(size)));
+    }
+    // from 1: an empty payload is a version mismatch, which leaves the stream alone
+    for(int size = 1; size < delta.size(); size++)
+    {
+        telemetryDecoder decoder;
+        QVERIFY(decoder.decode(key, &decoded));
+        QVERIFY2(!decoder.decode(delta.left(size), &decoded), qPrintable(QString::number(size)));
+        // and the stream waits for the next key frame
+        QVERIFY(!decoder.decode(delta, &decoded));
+    }
+}
+
+void tst_telemetryCodec::gpuCountOver255()
+{
+    telemetryDecoder decoder;
+    fleetProtocol::telemetry decoded;
+    QVERIFY(!decoder.decode(keyHeader(256), &decoded));
+    // would be negative as an int
+    QVERIFY(!decoder.decode(keyHeader(Q_UINT64_C(0xffffffff80000000)), &decoded));
+}
+
+void tst_telemetryCodec::corruptFloatWindow()
+{
+    fleetProtocol::telemetry decoded;
+
+    // new window: 31 leading bits and 63 significant ones don't fit in 64
+    bitWriter tooWide;
+    tooWide.writeBits(telemetryEncoder::VERSION, 8);
+    tooWide.writeBit(true);
+    tooWide.writeBit(true);
+    tooWide.writeVarint(1000);
+    tooWide.writeVarint(0);
+    tooWide.writeSigned(0);
+    tooWide.writeSigned(0);
+    tooWide.writeSigned(0);
+    tooWide.writeBit(true);
+    tooWide.writeBit(true);
+    tooWide.writeBits(31, 5);
+    tooWide.writeBits(63, 6);
+    tooWide.writeBits(~Q_UINT64_C(0), 63);
+    telemetryDecoder first;
+    QVERIFY(!first.decode(tooWide.finish(), &decoded));
+
+    // the previous window, right after a key frame reset it
+    bitWriter noWindow;
+    noWindow.writeBits(telemetryEncoder::VERSION, 8);
+    noWindow.writeBit(true);
+    noWindow.writeBit(true);
+    noWindow.writeVarint(1000);
+    noWindow.writeVarint(0);
+    noWindow.writeSigned(0);
+    noWindow.writeSigned(0);
+    noWindow.writeSigned(0);
+    noWindow.writeBit(true);
+    noWindow.writeBit(false);
+    noWindow.writeBits(~Q_UINT64_C(0), 64);
+    telemetryDecoder second;
+    QVERIFY(!second.decode(noWindow.finish(), &decoded));
+}
+
+QTEST_GUILESS_MAIN(tst_telemetryCodec)
+#include "tst_telemetrycodec.moc"
@@ -0,0 +1,178 @@
+#include "tracer.h"
+#include <QThread>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QVector>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+
+static QMutex registryMutex;
+static QVector<tracer::ring*> registry;
+
+// gives the ring back when its thread ends, a new thread may reuse it
+struct ringHolder
+{
+    ringHolder() : r(Q_NULLPTR), failed(false) {}
+    ~ringHolder(){if(r) r->inUse.store(false);}
+    tracer::ring* r;
+    bool failed;
+};
+
+static thread_local ringHolder localRing;
+
+static QString threadName()
+{
+    QThread* thread = QThread::currentThread();
+    if(QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+        return "main";
+    if(!thread->objectName().isEmpty())
+        return thread->objectName();
+    return thread->metaObject()->className();
+}
+
+static tracer::ring* acquireRing()
+{
+    QMutexLocker lock(&registryMutex);
+    tracer::ring* r = Q_NULLPTR;
+    if(registry.size() < tracer::MAX_RINGS)
+    {
+        r = new tracer::ring();
+        registry << r;
+    }
+    else
+    {
+        // past MAX_RINGS the rings of finished threads are recycled
+        foreach(tracer::ring* candidate, registry)
+        {
+            if(!candidate->inUse.load())
+            {
+                r = candidate;
+                break;
+            }
+        }
+        if(!r)
+            return Q_NULLPTR;
+    }
+    r->head.store(0);
+    r->inUse.store(true);
+    r->tid = (quint64)(quintptr)QThread::currentThreadId();
+    r->thread = threadName();
+    return r;
+}
+
+bool tracer::compiledIn()
+{
+#ifdef SELECTUM_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 tracer::now()
+{
+    static QElapsedTimer clock;
+    static bool started = (clock.start(), true);
+    Q_UNUSED(started);
+    return clock.nsecsElapsed();
+}
+
+void tracer::record(const char* name, qint64 start, qint64 duration)
+{
+    ringHolder& holder = localRing;
+    if(!holder.r)
+    {
+        if(holder.failed)
+            return;
+        holder.r = acquireRing();
+        holder.failed = !holder.r;
+        if(!holder.r)
+            return;
+    }
+    ring* r = holder.r;
+    quint64 head = r->head.load(std::memory_order_relaxed);
+    event& e = r->events[head % RING_SIZE];
+    e.name = name;
+    e.start = start;
+    e.duration = duration;
+    // published after the slot is filled
+    r->head.store(head + 1, std::memory_order_release);
+}
+
+static void appendEscaped(QByteArray& out, const QString& text)
+{
+    QByteArray utf8 = text.toUtf8();
+    for(int i = 0; i < utf8.size(); i++)
+    {
+        char c = utf8.at(i);
+        if(c == '"' || c == '\\')
+            out += '\\';
+        if((unsigned char)c >= 0x20)
+            out += c;
+    }
+}
+
+QByteArray tracer::chromeJson(int* events)
+{
+    QByteArray out;
+    out.reserve(1024 * 1024);
+    out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    int count = 0;
+    bool first = true;
+
+    QMutexLocker lock(&registryMutex);
+    QVector<event> copy;
+    foreach(ring* r, registry)
+    {
+        // the owner keeps writing while we copy: whatever it may have
+        // overwritten meanwhile is left out
+        quint64 head = r->head.load(std::memory_order_acquire);
+        quint64 begin = head > (quint64)RING_SIZE ? head - RING_SIZE : 0;
+        copy.resize(0);
+        for(quint64 i = begin; i < head; i++)
+            copy << r->events[i % RING_SIZE];
+        quint64 after = r->head.load(std::memory_order_acquire);
+        int skip = after > (quint64)RING_SIZE && after - RING_SIZE > begin ? (int)(after - RING_SIZE - begin) : 0;
+        if(skip >= copy.size())
+            continue;
+
+        QByteArray tid = QByteArray::number(r->tid);
+        out += first ? "" : ",";
+        first = false;
+        out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":\"";
+        appendEscaped(out, r->thread);
+        out += "\"}}";
+        for(int i = skip; i < copy.size(); i++)
+        {
+            const event& e = copy.at(i);
+            out += ",{\"ph\":\"X\",\"name\":\"";
+            out += e.name;
+            out += "\",\"pid\":" + pid + ",\"tid\":" + tid;
+            out += ",\"ts\":" + QByteArray::number(e.start / 1000.0, 'f', 3);
+            out += ",\"dur\":" + QByteArray::number(e.duration / 1000.0, 'f', 3) + "}";
+            count++;
+        }
+    }
+    out += "]}\n";
+    if(events)
+        *events = count;
+    return out;
+}
+
+int tracer::dump(const QString& path)
+{
+    int count = 0;
+    QByteArray json = chromeJson(&count);
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size())
+        return -1;
+    return count;
+}
+
+QString tracer::defaultPath()
+{
+    return QDir::currentPath() + QDir::separator() + "selectum-trace-" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".json";
+}
@@ -0,0 +1,66 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QByteArray>
+#include <atomic>
+
+// Scoped timing of the hot paths, dumped as Chrome trace events
+// (chrome://tracing, ui.perfetto.dev). Each thread writes its own ring of
+// the last RING_SIZE scopes without locking; only the first scope of a
+// thread takes the registry lock to get a ring.
+//
+// SELECTUM_TRACE_SCOPE compiles to nothing unless the build has
+// DEFINES += SELECTUM_TRACING, so release builds pay nothing.
+class tracer
+{
+public:
+    static const int RING_SIZE = 16384;
+    static const int MAX_RINGS = 64;
+
+    struct event
+    {
+        const char* name;   // a literal, only the pointer is kept
+        qint64 start;       // ns on the tracer clock
+        qint64 duration;
+    };
+
+    struct ring
+    {
+        event events[RING_SIZE];
+        std::atomic<quint64> head;  // events ever written, the slot is head % RING_SIZE
+        std::atomic<bool> inUse;
+        quint64 tid;
+        QString thread;
+    };
+
+    static bool compiledIn();
+    static qint64 now();
+    static void record(const char* name, qint64 start, qint64 duration);
+
+    // Chrome trace JSON of what the rings hold now
+    static QByteArray chromeJson(int* events = Q_NULLPTR);
+    // number of events written, -1 when the file cannot be written
+    static int dump(const QString& path);
+    static QString defaultPath();
+};
+
+class traceScope
+{
+public:
+    explicit traceScope(const char* name) : _name(name), _start(tracer::now()) {}
+    ~traceScope(){tracer::record(_name, _start, tracer::now() - _start);}
+private:
+    const char* _name;
+    qint64 _start;
+};
+
+#ifdef SELECTUM_TRACING
+#define SELECTUM_TRACE_JOIN2(a, b) a##b
+#define SELECTUM_TRACE_JOIN(a, b) SELECTUM_TRACE_JOIN2(a, b)
+#define SELECTUM_TRACE_SCOPE(name) traceScope SELECTUM_TRACE_JOIN(_traceScope, __LINE__)(name)
+#else
+#define SELECTUM_TRACE_SCOPE(name) (void)0
+#endif
+
+#endif // TRACER_H